@@ -27,14 +27,22 @@ To use a file-like objects as input/output, use the provided Compressor & Decomp
 classes instead or manually utilise the context-using low-level methods. All methods are thread safe unless stated.
 """
 
-from threading import Lock
+from collections import deque
+from threading import Lock, Thread
 
-from .compat import Iterable as __Iterable
+try:
+    from os import writev as _writev
+except ImportError:
+    # Windows, Python v2.7
+    _writev = None
+
+from .compat import (Iterable as __Iterable, Queue as _Queue, QueueEmpty as _QueueEmpty, Future as _Future,
+                     buffer_nbytes as _buffer_nbytes)
 
 # pylint: disable=unused-import
 from _lz4framed import (LZ4F_BLOCKSIZE_DEFAULT, LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX256KB,  # noqa (unused import)
                         LZ4F_BLOCKSIZE_MAX1MB, LZ4F_BLOCKSIZE_MAX4MB,
-                        LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MIN_HC, LZ4F_COMPRESSION_MAX,
+                        LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MIN_HC, LZ4F_COMPRESSION_MAX, LZ4F_COMPRESSION_FASTEST,
                         LZ4F_ERROR_GENERIC, LZ4F_ERROR_maxBlockSize_invalid, LZ4F_ERROR_blockMode_invalid,
                         LZ4F_ERROR_contentChecksumFlag_invalid, LZ4F_ERROR_compressionLevel_invalid,
                         LZ4F_ERROR_headerVersion_wrong, LZ4F_ERROR_blockChecksum_unsupported,
@@ -43,11 +51,347 @@ from _lz4framed import (LZ4F_BLOCKSIZE_DEFAULT, LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLO
                         LZ4F_ERROR_frameSize_wrong, LZ4F_ERROR_srcPtr_wrong, LZ4F_ERROR_decompressionFailed,
                         LZ4F_ERROR_headerChecksum_invalid, LZ4F_ERROR_contentChecksum_invalid,
                         LZ4F_VERSION, LZ4_VERSION, __version__,
-                        Lz4FramedError, Lz4FramedNoDataError,
-                        compress, decompress,
+                        Lz4FramedError, Lz4FramedNoDataError, Lz4FramedOutputLimitError,
+                        LazyLz4Buffer, LazyLz4BufferCache,
+                        compress, decompress, decompress_into,
                         create_compression_context, compress_begin, compress_update, compress_end,
                         create_decompression_context, get_frame_info, decompress_update,
-                        get_block_size)
+                        get_block_size, compress_file, decompress_file, set_thread_pool_size,
+                        get_thread_pool_stats, compress_flush, scan_frames, verify, compress_block, decompress_block,
+                        compress_block_dest_size, compress_dest_size,
+                        _async_completed, _compress_async, _decompress_async, _compress_update_async,
+                        _compress_flush_async, _decompress_update_async, _decompress_into_async)
+
+try:
+    from _lz4framed import (create_socket_compressor, socket_compress_update, socket_compress_flush,
+                            socket_compress_end, socket_send_pending, create_socket_decompressor,
+                            socket_decompress_recv)
+except ImportError:
+    # Windows
+    create_socket_compressor = create_socket_decompressor = None
+
+
+# How much a pipelined Decompressor reads from its file-like object at once
+_PIPELINE_READ_SIZE = 256 * 1024
+# Most buffers to pass to a single writev() call (IOV_MAX is 1024 on common platforms)
+_WRITEV_MAX_BUFFERS = 1024
+# Socket(De)Compressor timeout indicating that the socket's own one should be used
+_SOCKET_TIMEOUT_DEFAULT = object()
+
+
+def _fileno(fp):
+    """Returns file descriptor of fp or None if it does not have one"""
+    try:
+        return fp.fileno()
+    # io.UnsupportedOperation is a subclass of both
+    except (AttributeError, IOError, ValueError):
+        return None
+
+
+def _writev_all(fd, buffers):
+    """Writes all of buffers to fd, resuming after partial writes"""
+    while buffers:
+        written = _writev(fd, buffers)
+        index = 0
+        while index < len(buffers) and written >= len(buffers[index]):
+            written -= len(buffers[index])
+            index += 1
+        buffers = buffers[index:]
+        if written:
+            buffers[0] = memoryview(buffers[0])[written:]
+
+
+class _CoalescingWriter(object):
+    """Collects written data until at least size bytes (or too many buffers for a single writev() call) are pending
+       and then writes them in one go: Using writev() if fd is set, otherwise joined into one write() call. Zero-length
+       writes are dropped."""
+
+    def __init__(self, write, size, fd=None, flush=None):
+        """
+        Args:
+            write: Function to call with joined data (or single pending buffer)
+            size (int): How many bytes to collect before writing
+            fd (int): Descriptor to write multiple buffers to directly, if any
+            flush: Function to call before writing to fd directly (i.e. to flush buffering of file-like object owning
+                   fd), if any
+        """
+        self.__write = write
+        self.__size = size
+        self.__fd = fd if _writev else None
+        self.__flush = flush
+        self.__pending = []
+        self.__pending_len = 0
+
+    def write(self, data):
+        if data:
+            self.__pending.append(data)
+            self.__pending_len += len(data)
+            if self.__pending_len >= self.__size or len(self.__pending) >= _WRITEV_MAX_BUFFERS:
+                self.flush()
+
+    def flush(self):
+        """Writes any pending data"""
+        pending = self.__pending
+        if not pending:
+            return
+        self.__pending = []
+        self.__pending_len = 0
+        if len(pending) == 1:
+            self.__write(pending[0])
+        elif self.__fd is None:
+            self.__write(b''.join(pending))
+        else:
+            if self.__flush:
+                self.__flush()
+            _writev_all(self.__fd, pending)
+
+
+class _BackgroundWriter(object):
+    """Passes queued data to write() from a separate thread. Errors raised by write() are re-raised on subsequent
+       write() or close() calls."""
+
+    def __init__(self, write, depth):
+        self.__queue = _Queue(depth)
+        self.__error = None
+        self.__thread = Thread(target=self.__run, args=(write,), name='lz4framed-writer')
+        self.__thread.daemon = True
+        self.__thread.start()
+
+    def __run(self, write):
+        get = self.__queue.get
+        while True:
+            data = get()
+            if data is None:
+                break
+            # keep consuming after failure so that producer does not block
+            if self.__error is None:
+                try:
+                    write(data)
+                except Exception as ex:  # pylint: disable=broad-except
+                    self.__error = ex
+
+    def __check(self):
+        if self.__error is not None:
+            raise self.__error  # pylint: disable=raising-bad-type
+
+    def write(self, data):
+        self.__check()
+        if data:
+            self.__queue.put(data)
+
+    def close(self):
+        """Waits for all queued data to be written"""
+        self.__queue.put(None)
+        self.__thread.join()
+        self.__check()
+
+
+class _BackgroundReader(object):
+    """Calls read() ahead of time from a separate thread, keeping up to depth results queued. Errors raised by read()
+       are re-raised by this object's read() method. Note that the thread stops after the first empty read."""
+
+    def __init__(self, read, read_size, depth):
+        self.__queue = _Queue(depth)
+        self.__stopped = False
+        thread = Thread(target=self.__run, args=(read, read_size), name='lz4framed-reader')
+        thread.daemon = True
+        thread.start()
+
+    def __run(self, read, read_size):
+        put = self.__queue.put
+        try:
+            while not self.__stopped:
+                data = read(read_size)
+                put(data)
+                if not data:
+                    break
+        except Exception as ex:  # pylint: disable=broad-except
+            put(ex)
+
+    def read(self):
+        data = self.__queue.get()
+        if isinstance(data, Exception):
+            raise data
+        return data
+
+    def close(self):
+        """Stops reading ahead. (Does not wait for a read already in progress to complete.)"""
+        self.__stopped = True
+        # make space for any pending put
+        try:
+            while True:
+                self.__queue.get_nowait()
+        except _QueueEmpty:
+            pass
+
+
+__async_lock = Lock()
+__async_dispatcher = None
+
+
+def __async_dispatch():
+    while True:
+        for completed in _async_completed():
+            # None only on memory exhaustion
+            if completed is not None:
+                future, result, exception = completed
+                if exception is None:
+                    future.set_result(result)
+                else:
+                    future.set_exception(exception)
+
+
+def _submit_async(submit, *args, **kwargs):
+    """Calls native submit function with a new future (and given arguments), returning said future. Futures are
+       resolved by a single dispatcher thread (shared by all asynchronous operations), which also runs any callbacks
+       added to them. Hence callbacks should not block."""
+    global __async_dispatcher  # pylint: disable=global-statement
+    if _Future is None:
+        raise RuntimeError('concurrent.futures module unavailable')
+    with __async_lock:
+        if __async_dispatcher is None or not __async_dispatcher.is_alive():
+            __async_dispatcher = Thread(target=__async_dispatch, name='lz4framed-async')
+            __async_dispatcher.daemon = True
+            __async_dispatcher.start()
+    future = _Future()
+    future.set_running_or_notify_cancel()
+    submit(future, *args, **kwargs)
+    return future
+
+
+def compress_async(b, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True, checksum=False,
+                   level=LZ4F_COMPRESSION_MIN):
+    """Like compress() but runs on the shared thread pool (without the GIL), returning a concurrent.futures.Future
+       for the result. b can be any object supporting the buffer protocol and must not be modified until the future
+       has completed. Raises Lz4FramedNoDataError immediately if input is of zero length."""
+    return _submit_async(_compress_async, b, block_size_id=block_size_id, block_mode_linked=block_mode_linked,
+                         checksum=checksum, level=level)
+
+
+def decompress_async(b, buffer_size=1024):
+    """Like decompress() but runs on the shared thread pool (without the GIL), returning a concurrent.futures.Future
+       for the result. b can be any object supporting the buffer protocol and must not be modified until the future
+       has completed. Raises Lz4FramedNoDataError immediately if input is of zero length."""
+    return _submit_async(_decompress_async, b, buffer_size=buffer_size)
+
+
+def decompress_into_async(b, buffer):
+    """Like decompress_into() but runs on the shared thread pool (without the GIL), returning a
+       concurrent.futures.Future for the number of bytes written. Neither b nor buffer may be modified until the
+       future has completed. Raises Lz4FramedNoDataError immediately if input is of zero length."""
+    return _submit_async(_decompress_into_async, b, buffer)
+
+
+class _AsyncChain(object):
+    """Submits asynchronous operations (via _submit_async) such that each is only started once the previous one has
+       completed, e.g. for operations on the same context. The result of each is optionally passed through process()
+       (in order, on the dispatcher thread) before being used to resolve the future returned by submit()."""
+
+    def __init__(self, process=None):
+        self.__process = process
+        self.__lock = Lock()
+        self.__last = None
+
+    def submit(self, submit, *args, **kwargs):
+        future = _Future()
+        future.set_running_or_notify_cancel()
+        with self.__lock:
+            previous, self.__last = self.__last, future
+
+        def completed(native):
+            try:
+                result = native.result()
+                if self.__process:
+                    result = self.__process(result)
+            except Exception as ex:  # pylint: disable=broad-except
+                future.set_exception(ex)
+            else:
+                future.set_result(result)
+
+        def start(_=None):
+            try:
+                _submit_async(submit, *args, **kwargs).add_done_callback(completed)
+            except Exception as ex:  # pylint: disable=broad-except
+                future.set_exception(ex)
+
+        if previous is None:
+            start()
+        else:
+            previous.add_done_callback(start)
+        return future
+
+    def wait(self):
+        """Waits for the most recently submitted operation (and therefore all others) to complete"""
+        last = self.__last
+        if last is not None:
+            # errors will have been reported via relevant future already
+            last.exception()
+
+
+def _next_completed(pending, lookahead):
+    """Yields results from pending futures (oldest first) until fewer than lookahead remain"""
+    while len(pending) >= lookahead:
+        yield pending.popleft().result()
+
+
+def compress_packets(b, packet_size, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, checksum=False):
+    """Splits b into consecutive lz4 frames of at most packet_size bytes each (e.g. to fit into datagrams), yielding
+       each frame. Every frame can be decompressed on its own (via decompress()), so loss of one packet does not affect
+       others. See compress_dest_size() for arguments & exceptions."""
+    view = memoryview(b)
+    if not view:
+        raise Lz4FramedNoDataError
+    while view:
+        frame, consumed = compress_dest_size(view, packet_size, block_size_id=block_size_id, checksum=checksum)
+        yield frame
+        view = view[consumed:]
+
+
+def compress_iter(iterable, lookahead=4, **kwargs):
+    """Compresses chunks of data from iterable into a single lz4 frame, yielding compressed chunks. Compression runs
+       on the shared thread pool (without the GIL), so that the next input can be produced at the same time. Up to
+       lookahead inputs are queued (and therefore held in memory) before waiting for the oldest one to be compressed.
+       Inputs can be any objects supporting the buffer protocol and must not be modified until the iterator has moved
+       on by at least lookahead inputs. Empty inputs are skipped. Remaining keyword arguments are passed to Compressor.
+       Raises Lz4FramedNoDataError if there is no input at all. Note that yielded chunks can be zero length."""
+    if lookahead < 1:
+        raise ValueError('lookahead (%d) invalid' % lookahead)
+    compressor = Compressor(**kwargs)
+    pending = deque()
+    submitted = False
+    for chunk in iterable:
+        if _buffer_nbytes(chunk):
+            pending.append(compressor.update_async(chunk))
+            submitted = True
+            for output in _next_completed(pending, lookahead):
+                yield output
+    if not submitted:
+        raise Lz4FramedNoDataError
+    for output in _next_completed(pending, 1):
+        yield output
+    yield compressor.end()
+
+
+def decompress_iter(iterable, lookahead=4):
+    """Decompresses lz4 frame(s) from chunks of data yielded by iterable, yielding decompressed chunks.
+       Decompression runs on the shared thread pool (without the GIL), so that the next input can be produced at the
+       same time. See compress_iter() regarding lookahead and inputs. Raises Lz4FramedNoDataError if input ends
+       before the frame is complete. Note that yielded chunks can be zero length."""
+    if lookahead < 1:
+        raise ValueError('lookahead (%d) invalid' % lookahead)
+    ctx = create_decompression_context()
+    chain = _AsyncChain()
+    pending = deque()
+    input_hint = None
+    for chunk in iterable:
+        if _buffer_nbytes(chunk):
+            pending.append(chain.submit(_decompress_update_async, ctx, chunk))
+            for output, input_hint in _next_completed(pending, lookahead):
+                yield output
+    for output, input_hint in _next_completed(pending, 1):
+        yield output
+    if input_hint != 0:
+        raise Lz4FramedNoDataError
 
 
 class Compressor(object):
@@ -75,7 +419,7 @@ class Compressor(object):
     """
 
     def __init__(self, fp=None, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True, checksum=False,
-                 autoflush=False, level=LZ4F_COMPRESSION_MIN):
+                 autoflush=False, level=LZ4F_COMPRESSION_MIN, pipeline=False, prefetch=4, write_buffer_size=0):
         """
         Args:
             fp: File like object (supporting write() method) to write compressed data to. If not set, data will be
@@ -87,15 +431,45 @@ class Compressor(object):
                               waiting for internal buffer to be filled. (This reduces internal buffer size.)
             level (int): Compression level. Values lower than 3 use fast compression. Recommended
                          range for hc compression is between 4 and 9, with a maximum of LZ4_COMPRESSION_MAX.
+                         Negative values (down to LZ4F_COMPRESSION_FASTEST) trade ratio for speed.
+            pipeline (bool): Whether to write to fp from a background thread, so that compression of the next
+                             update() can overlap with output. Write errors are raised by a subsequent update() or
+                             end() call. Requires fp.
+            prefetch (int): How many outputs can be queued for writing in pipeline mode
+            write_buffer_size (int): If non-zero, collect output until at least this many bytes are pending, then
+                                     write it in one go (via os.writev() if fp has a file descriptor, so that fewer
+                                     system calls are needed for small outputs). Pending output is written by flush()
+                                     and end(). Requires fp.
         """
         self.__ctx = create_compression_context()
         self.__lock = Lock()
+        self.__writer = None
+        self.__coalescer = None
+        self.__async = _AsyncChain(self.__process_async)
+        if write_buffer_size < 0:
+            raise ValueError('write_buffer_size (%d) invalid' % write_buffer_size)
         if fp is None:
+            if pipeline:
+                raise ValueError('pipeline requires fp')
+            if write_buffer_size:
+                raise ValueError('write_buffer_size requires fp')
             self.__write = None
         elif not callable(fp.write):
             raise TypeError('fp.write not callable')
+        elif pipeline:
+            if prefetch < 1:
+                raise ValueError('prefetch (%d) invalid' % prefetch)
+            self.__writer = _BackgroundWriter(fp.write, prefetch)
+            self.__write = self.__writer.write
         else:
             self.__write = fp.write
+        if write_buffer_size:
+            if self.__writer:
+                self.__coalescer = _CoalescingWriter(self.__write, write_buffer_size)
+            else:
+                self.__coalescer = _CoalescingWriter(self.__write, write_buffer_size, fd=_fileno(fp),
+                                                     flush=getattr(fp, 'flush', None))
+            self.__write = self.__coalescer.write
         self.__header = compress_begin(self.__ctx, block_size_id=block_size_id, block_mode_linked=block_mode_linked,
                                        checksum=checksum, autoflush=autoflush, level=level)
 
@@ -112,17 +486,7 @@ class Compressor(object):
            sometimes output might be zero length (if being buffered by lz4).
            Raises Lz4FramedNoDataError if input is of zero length."""
         with self.__lock:
-            output = compress_update(self.__ctx, b)
-            if self.__write:
-                self.__write(self.__header)
-                self.__header = None
-                self.__write(output)
-                self.update = self.__updateNextWrite
-            else:
-                header = self.__header
-                self.__header = None
-                self.update = self.__updateNextReturn
-                return header + output
+            return self.__output(compress_update(self.__ctx, b))
 
     # post-first update methods so do not require header write & fp checks
     def __updateNextWrite(self, b):  # pylint: disable=invalid-name
@@ -131,11 +495,57 @@ class Compressor(object):
     def __updateNextReturn(self, b):  # pylint: disable=invalid-name
         return compress_update(self.__ctx, b)
 
+    def __output(self, output):
+        """Writes or returns output, preceded by the frame header if not output yet. Requires lock."""
+        if self.__header is not None:
+            output = self.__header + output
+            self.__header = None
+            self.update = self.__updateNextWrite if self.__write else self.__updateNextReturn
+        if self.__write:
+            self.__write(output)
+        else:
+            return output
+
+    def flush(self):
+        """Compresses any data buffered by lz4 (when autoflush is not set), outputting it as return from this function
+           or by writing to fp (including any output pending due to write_buffer_size)"""
+        with self.__lock:
+            output = self.__output(compress_flush(self.__ctx))
+            if self.__coalescer:
+                self.__coalescer.flush()
+            return output
+
+    def __process_async(self, output):
+        with self.__lock:
+            return self.__output(output)
+
+    def update_async(self, b):
+        """Like update() but compresses on the shared thread pool (without the GIL), returning a
+           concurrent.futures.Future for the result. Operations are applied (and any output written to fp) in
+           submission order. b can be any object supporting the buffer protocol and must not be modified until the
+           future has completed. Note: Futures are resolved by a shared dispatcher thread, so fp.write() is also called
+           from said thread. Do not mix with update()/flush() whilst asynchronous calls are outstanding."""
+        if not _buffer_nbytes(b):
+            raise Lz4FramedNoDataError
+        return self.__async.submit(_compress_update_async, self.__ctx, b)
+
+    def flush_async(self):
+        """Like flush() but asynchronous, see update_async()"""
+        return self.__async.submit(_compress_flush_async, self.__ctx)
+
     def end(self):
-        """Finalise lz4 frame, outputting any remaining as return from this function or by writing to fp)"""
+        """Finalise lz4 frame, outputting any remaining as return from this function or by writing to fp). Waits for
+           any outstanding asynchronous operations first."""
+        self.__async.wait()
         with self.__lock:
             if self.__write:
-                self.__write(compress_end(self.__ctx))
+                try:
+                    self.__write(compress_end(self.__ctx))
+                    if self.__coalescer:
+                        self.__coalescer.flush()
+                finally:
+                    if self.__writer:
+                        self.__writer.close()
             else:
                 return compress_end(self.__ctx)
 
@@ -152,13 +562,21 @@ class Decompressor(__Iterable):
 
     The decompressor will automatically choose a meaningful read size. Note that some
     iterator calls might return zero-length data. The iterator raises LZ4FNoDataError
-    if input (from fp.read) is of zero length, before decompression finished.
+    if input (from fp.read) is of zero length, before decompression finished. If fp
+    supports readinto(), input is read into a single re-used buffer instead.
     """
 
-    def __init__(self, fp):
+    def __init__(self, fp, pipeline=False, prefetch=4, max_output_size=None):
         """
         Args:
             fp: File like object (supporting read() method) to read compressed data from.
+            pipeline (bool): Whether to read from fp in a background thread, so that reads can overlap with
+                             decompression. Note: In this mode fixed-size reads are used, i.e. data following the end
+                             of the frame might also be consumed from fp.
+            prefetch (int): How many reads to queue up ahead of decompression in pipeline mode
+            max_output_size (int): If set, the most uncompressed data to allow for the frame. Iteration raises
+                                   Lz4FramedOutputLimitError as soon as the frame states a larger content size or
+                                   decompression would exceed it.
         """
         if fp is None:
             raise TypeError('fp')
@@ -166,26 +584,133 @@ class Decompressor(__Iterable):
             raise TypeError('fp.read not callable')
         else:
             self.__read = fp.read
+        readinto = getattr(fp, 'readinto', None)
+        self.__readinto = readinto if callable(readinto) else None
+        if pipeline and prefetch < 1:
+            raise ValueError('prefetch (%d) invalid' % prefetch)
+        if max_output_size is not None and max_output_size < 0:
+            raise ValueError('max_output_size (%d) invalid' % max_output_size)
+        self.__max_output_size = max_output_size
+        self.__output_size = 0
+        self.__prefetch = prefetch if pipeline else 0
         self.__info = None
         self.__ctx = create_decompression_context()
         self.__lock = Lock()
+        # for read(): iterator over decompressed chunks & unread part of last one
+        self.__chunks = None
+        self.__pending = b''
 
     def __iter__(self):
+        if self.__prefetch:
+            return self.__iter_pipelined()
+        if self.__readinto:
+            return self.__iter_readinto()
+        return self.__iter_sequential()
+
+    def __update(self, data, chunk_size):
+        """decompress_update() on own context, enforcing max_output_size across calls"""
+        limit = self.__max_output_size
+        if limit is None:
+            return decompress_update(self.__ctx, data, chunk_size)
+        try:
+            output = decompress_update(self.__ctx, data, chunk_size, max_output_size=limit - self.__output_size)
+        except Lz4FramedOutputLimitError:
+            # report overall rather than remaining limit
+            raise Lz4FramedOutputLimitError('output limit exceeded', limit)
+        for chunk in output[:-1]:
+            self.__output_size += len(chunk)
+        return output
+
+    def __set_info(self, info):
+        self.__info = info
+        if self.__max_output_size is not None and info['length'] > self.__max_output_size:
+            raise Lz4FramedOutputLimitError('output limit exceeded', self.__max_output_size)
+
+    def __iter_pipelined(self):
+        ctx = self.__ctx
+        chunk_size = get_block_size()  # output chunk size, adjusted once block size known
+        input_hint = 1
+
+        with self.__lock:
+            reader = _BackgroundReader(self.__read, _PIPELINE_READ_SIZE, self.__prefetch)
+            try:
+                data = reader.read()
+                # header on its own first, so frame info available even if whole frame contained in first read
+                output = self.__update(data[:15], chunk_size)
+                data = data[15:]
+                try:
+                    info = get_frame_info(ctx)
+                except Lz4FramedError as ex:
+                    if ex.args[1] != LZ4F_ERROR_frameHeader_incomplete:
+                        raise
+                else:
+                    self.__set_info(info)
+                    chunk_size = get_block_size(info['block_size_id'])
+                input_hint = output.pop()
+
+                while input_hint > 0:
+                    for element in output:
+                        yield element
+                    # empty read (i.e. incomplete frame) results in Lz4FramedNoDataError
+                    output = self.__update(data or reader.read(), chunk_size)
+                    data = None
+                    input_hint = output.pop()
+                for element in output:
+                    yield element
+            finally:
+                reader.close()
+
+    def __iter_sequential(self):
         ctx = self.__ctx
         read = self.__read
         input_hint = 15  # enough to read largest header
         chunk_size = 32  # output chunk size, will be increased once block size known
 
         with self.__lock:
-            output = decompress_update(ctx, read(input_hint), chunk_size)
+            output = self.__update(read(input_hint), chunk_size)
+            try:
+                info = get_frame_info(ctx)
+            except Lz4FramedError as ex:
+                if ex.args[1] != LZ4F_ERROR_frameHeader_incomplete:
+                    # should not happen since have read 15 bytes
+                    raise
+            else:
+                self.__set_info(info)
+                chunk_size = get_block_size(info['block_size_id'])
+            input_hint = output.pop()
+
+            # return any data as part of header read, if present
+            for element in output:
+                yield element
+
+            while input_hint > 0:
+                output = self.__update(read(input_hint), chunk_size)
+                input_hint = output.pop()
+                for element in output:
+                    yield element
+
+    def __iter_readinto(self):
+        """As __iter_sequential but without allocating an object per read"""
+        ctx = self.__ctx
+        readinto = self.__readinto
+        input_hint = 15  # enough to read largest header
+        chunk_size = 32  # output chunk size, will be increased once block size known
+        # replaced by one sized for whole blocks once header has been decoded
+        view = memoryview(bytearray(input_hint))
+
+        with self.__lock:
+            output = self.__update(view[:readinto(view) or 0], chunk_size)
             try:
-                self.__info = info = get_frame_info(ctx)
+                info = get_frame_info(ctx)
             except Lz4FramedError as ex:
                 if ex.args[1] != LZ4F_ERROR_frameHeader_incomplete:
                     # should not happen since have read 15 bytes
                     raise
             else:
+                self.__set_info(info)
                 chunk_size = get_block_size(info['block_size_id'])
+                # block header & data, next block header (or end mark & checksum)
+                view = memoryview(bytearray(chunk_size + 8))
             input_hint = output.pop()
 
             # return any data as part of header read, if present
@@ -193,13 +718,196 @@ class Decompressor(__Iterable):
                 yield element
 
             while input_hint > 0:
-                output = decompress_update(ctx, read(input_hint), chunk_size)
+                # only expected for frames not using their declared block size
+                if input_hint > len(view):
+                    view = memoryview(bytearray(input_hint))
+                # empty read (i.e. incomplete frame) results in Lz4FramedNoDataError
+                output = self.__update(view[:readinto(view[:input_hint]) or 0], chunk_size)
                 input_hint = output.pop()
                 for element in output:
                     yield element
 
+    def read(self, n=-1):
+        """Returns (as bytes) up to n bytes of decompressed data, or all remaining data if n is negative. Fewer bytes
+           are only returned once the end of the frame has been reached (after which b'' is returned). Only as much
+           input as required is read & decompressed (i.e. whole blocks), so reading the start of a large frame does
+           not cost decompressing all of it. Must not be mixed with iteration over the same instance.
+
+        Raises:
+            Lz4FramedNoDataError: If input ends before the frame is complete
+        """
+        if self.__chunks is None:
+            self.__chunks = iter(self)
+        parts = []
+        # (stays non-zero if negative)
+        remaining = n
+        while remaining:
+            chunk = self.__pending
+            if not chunk:
+                chunk = next(self.__chunks, None)
+                if chunk is None:
+                    break
+            if 0 < remaining < len(chunk):
+                chunk = memoryview(chunk)
+                parts.append(chunk[:remaining])
+                self.__pending = chunk[remaining:]
+                break
+            parts.append(chunk)
+            self.__pending = b''
+            remaining -= len(chunk)
+        return b''.join(parts)
+
     @property
     def frame_info(self):
         """See get_frame_info(). Note: This will return None if not enough data has been
            read yet to decode header (typically at least one read from iterator)."""
         return self.__info
+
+
+def _socket_timeout(sock, timeout):
+    """Returns timeout for native socket functions (negative meaning no limit)"""
+    if timeout is _SOCKET_TIMEOUT_DEFAULT:
+        timeout = sock.gettimeout() if hasattr(sock, 'gettimeout') else None
+    return -1 if timeout is None else timeout
+
+
+class SocketCompressor(object):
+    """Compresses data into a single lz4 frame sent directly to a connected stream socket (POSIX only). Compression and
+    sending (of all pending output in one sendmsg() call) happen in native code without the GIL. Can be used as a
+    context manager, finalising the frame on exit (unless an exception occurs).
+
+    Blocking sockets (including ones with a timeout) are sent all output on each call. With non-blocking sockets any
+    output which cannot be sent straight away is kept and sent by subsequent calls, e.g. using selectors:
+
+        compressor.update(moreData)
+        if compressor.pending:
+            sel.register(sock, selectors.EVENT_WRITE)
+        ...
+        # when socket writable
+        if not compressor.send_pending():
+            sel.unregister(sock)
+    """
+
+    def __init__(self, sock, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True, checksum=False,
+                 autoflush=False, level=LZ4F_COMPRESSION_MIN, timeout=_SOCKET_TIMEOUT_DEFAULT):
+        """
+        Args:
+            sock: Socket (or its file descriptor) to send compressed data to
+            timeout (float): Seconds to wait each time the socket is not writable (None meaning no limit, zero meaning
+                             non-blocking). Defaults to sock.gettimeout() at the time of each call (or None if sock is
+                             a file descriptor).
+            Remaining arguments: See Compressor
+        """
+        if create_socket_compressor is None:
+            raise NotImplementedError('Socket (de)compression not supported on this platform')
+        self.__sock = sock
+        self.__timeout = timeout
+        self.__ctx = create_socket_compressor(sock if isinstance(sock, int) else sock.fileno(),
+                                              block_size_id=block_size_id, block_mode_linked=block_mode_linked,
+                                              checksum=checksum, autoflush=autoflush, level=level)
+        self.__pending = 0
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        if exc_type is None:
+            self.end()
+
+    def fileno(self):
+        """File descriptor of socket (e.g. for use with selectors)"""
+        return self.__sock if isinstance(self.__sock, int) else self.__sock.fileno()
+
+    @property
+    def pending(self):
+        """Number of bytes of compressed output not yet sent (as of last call)"""
+        return self.__pending
+
+    def update(self, b):
+        """Compresses b (any object supporting the buffer protocol), sending output. Returns number of bytes not yet
+           sent. Raises Lz4FramedNoDataError if input is of zero length."""
+        self.__pending = socket_compress_update(self.__ctx, b, _socket_timeout(self.__sock, self.__timeout))
+        return self.__pending
+
+    def flush(self):
+        """Compresses & sends any data buffered by lz4 (when autoflush is not set). Returns number of bytes not yet
+           sent."""
+        self.__pending = socket_compress_flush(self.__ctx, _socket_timeout(self.__sock, self.__timeout))
+        return self.__pending
+
+    def send_pending(self):
+        """Sends output which could not be sent previously. Returns number of bytes not yet sent."""
+        self.__pending = socket_send_pending(self.__ctx, _socket_timeout(self.__sock, self.__timeout))
+        return self.__pending
+
+    def end(self):
+        """Finalises lz4 frame, sending remaining output. Returns number of bytes not yet sent."""
+        self.__pending = socket_compress_end(self.__ctx, _socket_timeout(self.__sock, self.__timeout))
+        return self.__pending
+
+
+class SocketDecompressor(__Iterable):
+    """Decompresses lz4 frames received directly from a connected stream socket (POSIX only). Receiving (into a buffer
+    sized for whole blocks) and decompression happen in native code without the GIL. Only data belonging to the
+    current frame is received, so subsequent frames can be decompressed with the same instance. Iterating yields the
+    chunks of one frame, e.g.:
+
+        for chunk in SocketDecompressor(sock):
+            decoded.append(chunk)
+
+    With non-blocking sockets use recv() whenever the socket is readable instead, e.g. using selectors:
+
+        sel.register(sock, selectors.EVENT_READ)
+        ...
+        # when socket readable
+        decoded.extend(decompressor.recv())
+        if decompressor.finished:
+            ...
+
+    Both raise Lz4FramedNoDataError if the connection is closed before the frame is complete.
+    """
+
+    def __init__(self, sock, timeout=_SOCKET_TIMEOUT_DEFAULT):
+        """
+        Args:
+            sock: Socket (or its file descriptor) to receive compressed data from
+            timeout (float): Seconds to wait each time the socket is not readable (None meaning no limit, zero meaning
+                             non-blocking). Defaults to sock.gettimeout() at the time of each call (or None if sock is
+                             a file descriptor).
+        """
+        if create_socket_decompressor is None:
+            raise NotImplementedError('Socket (de)compression not supported on this platform')
+        self.__sock = sock
+        self.__timeout = timeout
+        self.__ctx = create_socket_decompressor(sock if isinstance(sock, int) else sock.fileno())
+        self.__finished = False
+
+    def fileno(self):
+        """File descriptor of socket (e.g. for use with selectors)"""
+        return self.__sock if isinstance(self.__sock, int) else self.__sock.fileno()
+
+    @property
+    def finished(self):
+        """Whether the last recv() call completed a frame"""
+        return self.__finished
+
+    def recv(self):
+        """Receives & decompresses data available without blocking (or, for blocking sockets, at least some), returning
+           a list of uncompressed chunks. The list can be empty, e.g. if a block has not been fully received yet."""
+        output = socket_decompress_recv(self.__ctx, _socket_timeout(self.__sock, self.__timeout))
+        self.__finished = output.pop() == 0
+        return output
+
+    def __iter__(self):
+        """Yields chunks of the next frame, waiting for data even if the socket is non-blocking"""
+        timeout = _socket_timeout(self.__sock, self.__timeout)
+        if timeout == 0:
+            timeout = -1
+        ctx = self.__ctx
+        self.__finished = False
+
+        while not self.__finished:
+            output = socket_decompress_recv(ctx, timeout)
+            self.__finished = output.pop() == 0
+            for element in output:
+                yield element
@@ -16,21 +16,66 @@
 """(de)compresses to/from lz4-framed data"""
 
 from __future__ import print_function
-from sys import argv, stderr
+from argparse import ArgumentParser, ArgumentTypeError, RawDescriptionHelpFormatter, SUPPRESS
+from multiprocessing import cpu_count
+from os import path, walk, remove, open as os_open, close as os_close, O_WRONLY, O_CREAT, O_EXCL, O_TRUNC, O_RDONLY
+try:
+    from os import O_BINARY
+except ImportError:
+    # only applicable to Windows
+    O_BINARY = 0
+from shutil import copystat
+from sys import argv, stderr, stdout as STDOUT
+from threading import Thread, Lock
 
-from .compat import STDIN_RAW, STDOUT_RAW
-from . import Compressor, Decompressor, Lz4FramedError, Lz4FramedNoDataError, get_block_size
+from .compat import STDIN_RAW, STDOUT_RAW, Queue, QueueEmpty
+from . import (LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX4MB, LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MAX,
+               LZ4F_COMPRESSION_FASTEST, Compressor, Decompressor, Lz4FramedError, Lz4FramedNoDataError,
+               get_block_size, compress_file, decompress_file, verify)
+from .bench import SYNTHETIC_SIZE, bench, synthetic_data
 
 
 def __error(*args, **kwargs):
     print(*args, file=stderr, **kwargs)
 
 
-def do_compress(in_stream, out_stream):
+def __fileno(stream):
+    """Returns file descriptor of given stream or None if it does not have one"""
+    try:
+        return stream.fileno()
+    # io.UnsupportedOperation is a subclass of both
+    except (AttributeError, IOError, ValueError):
+        return None
+
+
+def __file_descriptors(in_stream, out_stream):
+    """Returns descriptors for both streams (for use with native file functions) or None if not applicable"""
+    in_fd = __fileno(in_stream)
+    out_fd = __fileno(out_stream)
+    if in_fd is None or out_fd is None:
+        return None
+    # Native functions write to descriptor directly, bypassing any buffered stream output
+    out_stream.flush()
+    return in_fd, out_fd
+
+
+def do_compress(in_stream, out_stream, use_mmap=False, threads=1, **kwargs):
+    """kwargs: block_size_id, block_mode_linked, checksum & level, see compress_file()"""
+    fds = __file_descriptors(in_stream, out_stream)
+    if fds:
+        try:
+            compress_file(*fds, mmap_src=use_mmap, threads=threads, **kwargs)
+        except Lz4FramedError as ex:
+            __error('Compression error: %s' % ex)
+            return 8
+        return 0
+
     read = in_stream.read
-    read_size = get_block_size()
+    read_size = get_block_size(kwargs.get('block_size_id', LZ4F_BLOCKSIZE_MAX64KB))
     try:
-        with Compressor(out_stream) as compressor:
+        # collect small outputs (e.g. when lz4 buffers input internally) into fewer writes. (Single-threaded since
+        # streams without descriptors are unlikely to be large.)
+        with Compressor(out_stream, write_buffer_size=read_size, **kwargs) as compressor:
             try:
                 while True:
                     compressor.update(read(read_size))
@@ -47,50 +92,338 @@ def do_compress(in_stream, out_stream):
 
 
 def do_decompress(in_stream, out_stream):
+    fds = __file_descriptors(in_stream, out_stream)
     write = out_stream.write
     try:
-        for chunk in Decompressor(in_stream):
-            write(chunk)
-    except Lz4FramedError as ex:
+        if fds:
+            decompress_file(*fds)
+        else:
+            for chunk in Decompressor(in_stream):
+                write(chunk)
+    except (Lz4FramedError, Lz4FramedNoDataError, ValueError) as ex:
         __error('Compression error: %s' % ex)
         return 8
     return 0
 
 
-__ACTION = frozenset(('compress', 'decompress'))
+SUFFIX = '.lz4'
+
+
+def __batch_inputs(paths, compress, recursive):
+    """Yields input files for batch mode. Directories are only descended into if recursive is set, in which case files
+       found which do not apply to the action (i.e. with or without suffix) are skipped."""
+    for name in paths:
+        if recursive and path.isdir(name):
+            for dir_path, _, files in walk(name):
+                for file_name in sorted(files):
+                    if file_name.endswith(SUFFIX) != compress:
+                        yield path.join(dir_path, file_name)
+        else:
+            yield name
+
+
+def __batch_process(src, compress, overwrite, remove_src, kwargs):
+    """Processes a single file in batch mode, returning non-zero (after reporting error) on failure"""
+    if compress:
+        dst = src + SUFFIX
+    elif src.endswith(SUFFIX) and len(path.basename(src)) > len(SUFFIX):
+        dst = src[:-len(SUFFIX)]
+    else:
+        __error('%s: Unknown suffix, skipping' % src)
+        return 1
+    if not path.isfile(src):
+        __error('%s: Not a regular file, skipping' % src)
+        return 1
+
+    try:
+        src_fd = os_open(src, O_RDONLY | O_BINARY)
+    except OSError as ex:
+        __error('%s: Failed to open for reading: %s' % (src, ex))
+        return 2
+    dst_fd = None
+    try:
+        try:
+            dst_fd = os_open(dst, O_WRONLY | O_CREAT | (O_TRUNC if overwrite else O_EXCL) | O_BINARY, 0o666)
+        except OSError as ex:
+            __error('%s: Failed to open output file for writing: %s' % (src, ex))
+            return 4
+        try:
+            if compress:
+                compress_file(src_fd, dst_fd, mmap_src=True, **kwargs)
+            else:
+                decompress_file(src_fd, dst_fd)
+        except (Lz4FramedError, Lz4FramedNoDataError, ValueError, IOError) as ex:
+            __error('%s: %s error: %s' % (src, 'Compression' if compress else 'Decompression', ex))
+            os_close(dst_fd)
+            dst_fd = None
+            remove(dst)
+            return 8
+    finally:
+        os_close(src_fd)
+        if dst_fd is not None:
+            os_close(dst_fd)
+
+    try:
+        # permissions & times
+        copystat(src, dst)
+        if remove_src:
+            remove(src)
+    except OSError as ex:
+        __error('%s: %s' % (src, ex))
+        return 2
+    return 0
+
+
+def __run_parallel(names, func, workers):
+    """Calls func for each of names using workers threads (0 meaning as many as CPUs). Returns highest result. An
+       unexpected exception raised by func is reported (and counts as a failure) without affecting remaining names."""
+    queue = Queue()
+    for name in names:
+        queue.put(name)
+    result = [0]
+    result_lock = Lock()
+
+    def run():
+        while True:
+            try:
+                name = queue.get_nowait()
+            except QueueEmpty:
+                return
+            try:
+                code = func(name)
+            except Exception as ex:  # pylint: disable=broad-except
+                __error('%s: Unexpected error: %r' % (name, ex))
+                code = 8
+            if code:
+                with result_lock:
+                    result[0] = max(result[0], code)
+
+    threads = [Thread(target=run, name='lz4framed-batch-%d' % i)
+               for i in range(min(workers or cpu_count(), queue.qsize()))]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    return result[0]
+
+
+def do_batch(paths, compress, recursive=False, workers=0, overwrite=False, remove_src=False, **kwargs):
+    """(De)compresses each of the given files (and, if recursive, those in given directories) in place, i.e. to/from
+       files with .lz4 suffix, using workers threads (0 meaning as many as CPUs). Returns highest failure code or zero
+       if all files were processed. kwargs: see do_compress()"""
+    return __run_parallel(__batch_inputs(paths, compress, recursive),
+                          lambda name: __batch_process(name, compress, overwrite, remove_src, kwargs), workers)
+
+
+def __verify_file(name):
+    """Verifies a single file ('-' meaning stdin), returning non-zero (after reporting error) on failure"""
+    try:
+        if name == '-':
+            verify(STDIN_RAW)
+        else:
+            with open(name, 'rb') as in_file:
+                verify(in_file)
+    except IOError as ex:
+        __error('%s: Failed to read: %s' % (name, ex))
+        return 2
+    except Lz4FramedNoDataError:
+        __error('%s: Empty' % name)
+        return 8
+    except Lz4FramedError as ex:
+        # (not all errors have an offset, e.g. context creation failure)
+        if len(ex.args) > 2:
+            __error('%s: Invalid at offset %d: %s' % (name, ex.args[2], ex.args[0]))
+        else:
+            __error('%s: Invalid: %s' % (name, ex.args[0]))
+        return 8
+    return 0
+
+
+def do_verify(paths, recursive=False, workers=0):
+    """Validates each of the given files (and, if recursive, .lz4 files in given directories) without writing any
+       output, using workers threads (0 meaning as many as CPUs). Returns highest failure code or zero if all files
+       are valid."""
+    return __run_parallel(__batch_inputs(paths, False, recursive), __verify_file, workers)
+
+
+class __ArgumentParser(ArgumentParser):
+
+    def error(self, message):
+        self.print_usage(stderr)
+        print('%s: error: %s' % (self.prog, message), file=stderr)
+        exit(1)
+
+
+def __fast_level(value):
+    """Converts --fast argument to (negative) compression level"""
+    try:
+        value = int(value)
+    except ValueError:
+        value = 0
+    if not 1 <= value <= -LZ4F_COMPRESSION_FASTEST:
+        raise ArgumentTypeError('must be between 1 and %d' % -LZ4F_COMPRESSION_FASTEST)
+    return -value
+
+
+__DESCRIPTION = """(De)compresses an lz4 frame. Input is read from INFILE unless set to '-', in
+which case stdin is used. If OUTFILE is not specified, output goes to stdout.
+Compression options are ignored when decompressing. See '%(prog)s bench -h' for
+benchmark mode.
+
+With -m (or -r) each FILE is (de)compressed to/from FILE.lz4 instead, several at
+a time, preserving permissions & modification times.
+
+verify checks that each FILE consists of valid lz4 frames (including checksums)
+without writing any output, reporting the offset of any problem found."""
+
+
+def __parser():
+    parser = __ArgumentParser(prog='lz4framed', formatter_class=RawDescriptionHelpFormatter,
+                              usage='%(prog)s [-h] [-1..-12 | --fast[=N]] [-B4..-B7] [--independent] '
+                                    '[--checksum] [-T N]\n                 (compress|decompress) (INFILE|-) [OUTFILE]'
+                                    '\n       %(prog)s [options] -m|-r [-j N] [-f] [--rm] (compress|decompress) '
+                                    'FILE [FILE ...]\n       %(prog)s [-r] [-j N] verify (FILE|-) [FILE ...]',
+                              description=__DESCRIPTION)
+    parser.add_argument('action', choices=('compress', 'decompress', 'verify'))
+    parser.add_argument('files', metavar='FILE', nargs='+')
+    # last level option wins (as with lz4 utility)
+    for level in range(1, LZ4F_COMPRESSION_MAX + 1):
+        parser.add_argument('-%d' % level, dest='level', action='store_const', const=level,
+                            help=('-1..-%d: compression level, 3+ using hc compression (default: fast)'
+                                  % LZ4F_COMPRESSION_MAX if level == 1 else SUPPRESS))
+    parser.add_argument('--fast', dest='level', type=__fast_level, metavar='N',
+                        help='--fast[=N]: faster (acceleration N+1) but lower compression than default (default N: 1)')
+    parser.set_defaults(level=LZ4F_COMPRESSION_MIN)
+    parser.add_argument('-B', type=int, dest='block_size_id', choices=range(LZ4F_BLOCKSIZE_MAX64KB,
+                                                                              LZ4F_BLOCKSIZE_MAX4MB + 1),
+                        default=LZ4F_BLOCKSIZE_MAX64KB,
+                        help='block size: 4=64KB, 5=256KB, 6=1MB, 7=4MB (default: %(default)s)')
+    parser.add_argument('--independent', dest='block_mode_linked', action='store_false',
+                        help='compress blocks independently (default: linked)')
+    parser.add_argument('--checksum', action='store_true', help='add content checksum')
+    parser.add_argument('-T', type=int, dest='threads', default=1, metavar='N',
+                        help='compress N blocks in parallel, 0 meaning as many as CPUs (default: 1)')
+    batch = parser.add_argument_group('batch mode')
+    batch.add_argument('-m', dest='multiple', action='store_true', help='process multiple files')
+    batch.add_argument('-r', dest='recursive', action='store_true',
+                       help='process files in given directories recursively (implies -m)')
+    batch.add_argument('-j', type=int, dest='workers', default=0, metavar='N',
+                       help='process N files in parallel, 0 meaning as many as CPUs (default: 0)')
+    batch.add_argument('-f', dest='overwrite', action='store_true', help='overwrite existing output files')
+    batch.add_argument('--rm', dest='remove_src', action='store_true', help='remove input files once processed')
+    return parser
+
+
+def __bench_parser():
+    parser = __ArgumentParser(prog='lz4framed bench', formatter_class=RawDescriptionHelpFormatter,
+                              description="""Benchmarks in-memory compression & decompression of each FILE (or of %d MB
+of generated text if none are given) for each level from -b to -e and each
+block size (-B may be repeated). Reports ratio, speed of the fastest iteration
+and peak memory use of the process.""" % (SYNTHETIC_SIZE // (1024 * 1024)))
+    parser.add_argument('files', metavar='FILE', nargs='*')
+    parser.add_argument('-b', type=int, dest='start', default=LZ4F_COMPRESSION_MIN, metavar='LEVEL',
+                        help='first compression level (default: %(default)s)')
+    parser.add_argument('-e', type=int, dest='end', metavar='LEVEL', help='last compression level (default: -b)')
+    parser.add_argument('-i', type=int, dest='iterations', default=3, metavar='N',
+                        help='iterations per level (default: %(default)s)')
+    parser.add_argument('-B', type=int, dest='block_size_ids', action='append',
+                        choices=range(LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX4MB + 1),
+                        help='block size: 4=64KB, 5=256KB, 6=1MB, 7=4MB (default: 4)')
+    parser.add_argument('--independent', dest='block_mode_linked', action='store_false',
+                        help='compress blocks independently (default: linked)')
+    parser.add_argument('--checksum', action='store_true', help='add content checksum')
+    parser.add_argument('-T', type=int, dest='threads', default=1, metavar='N',
+                        help='compress N blocks in parallel, 0 meaning as many as CPUs (default: 1)')
+    return parser
+
+
+def do_bench(args):
+    end = args.start if args.end is None else args.end
+    for level in (args.start, end):
+        if not LZ4F_COMPRESSION_FASTEST <= level <= LZ4F_COMPRESSION_MAX:
+            __error('Level must be between %d and %d' % (LZ4F_COMPRESSION_FASTEST, LZ4F_COMPRESSION_MAX))
+            return 1
+    if args.iterations < 1 or args.threads < 0:
+        __error('-i must be positive and -T must not be negative')
+        return 1
+
+    inputs = []
+    try:
+        for name in args.files:
+            with open(name, 'rb') as in_file:
+                inputs.append((name, in_file.read()))
+    except IOError as ex:
+        __error('Failed to read input file: %s' % ex)
+        return 2
+    if not args.files:
+        inputs.append(('synthetic', synthetic_data()))
+
+    try:
+        for name, data in inputs:
+            if not data:
+                __error('Skipping empty input: %s' % name)
+                continue
+            for result in bench(data, name=name, levels=range(args.start, end + 1),
+                                block_size_ids=args.block_size_ids or (LZ4F_BLOCKSIZE_MAX64KB,),
+                                iterations=args.iterations, block_mode_linked=args.block_mode_linked,
+                                checksum=args.checksum, threads=args.threads):
+                print(result)
+                STDOUT.flush()
+    except (Lz4FramedError, ValueError) as ex:
+        __error('Benchmark error: %s' % ex)
+        return 8
+    return 0
 
 
 def main():  # noqa (complexity)
-    if not (3 <= len(argv) <= 4 and argv[1] in __ACTION):
-        print("""USAGE: lz4framed (compress|decompress) (INFILE|-) [OUTFILE]
+    if argv[1:2] == ['bench']:
+        return do_bench(__bench_parser().parse_args(argv[2:]))
+
+    # value of --fast is optional, i.e. must be given as --fast=N
+    args = __parser().parse_args(['--fast=1' if arg == '--fast' else arg for arg in argv[1:]])
+    if args.threads < 0 or args.workers < 0:
+        __error('-T and -j must not be negative')
+        return 1
 
-(De)compresses an lz4 frame. Input is read from INFILE unless set to '-', in
-which case stdin is used. If OUTFILE is not specified, output goes to stdout.""", file=stderr)
+    if args.action == 'verify':
+        return do_verify(args.files, recursive=args.recursive, workers=args.workers)
+    compress = (args.action == 'compress')
+    compress_kwargs = dict(threads=args.threads, block_size_id=args.block_size_id,
+                           block_mode_linked=args.block_mode_linked, checksum=args.checksum, level=args.level)
+    if args.multiple or args.recursive:
+        return do_batch(args.files, compress, recursive=args.recursive, workers=args.workers,
+                        overwrite=args.overwrite, remove_src=args.remove_src, **compress_kwargs)
+    if len(args.files) > 2:
+        __error('Use -m to process multiple files')
         return 1
+    infile = args.files[0]
+    outfile = args.files[1] if len(args.files) > 1 else None
 
-    compress = (argv[1] == 'compress')
     in_file = out_file = None
     try:
         # input
-        if argv[2] == '-':
+        if infile == '-':
             in_stream = STDIN_RAW
         else:
             try:
-                in_stream = in_file = open(argv[2], 'rb')
+                in_stream = in_file = open(infile, 'rb')
             except IOError as ex:
                 __error('Failed to open input file for reading: %s' % ex)
                 return 2
         # output
-        if len(argv) == 3:
+        if outfile is None:
             out_stream = STDOUT_RAW
         else:
             try:
-                out_stream = out_file = open(argv[3], 'ab')
+                out_stream = out_file = open(outfile, 'wb')
             except IOError as ex:
-                __error('Failed to open output file for appending: %s' % ex)
+                __error('Failed to open output file for writing: %s' % ex)
                 return 4
 
-        return (do_compress if compress else do_decompress)(in_stream, out_stream)
+        if compress:
+            # memory-map named input files (falls back to reads if not possible)
+            return do_compress(in_stream, out_stream, use_mmap=in_file is not None, **compress_kwargs)
+        return do_decompress(in_stream, out_stream)
     except IOError as ex:
         __error('I/O failure: %s' % ex)
     finally:
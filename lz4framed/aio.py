@@ -0,0 +1,133 @@
+# Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+"""asyncio stream adapters (Python v3.6+ only), e.g.:
+
+    async with AsyncCompressor(writer) as compressor:
+        await compressor.update(moreData)
+
+    async for chunk in AsyncDecompressor(reader):
+        decoded.append(chunk)
+
+Small inputs are (de)compressed directly on the event loop. Larger ones are offloaded to the shared native thread pool,
+with the GIL released during (de)compression, so that the loop stays responsive. Note: Each adapter instance should only
+be used by one task at a time.
+"""
+
+from asyncio import wrap_future
+
+from . import (LZ4F_BLOCKSIZE_DEFAULT, LZ4F_COMPRESSION_MIN, LZ4F_ERROR_frameHeader_incomplete, Lz4FramedError,
+               Compressor, create_decompression_context, decompress_update, get_frame_info, get_block_size,
+               _AsyncChain, _decompress_update_async)
+from .compat import buffer_nbytes as _buffer_nbytes
+
+# Inputs smaller than this (in bytes) are processed on the event loop
+INLINE_THRESHOLD = 32 * 1024
+
+
+class AsyncCompressor(object):
+    """Compresses data into a single lz4 frame written to an asyncio.StreamWriter. Can be used as an asynchronous
+       context manager, finalising the frame on exit (unless an exception occurs)."""
+
+    def __init__(self, writer, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True, checksum=False,
+                 autoflush=False, level=LZ4F_COMPRESSION_MIN):
+        """
+        Args:
+            writer: asyncio.StreamWriter (or object with write() & coroutine drain() methods) to write compressed
+                    data to
+            Remaining arguments: See Compressor
+        """
+        self.__writer = writer
+        self.__compressor = Compressor(block_size_id=block_size_id, block_mode_linked=block_mode_linked,
+                                       checksum=checksum, autoflush=autoflush, level=level)
+
+    async def __aenter__(self):
+        return self
+
+    async def __aexit__(self, exc_type, exc_value, traceback):
+        if exc_type is None:
+            await self.end()
+
+    async def __write(self, data):
+        if data:
+            self.__writer.write(data)
+            await self.__writer.drain()
+
+    async def update(self, b):
+        """Compresses b, writing any output. Raises Lz4FramedNoDataError if input is of zero length."""
+        if _buffer_nbytes(b) < INLINE_THRESHOLD:
+            output = self.__compressor.update(b)
+        else:
+            output = await wrap_future(self.__compressor.update_async(b))
+        await self.__write(output)
+
+    async def end(self):
+        """Finalises lz4 frame, writing any remaining output"""
+        await self.__write(self.__compressor.end())
+
+
+class AsyncDecompressor(object):
+    """Iteratively decompresses an lz4 frame from an asyncio.StreamReader, e.g.:
+
+        async for chunk in AsyncDecompressor(reader):
+            decoded.append(chunk)
+
+    Iteration raises Lz4FramedNoDataError if the stream ends before the frame is complete.
+    """
+
+    def __init__(self, reader):
+        """
+        Args:
+            reader: asyncio.StreamReader (or object with coroutine read(n) method) to read compressed data from
+        """
+        self.__reader = reader
+        self.__ctx = create_decompression_context()
+        # (orders offloaded operations on context)
+        self.__chain = _AsyncChain()
+        self.__info = None
+
+    def __aiter__(self):
+        return self.__iterate()
+
+    async def __iterate(self):
+        ctx = self.__ctx
+        read = self.__reader.read
+        input_hint = 15  # enough to read largest header
+        chunk_size = 32  # output chunk size, will be increased once block size known
+
+        while input_hint > 0:
+            data = await read(input_hint)
+            if len(data) < INLINE_THRESHOLD:
+                output = decompress_update(ctx, data, chunk_size)
+                input_hint = output.pop()
+            else:
+                output, input_hint = await wrap_future(self.__chain.submit(_decompress_update_async, ctx, data,
+                                                                           buffer_len=chunk_size))
+                output = (output,) if output else ()
+            if self.__info is None:
+                try:
+                    self.__info = info = get_frame_info(ctx)
+                except Lz4FramedError as ex:
+                    if ex.args[1] != LZ4F_ERROR_frameHeader_incomplete:
+                        raise
+                else:
+                    chunk_size = get_block_size(info['block_size_id'])
+            for element in output:
+                yield element
+
+    @property
+    def frame_info(self):
+        """See Decompressor.frame_info"""
+        return self.__info
@@ -0,0 +1,149 @@
+# Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+"""In-memory benchmark of compress() & decompress() (similar to lz4 -b), e.g.:
+
+    for result in bench(data, levels=range(1, 10)):
+        print(result)
+"""
+
+from __future__ import division
+from random import Random
+from sys import platform
+from timeit import default_timer
+try:
+    from resource import getrusage, RUSAGE_SELF
+except ImportError:
+    # Windows
+    getrusage = None
+
+from . import LZ4F_BLOCKSIZE_DEFAULT, LZ4F_COMPRESSION_MIN, compress, decompress
+
+# Size of generated input (in bytes) when no data is supplied
+SYNTHETIC_SIZE = 10 * 1024 * 1024
+
+_MB = 1024 * 1024
+
+__WORDS = (b'lorem', b'ipsum', b'dolor', b'sit', b'amet', b'consectetur', b'adipiscing', b'elit', b'sed', b'do',
+           b'eiusmod', b'tempor', b'incididunt', b'ut', b'labore', b'et', b'dolore', b'magna', b'aliqua', b'enim')
+
+
+def synthetic_data(size=SYNTHETIC_SIZE, seed=0):
+    """Returns size bytes of repeatable, moderately compressible text (words and some random bytes)"""
+    rand = Random(seed)
+    # pieces are joined per chunk to limit peak memory use of (many) small objects
+    chunks = []
+    total = 0
+    while total < size:
+        parts = []
+        for _ in range(8192):
+            if rand.random() < 0.1:
+                parts.append(bytes(bytearray(rand.randrange(256) for _ in range(rand.randrange(1, 16)))))
+            else:
+                parts.append(rand.choice(__WORDS) + b' ')
+        chunks.append(b''.join(parts))
+        total += len(chunks[-1])
+    return b''.join(chunks)[:size]
+
+
+def peak_memory():
+    """Peak resident set size of this process in bytes or None if not available"""
+    if getrusage is None:
+        return None
+    usage = getrusage(RUSAGE_SELF).ru_maxrss
+    # kilobytes everywhere except macOS
+    return usage if platform == 'darwin' else usage * 1024
+
+
+class BenchResult(object):
+    """Outcome of benchmarking one input with one set of compression parameters. Speeds are in MB/s of uncompressed
+       data based on the fastest of all iterations."""
+
+    __slots__ = ('name', 'level', 'block_size_id', 'size', 'compressed_size', 'compress_time', 'decompress_time',
+                 'peak_memory')
+
+    def __init__(self, name, level, block_size_id, size, compressed_size, compress_time, decompress_time):
+        self.name = name
+        self.level = level
+        self.block_size_id = block_size_id
+        self.size = size
+        self.compressed_size = compressed_size
+        self.compress_time = compress_time
+        self.decompress_time = decompress_time
+        self.peak_memory = peak_memory()
+
+    @property
+    def ratio(self):
+        return self.size / self.compressed_size
+
+    @staticmethod
+    def __speed(size, elapsed):
+        return size / _MB / elapsed if elapsed > 0 else float('inf')
+
+    @property
+    def compress_speed(self):
+        return self.__speed(self.size, self.compress_time)
+
+    @property
+    def decompress_speed(self):
+        return self.__speed(self.size, self.decompress_time)
+
+    def __str__(self):
+        return '%3d  -B%d  %-20.20s %12d -> %12d (%6.3f) %9.1f MB/s %9.1f MB/s %s' % (
+            self.level, self.block_size_id, self.name, self.size, self.compressed_size, self.ratio,
+            self.compress_speed, self.decompress_speed,
+            '%7.1f MB' % (self.peak_memory / _MB) if self.peak_memory is not None else '')
+
+
+def __best_time(iterations, func, *args, **kwargs):
+    best = None
+    for _ in range(iterations):
+        start = default_timer()
+        result = func(*args, **kwargs)
+        elapsed = default_timer() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best, result
+
+
+def bench(data, name='', levels=(LZ4F_COMPRESSION_MIN,), block_size_ids=(LZ4F_BLOCKSIZE_DEFAULT,), iterations=3,
+          block_mode_linked=True, checksum=False, threads=1):
+    """Generator yielding a BenchResult for each combination of level and block size, compressing (and then
+       decompressing) data in memory iterations times.
+
+    Args:
+        data: bytes-like object to compress (must not be empty)
+        name: Label of data to include in results
+        levels: Compression levels to benchmark, see compress()
+        block_size_ids: Block sizes to benchmark, see compress()
+        iterations: Number of times each (de)compression is run (with the fastest being reported)
+        Remaining arguments: See compress()
+
+    Raises:
+        ValueError: If iterations is not positive or decompressed data does not match input
+        Remaining exceptions: See compress()
+    """
+    if iterations < 1:
+        raise ValueError('iterations must be positive')
+    for block_size_id in block_size_ids:
+        for level in levels:
+            compress_time, compressed = __best_time(iterations, compress, data, block_size_id=block_size_id,
+                                                    block_mode_linked=block_mode_linked, checksum=checksum,
+                                                    level=level, threads=threads)
+            decompress_time, decompressed = __best_time(iterations, decompress, compressed, buffer_size=len(data))
+            if decompressed != data:
+                raise ValueError('Decompressed data does not match input (level %d, block size id %d)'
+                                 % (level, block_size_id))
+            yield BenchResult(name, level, block_size_id, len(data), len(compressed), compress_time, decompress_time)
@@ -0,0 +1,155 @@
+# Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+"""In-memory cache keeping values compressed, e.g.:
+
+    cache = CompressedCache(256 * 1024 * 1024, dictionary=typical_values)
+    cache[key] = value
+    value = cache.get(key)
+
+By default each value is stored as a single raw lz4 block (see compress_block()), avoiding the per-value overhead of a
+frame header & end mark, which is significant for small values. A dictionary (e.g. a concatenation of typical values)
+further improves the ratio of small values considerably.
+"""
+
+from collections import OrderedDict
+from threading import Lock
+
+from .compat import MutableMapping
+from . import LZ4F_COMPRESSION_MIN, compress, decompress, compress_block, decompress_block
+
+
+class CompressedCache(MutableMapping):
+    """Least-recently-used mapping of hashable keys to bytes values, which are compressed on insertion and decompressed
+       on retrieval. Values which do not compress are stored as-is. The budget applies to the stored (compressed) size
+       of values. All methods are thread safe, with (de)compression happening outside of the lock."""
+
+    def __init__(self, max_bytes, level=LZ4F_COMPRESSION_MIN, dictionary=None, frames=False):
+        """
+        Args:
+            max_bytes (int): Most compressed bytes to hold, beyond which least recently used values are evicted. Values
+                             which by themselves exceed this are not stored.
+            level (int): Compression level, see compress()
+            dictionary (bytes): Data similar to values, referenced during (de)compression (only the last 64 KB are
+                                used). Requires frames to be False.
+            frames (bool): Whether to store values as lz4 frames instead of raw blocks, e.g. so that they can be
+                           decompressed elsewhere without knowing their length.
+
+        Raises:
+            ValueError: If max_bytes is negative or dictionary is used with frames
+        """
+        if max_bytes < 0:
+            raise ValueError('max_bytes must not be negative')
+        if dictionary is not None and frames:
+            raise ValueError('dictionary requires frames to be False')
+        self.__max_bytes = max_bytes
+        self.__level = level
+        self.__dictionary = bytes(dictionary) if dictionary is not None else None
+        self.__frames = frames
+        self.__lock = Lock()
+        # key -> (data, uncompressed length), least recently used first. Data is stored as-is if of uncompressed length.
+        self.__entries = OrderedDict()
+        self.__size = 0
+        self.__uncompressed_size = 0
+        self.__hits = self.__misses = self.__evictions = 0
+
+    def __compress(self, value):
+        if not value:
+            return b''
+        if self.__frames:
+            data = compress(value, level=self.__level)
+        else:
+            data = compress_block(value, level=self.__level, dictionary=self.__dictionary)
+        return data if len(data) < len(value) else bytes(value)
+
+    def __decompress(self, data, length):
+        if len(data) == length:
+            return data
+        if self.__frames:
+            return decompress(data)
+        return decompress_block(data, length, dictionary=self.__dictionary)
+
+    def __remove(self, key):
+        """Must be called with lock held"""
+        data, length = self.__entries.pop(key)
+        self.__size -= len(data)
+        self.__uncompressed_size -= length
+
+    def __setitem__(self, key, value):
+        """Compresses & stores value (bytes-like object), evicting least recently used values if required"""
+        data = self.__compress(value)
+        length = len(value)
+        with self.__lock:
+            if key in self.__entries:
+                self.__remove(key)
+            if len(data) > self.__max_bytes:
+                return
+            self.__entries[key] = (data, length)
+            self.__size += len(data)
+            self.__uncompressed_size += length
+            while self.__size > self.__max_bytes:
+                self.__remove(next(iter(self.__entries)))
+                self.__evictions += 1
+
+    def __getitem__(self, key):
+        """Returns decompressed value (bytes) of key, marking it as most recently used
+
+        Raises:
+            KeyError: If key is not present
+            Lz4FramedError: If value cannot be decompressed (e.g. due to an incorrect dictionary)
+        """
+        with self.__lock:
+            try:
+                entry = self.__entries.pop(key)
+            except KeyError:
+                self.__misses += 1
+                raise
+            # re-insert as most recently used
+            self.__entries[key] = entry
+            self.__hits += 1
+        return self.__decompress(*entry)
+
+    def __delitem__(self, key):
+        with self.__lock:
+            self.__remove(key)
+
+    def __contains__(self, key):
+        # (without decompressing, affecting statistics or order)
+        with self.__lock:
+            return key in self.__entries
+
+    def __iter__(self):
+        with self.__lock:
+            keys = list(self.__entries)
+        return iter(keys)
+
+    def __len__(self):
+        return len(self.__entries)
+
+    def clear(self):
+        with self.__lock:
+            self.__entries.clear()
+            self.__size = self.__uncompressed_size = 0
+
+    @property
+    def stats(self):
+        """dict with count (values), size (compressed bytes), uncompressed_size, ratio (uncompressed over compressed
+           size), hits, misses, hit_rate (hits over all lookups) & evictions"""
+        with self.__lock:
+            lookups = self.__hits + self.__misses
+            return {'count': len(self.__entries), 'size': self.__size, 'uncompressed_size': self.__uncompressed_size,
+                    'ratio': self.__uncompressed_size / float(self.__size) if self.__size else None,
+                    'hits': self.__hits, 'misses': self.__misses,
+                    'hit_rate': self.__hits / float(lookups) if lookups else None, 'evictions': self.__evictions}
@@ -38,13 +38,26 @@
 
 # pylint: disable=unused-import,invalid-name,wrong-import-order
 
+from functools import reduce
+from operator import mul
 from sys import stderr, stdout, stdin, version_info
 
 try:
     # pylint: disable=no-name-in-module
-    from collections.abc import Iterable
+    from collections.abc import Iterable, MutableMapping
 except ImportError:
-    from collections import Iterable  # noqa
+    from collections import Iterable, MutableMapping  # noqa
+
+try:
+    from queue import Queue, Empty as QueueEmpty
+except ImportError:
+    from Queue import Queue, Empty as QueueEmpty  # noqa
+
+try:
+    from concurrent.futures import Future
+except ImportError:
+    # Python v2.7 without futures backport
+    Future = None
 
 PY2 = (version_info[0] == 2)
 
@@ -53,7 +66,16 @@ if PY2:
     STDOUT_RAW = stdout
     STDERR_RAW = stderr
 
+    def buffer_nbytes(obj):
+        """Size in bytes of obj, which must support the buffer protocol"""
+        view = memoryview(obj)
+        return reduce(mul, view.shape or (), view.itemsize)
+
 else:
     STDIN_RAW = getattr(stdin, 'buffer', stdin)
     STDOUT_RAW = getattr(stdout, 'buffer', stdout)
     STDERR_RAW = getattr(stderr, 'buffer', stderr)
+
+    def buffer_nbytes(obj):
+        """Size in bytes of obj, which must support the buffer protocol"""
+        return memoryview(obj).nbytes
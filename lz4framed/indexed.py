@@ -0,0 +1,233 @@
+# Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+"""Random access to the uncompressed data of lz4 files, e.g.:
+
+    with IndexedReader('data.lz4', cache_bytes=64 * 1024 * 1024) as reader:
+        record = reader.pread(offset, length)
+
+Files are indexed once (see scan_frames()) and then only the blocks covering a requested range are decompressed, so
+frames must have been written with independent blocks (block_mode_linked=False). Each block is decoded on its own (see
+decompress_block()) without any shared decompression context, so concurrent readers only contend briefly on the lock of
+the cache shard a block belongs to, not on decompression.
+"""
+
+from bisect import bisect_right
+from collections import OrderedDict
+from mmap import mmap, ACCESS_READ
+from threading import Event, Lock
+
+from . import scan_frames, decompress_block
+
+# Default total size (in bytes) of decoded blocks to keep cached
+CACHE_BYTES_DEFAULT = 64 * 1024 * 1024
+# Default number of independently locked cache partitions
+CACHE_SHARDS_DEFAULT = 16
+
+
+class _CacheShard(object):
+    """Least-recently-used cache of decoded blocks for a subset of block indices"""
+
+    __slots__ = ('lock', 'blocks', 'loading', 'size', 'capacity', 'hits', 'misses')
+
+    def __init__(self, capacity):
+        self.lock = Lock()
+        # block index -> bytes, least recently used first
+        self.blocks = OrderedDict()
+        # block index -> Event, for blocks currently being decoded by another reader
+        self.loading = {}
+        self.size = 0
+        self.capacity = capacity
+        self.hits = self.misses = 0
+
+    def add(self, index, block):
+        """Must be called with lock held"""
+        if len(block) > self.capacity:
+            return
+        self.blocks[index] = block
+        self.size += len(block)
+        while self.size > self.capacity:
+            self.size -= len(self.blocks.popitem(last=False)[1])
+
+
+class IndexedReader(object):
+    """Reads arbitrary ranges of the uncompressed data of a file made up of lz4 (and skippable) frames, decompressing
+       only the blocks needed. Decoded blocks are kept in a sharded LRU cache. Blocks are pinned (by reference) whilst
+       in use, so eviction never invalidates a read in progress or a view returned by view(). All methods except
+       close() are thread safe. Can be used as a context manager, closing the file on exit."""
+
+    def __init__(self, path, cache_bytes=CACHE_BYTES_DEFAULT, cache_shards=CACHE_SHARDS_DEFAULT):
+        """
+        Args:
+            path: Name of (or path to) the file to read
+            cache_bytes (int): Most decoded data to keep cached (split evenly across shards). Blocks larger than one
+                               shard's share are not cached. Zero disables caching.
+            cache_shards (int): Number of cache partitions, each with their own lock
+
+        Raises:
+            ValueError: If cache arguments are invalid or a frame has linked blocks
+            IOError: If the file cannot be read
+            Lz4FramedNoDataError: If the file is empty
+            Lz4FramedError: If the file is not made up of valid & complete frames, see scan_frames()
+        """
+        if cache_bytes < 0:
+            raise ValueError('cache_bytes must not be negative')
+        if cache_shards < 1:
+            raise ValueError('cache_shards must be positive')
+        # uncompressed offset of each block (ascending, for bisection)
+        self.__starts = starts = []
+        # (offset, size, uncompressed_size, stored) of each block
+        self.__blocks = blocks = []
+        self.__length = 0
+        self.__fp = fp = open(path, 'rb')
+        self.__map = self.__data = None
+        try:
+            for frame in scan_frames(fp):
+                if frame['skippable']:
+                    continue
+                if frame['block_mode_linked'] and len(frame['blocks']) > 1:
+                    raise ValueError('Frame at offset %d has linked blocks' % frame['offset'])
+                for offset, size, uncompressed_offset, uncompressed_size, stored in frame['blocks']:
+                    starts.append(uncompressed_offset)
+                    blocks.append((offset, size, uncompressed_size, stored))
+                self.__length += frame['uncompressed_length']
+            self.__map = mmap(fp.fileno(), 0, access=ACCESS_READ)
+            try:
+                self.__data = memoryview(self.__map)
+            except TypeError:
+                # Python v2.7 mmap only supports slicing (which copies)
+                self.__data = self.__map
+        except:  # noqa (re-raised)
+            self.close()
+            raise
+        self.__shards = tuple(_CacheShard(cache_bytes // cache_shards) for _ in range(cache_shards))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def __len__(self):
+        return self.__length
+
+    @property
+    def length(self):
+        """Total uncompressed length of all frames"""
+        return self.__length
+
+    @property
+    def block_count(self):
+        """Number of (independently decodable) blocks in the file"""
+        return len(self.__blocks)
+
+    @property
+    def cache_stats(self):
+        """dict with hits, misses (i.e. blocks decoded) and size (bytes of decoded blocks currently cached)"""
+        stats = {'hits': 0, 'misses': 0, 'size': 0}
+        for shard in self.__shards:
+            with shard.lock:
+                stats['hits'] += shard.hits
+                stats['misses'] += shard.misses
+                stats['size'] += shard.size
+        return stats
+
+    def close(self):
+        """Releases the file. Must not be called whilst other threads are reading."""
+        if isinstance(self.__data, memoryview):
+            self.__data.release()
+        self.__data = None
+        if self.__map is not None:
+            self.__map.close()
+            self.__map = None
+        self.__fp.close()
+
+    def __decode(self, index):
+        offset, size, uncompressed_size, stored = self.__blocks[index]
+        data = self.__data[offset:offset + size]
+        if stored:
+            return bytes(data)
+        return decompress_block(data, uncompressed_size)
+
+    def __block(self, index):
+        """Decoded data of block index, from cache if possible. Only one reader decodes a given block at a time, others
+           requesting it wait for the result instead of duplicating the work."""
+        shard = self.__shards[index % len(self.__shards)]
+        while True:
+            with shard.lock:
+                block = shard.blocks.pop(index, None)
+                if block is not None:
+                    # re-insert as most recently used
+                    shard.blocks[index] = block
+                    shard.hits += 1
+                    return block
+                loading = shard.loading.get(index)
+                if loading is None:
+                    shard.loading[index] = loading = Event()
+                    shard.misses += 1
+                    break
+            # decoded by another reader, so should be cached now (unless it failed or was not cacheable)
+            loading.wait()
+            with shard.lock:
+                block = shard.blocks.get(index)
+            if block is not None:
+                return block
+        block = None
+        try:
+            block = self.__decode(index)
+        finally:
+            with shard.lock:
+                del shard.loading[index]
+                if block is not None:
+                    shard.add(index, block)
+            loading.set()
+        return block
+
+    def __range(self, offset, length):
+        if offset < 0 or length < 0:
+            raise ValueError('offset & length must not be negative')
+        end = min(offset + length, self.__length)
+        if offset >= end:
+            return None, 0, 0
+        return bisect_right(self.__starts, offset) - 1, offset, end
+
+    def pread(self, offset, length):
+        """Returns (as bytes) up to length bytes of uncompressed data starting at offset. Like os.pread(), fewer bytes
+           are returned if the range extends beyond the end of the data.
+
+        Raises:
+            ValueError: If offset or length are negative
+            Lz4FramedError: If a block is corrupt, see decompress_block()
+        """
+        index, offset, end = self.__range(offset, length)
+        parts = []
+        while offset < end:
+            start = self.__starts[index]
+            block = self.__block(index)
+            parts.append(block[offset - start:end - start])
+            offset = start + len(block)
+            index += 1
+        return parts[0] if len(parts) == 1 else b''.join(parts)
+
+    def view(self, offset, length):
+        """As pread() but returns a (read-only) memoryview. Ranges within a single block reference the cached block
+           directly (i.e. without copying), keeping it alive for as long as the view exists."""
+        index, offset, end = self.__range(offset, length)
+        if offset < end:
+            start = self.__starts[index]
+            block = self.__block(index)
+            if end - start <= len(block):
+                return memoryview(block)[offset - start:end - start]
+        return memoryview(self.pread(offset, end - offset))
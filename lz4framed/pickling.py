@@ -0,0 +1,125 @@
+# Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+"""Compressed pickling with out-of-band buffers (Python v3.8+ only), e.g.:
+
+    data = dumps(frame)
+    frame = loads(data)
+
+Objects are pickled with protocol 5 and large (contiguous) buffers exposed via PickleBuffer, e.g. those of numpy arrays,
+are captured out-of-band instead of being copied into the pickle stream. The stream and each such buffer are then
+compressed in parallel on the shared thread pool (see compress_async()) as independent frames, which are preceded by a
+skippable frame holding an offsets table. Hence the output is also a valid sequence of frames (e.g. for scan_frames()).
+On loading, buffers are decompressed in parallel directly into newly allocated (writable) bytearrays.
+"""
+
+from pickle import dumps as _pickle_dumps, loads as _pickle_loads, HIGHEST_PROTOCOL
+from struct import Struct
+
+from . import LZ4F_COMPRESSION_MIN, compress_async, decompress_into_async
+
+if HIGHEST_PROTOCOL < 5:
+    raise ImportError('pickle protocol 5 unavailable')
+
+# Smaller buffers (in bytes) are kept in-band since they don't benefit from being compressed on their own
+OOB_THRESHOLD_DEFAULT = 64 * 1024
+
+# magic, frame size, tag & number of entries (the first being the pickle stream itself)
+_HEADER = Struct('<II4sI')
+# offset (from start of data), compressed length & uncompressed length of each frame
+_ENTRY = Struct('<QQQ')
+_MAGIC = 0x184D2A5D
+_TAG = b'PKL5'
+
+
+def dumps(obj, level=LZ4F_COMPRESSION_MIN, oob_threshold=OOB_THRESHOLD_DEFAULT):
+    """Pickles & compresses obj, returning bytes.
+
+    Args:
+        obj: Object to pickle (with protocol 5)
+        level (int): Compression level, see compress()
+        oob_threshold (int): Size (in bytes) from which contiguous buffers are handled out-of-band, i.e. compressed
+                             separately & in parallel
+
+    Raises:
+        ValueError: If oob_threshold is not positive
+        Lz4FramedError: If compression fails, see compress()
+        Remaining exceptions: See pickle.dumps()
+    """
+    if oob_threshold < 1:
+        raise ValueError('oob_threshold must be positive')
+    buffers = []
+
+    def buffer_callback(buf):
+        try:
+            raw = buf.raw()
+        except BufferError:
+            # non-contiguous, left to pickle to handle
+            return True
+        if raw.nbytes < oob_threshold:
+            return True
+        buffers.append(raw)
+        return False
+
+    stream = _pickle_dumps(obj, protocol=5, buffer_callback=buffer_callback)
+    lengths = [len(stream)] + [raw.nbytes for raw in buffers]
+    # Buffers are started first since the stream is usually the smallest
+    futures = [compress_async(raw, level=level) for raw in buffers]
+    futures.insert(0, compress_async(stream, level=level))
+    frames = [future.result() for future in futures]
+
+    header_size = _HEADER.size + _ENTRY.size * len(frames)
+    table = [_HEADER.pack(_MAGIC, header_size - 8, _TAG, len(frames))]
+    offset = header_size
+    for frame, length in zip(frames, lengths):
+        table.append(_ENTRY.pack(offset, len(frame), length))
+        offset += len(frame)
+    return b''.join(table + frames)
+
+
+def loads(data):
+    """Decompresses & unpickles data as produced by dumps(). Out-of-band buffers are restored as bytearrays.
+
+    Raises:
+        ValueError: If data is not a container produced by dumps()
+        Lz4FramedError: If a frame is corrupt, see decompress()
+        Remaining exceptions: See pickle.loads()
+    """
+    view = memoryview(data)
+    if len(view) < _HEADER.size:
+        raise ValueError('data too short')
+    magic, header_size, tag, count = _HEADER.unpack_from(view)
+    if magic != _MAGIC or tag != _TAG or not count or header_size != _HEADER.size - 8 + _ENTRY.size * count:
+        raise ValueError('Not a pickle container')
+    table_end = _HEADER.size + _ENTRY.size * count
+    if len(view) < table_end:
+        raise ValueError('Offsets table extends beyond end of data')
+    entries = [_ENTRY.unpack_from(view, _HEADER.size + _ENTRY.size * i) for i in range(count)]
+    for offset, compressed_length, _ in entries:
+        if offset < table_end:
+            raise ValueError('Frame at offset %d overlaps offsets table' % offset)
+        if offset + compressed_length > len(view):
+            raise ValueError('Frame at offset %d extends beyond end of data' % offset)
+    targets = [bytearray(length) for _, _, length in entries]
+    futures = [decompress_into_async(view[offset:offset + compressed_length], target)
+               for (offset, compressed_length, _), target in zip(entries, targets)]
+    # wait for all (even if one fails) so that no decompression still references data
+    errors = [future.exception() for future in futures]
+    for target, future, error in zip(targets, futures, errors):
+        if error is not None:
+            raise error
+        if future.result() != len(target):
+            raise ValueError('Decompressed length (%d) does not match expected (%d)' % (future.result(), len(target)))
+    return _pickle_loads(targets[0], buffers=targets[1:])
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// for sysconf() & pthread_atfork() in c99 mode
+#ifndef _POSIX_C_SOURCE
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+/******************************************************************************/
+
+#ifdef LZ4FRAMED_HAVE_POOL
+
+#include <unistd.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    pool_task_t *head;
+    pool_task_t *tail;
+    unsigned long long depth;
+    pthread_t thread;
+    unsigned index;
+} _pool_worker_t;
+
+/* config_lock serialises starting/stopping the pool and submission of tasks from outside the pool (so that workers
+ * are not removed whilst a task is being queued for them). state_lock protects counters & the stopping flag.
+ */
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t current_worker;
+
+static _pool_worker_t *workers = NULL;
+static unsigned worker_count = 0;           // number of started workers
+static unsigned configured_size = 0;        // 0 = number of CPUs
+static unsigned next_worker = 0;            // round-robin target for external submissions
+static int stopping = 0;
+static pool_stats_t stats = {0, 0, 0, 0, 0, 0, 0};
+
+static unsigned _cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (unsigned)count : 1;
+}
+
+static unsigned _target_size(void) {
+    return configured_size ? configured_size : _cpu_count();
+}
+
+// Threads do not survive fork, so the child starts with a fresh (not yet started) pool. (Old memory is leaked.)
+static void _pool_atfork_child(void) {
+    pthread_mutex_init(&config_lock, NULL);
+    pthread_mutex_init(&state_lock, NULL);
+    pthread_cond_init(&work_available, NULL);
+    workers = NULL;
+    worker_count = 0;
+    next_worker = 0;
+    stopping = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void _pool_init_once(void) {
+    pthread_key_create(&current_worker, NULL);
+    pthread_atfork(NULL, NULL, _pool_atfork_child);
+}
+
+static void _queue_push(_pool_worker_t *worker, pool_task_t *task) {
+    task->next = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->tail) {
+        worker->tail->next = task;
+    } else {
+        worker->head = task;
+    }
+    worker->tail = task;
+    worker->depth++;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+static pool_task_t* _queue_pop(_pool_worker_t *worker) {
+    pool_task_t *task;
+
+    pthread_mutex_lock(&worker->lock);
+    if (NULL != (task = worker->head)) {
+        if (NULL == (worker->head = task->next)) {
+            worker->tail = NULL;
+        }
+        worker->depth--;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return task;
+}
+
+// Own queue first, then the others (starting with the next worker along, to spread out stealing)
+static pool_task_t* _pool_take(_pool_worker_t *self, int *stolen) {
+    pool_task_t *task;
+    unsigned i;
+
+    if (NULL != (task = _queue_pop(self))) {
+        *stolen = 0;
+        return task;
+    }
+    for (i = 1; i < worker_count; i++) {
+        if (NULL != (task = _queue_pop(&workers[(self->index + i) % worker_count]))) {
+            *stolen = 1;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static void* _pool_worker_run(void *arg) {
+    _pool_worker_t *self = arg;
+    pool_task_t *task;
+    int stolen;
+
+    pthread_setspecific(current_worker, self);
+    while (1) {
+        if (NULL != (task = _pool_take(self, &stolen))) {
+            pthread_mutex_lock(&state_lock);
+            stats.queued--;
+            stats.active++;
+            if (stolen) {
+                stats.stolen++;
+            }
+            pthread_mutex_unlock(&state_lock);
+
+            task->func(task);
+
+            pthread_mutex_lock(&state_lock);
+            stats.active--;
+            stats.completed++;
+            pthread_mutex_unlock(&state_lock);
+            continue;
+        }
+        pthread_mutex_lock(&state_lock);
+        // queued might be non-zero briefly before a task is actually pushed, hence re-checking queues in that case
+        while (!stats.queued && !stopping) {
+            pthread_cond_wait(&work_available, &state_lock);
+        }
+        if (!stats.queued && stopping) {
+            pthread_mutex_unlock(&state_lock);
+            break;
+        }
+        pthread_mutex_unlock(&state_lock);
+    }
+    pthread_setspecific(current_worker, NULL);
+    return NULL;
+}
+
+// Waits for queued tasks to complete and removes all workers. Requires config_lock.
+static void _pool_stop(void) {
+    unsigned i;
+
+    pthread_mutex_lock(&state_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&work_available);
+    pthread_mutex_unlock(&state_lock);
+
+    for (i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+
+    pthread_mutex_lock(&state_lock);
+    stopping = 0;
+    stats.size = 0;
+    pthread_mutex_unlock(&state_lock);
+}
+
+// Requires config_lock. Returns non-zero (with errno set) on failure.
+static int _pool_start(void) {
+    unsigned size = _target_size();
+    unsigned i;
+    int result;
+
+    if (NULL == (workers = calloc(size, sizeof(_pool_worker_t)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < size; i++) {
+        workers[i].index = i;
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    // workers only look at worker_count once running, so set it up front (shrinking again on failure)
+    worker_count = size;
+    for (i = 0; i < size; i++) {
+        if ((result = pthread_create(&workers[i].thread, NULL, _pool_worker_run, &workers[i]))) {
+            break;
+        }
+    }
+    if (i < size) {
+        // no tasks can have been queued yet, so remaining workers exit immediately
+        worker_count = i;
+        _pool_stop();
+        errno = result;
+        return -1;
+    }
+    pthread_mutex_lock(&state_lock);
+    stats.size = size;
+    pthread_mutex_unlock(&state_lock);
+    return 0;
+}
+
+// Requires state_lock
+static void _stats_queued(void) {
+    stats.queued++;
+    stats.submitted++;
+    if (stats.queued > stats.max_queued) {
+        stats.max_queued = stats.queued;
+    }
+}
+
+int pool_submit(pool_task_t *task) {
+    _pool_worker_t *self;
+
+    pthread_once(&init_once, _pool_init_once);
+
+    // Counted before being pushed so that workers never see a task without it being reflected in queued
+    if (NULL != (self = pthread_getspecific(current_worker))) {
+        // Running on a worker, which cannot be removed whilst it is running a task
+        pthread_mutex_lock(&state_lock);
+        _stats_queued();
+        pthread_mutex_unlock(&state_lock);
+        _queue_push(self, task);
+    } else {
+        pthread_mutex_lock(&config_lock);
+        if (!worker_count && _pool_start()) {
+            int start_errno = errno;
+            pthread_mutex_unlock(&config_lock);
+            errno = start_errno;
+            return -1;
+        }
+        pthread_mutex_lock(&state_lock);
+        _stats_queued();
+        pthread_mutex_unlock(&state_lock);
+        _queue_push(&workers[next_worker++ % worker_count], task);
+        pthread_mutex_unlock(&config_lock);
+    }
+
+    pthread_mutex_lock(&state_lock);
+    pthread_cond_signal(&work_available);
+    pthread_mutex_unlock(&state_lock);
+    return 0;
+}
+
+int pool_set_size(unsigned size) {
+    pthread_once(&init_once, _pool_init_once);
+    if (pthread_getspecific(current_worker)) {
+        // would wait for itself
+        errno = EDEADLK;
+        return -1;
+    }
+    pthread_mutex_lock(&config_lock);
+    if (worker_count) {
+        _pool_stop();
+    }
+    configured_size = size;
+    pthread_mutex_unlock(&config_lock);
+    return 0;
+}
+
+unsigned pool_get_size(void) {
+    unsigned size;
+
+    pthread_mutex_lock(&config_lock);
+    size = worker_count ? worker_count : _target_size();
+    pthread_mutex_unlock(&config_lock);
+    return size;
+}
+
+unsigned pool_get_stats(pool_stats_t *stats_out, unsigned long long *depths, unsigned depths_len) {
+    unsigned count;
+    unsigned i;
+
+    pthread_mutex_lock(&config_lock);
+    count = worker_count;
+    for (i = 0; depths && i < count && i < depths_len; i++) {
+        pthread_mutex_lock(&workers[i].lock);
+        depths[i] = workers[i].depth;
+        pthread_mutex_unlock(&workers[i].lock);
+    }
+    pthread_mutex_lock(&state_lock);
+    *stats_out = stats;
+    pthread_mutex_unlock(&state_lock);
+    if (!count) {
+        stats_out->size = _target_size();
+    }
+    pthread_mutex_unlock(&config_lock);
+    return count;
+}
+
+/******************************************************************************/
+
+int pool_group_init(pool_group_t *group, size_t count) {
+    int result;
+
+    group->count = group->remaining = count;
+    group->next = 0;
+    if ((result = pthread_mutex_init(&group->lock, NULL))) {
+        errno = result;
+        return -1;
+    }
+    if ((result = pthread_cond_init(&group->done, NULL))) {
+        pthread_mutex_destroy(&group->lock);
+        errno = result;
+        return -1;
+    }
+    return 0;
+}
+
+void pool_group_destroy(pool_group_t *group) {
+    pthread_cond_destroy(&group->done);
+    pthread_mutex_destroy(&group->lock);
+}
+
+size_t pool_group_take(pool_group_t *group) {
+    size_t index;
+
+    pthread_mutex_lock(&group->lock);
+    index = (group->next < group->count) ? group->next++ : group->count;
+    pthread_mutex_unlock(&group->lock);
+    return index;
+}
+
+void pool_group_done(pool_group_t *group) {
+    pthread_mutex_lock(&group->lock);
+    if (!--group->remaining) {
+        pthread_cond_broadcast(&group->done);
+    }
+    pthread_mutex_unlock(&group->lock);
+}
+
+void pool_group_wait(pool_group_t *group) {
+    pthread_mutex_lock(&group->lock);
+    while (group->remaining) {
+        pthread_cond_wait(&group->done, &group->lock);
+    }
+    pthread_mutex_unlock(&group->lock);
+}
+
+/******************************************************************************/
+
+#else  // no pool support: run tasks inline
+
+#ifdef _MSC_VER
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL __thread
+#endif
+
+// per calling thread, since tasks are run by the thread submitting them
+static THREAD_LOCAL pool_task_t *inline_head = NULL;
+static THREAD_LOCAL pool_task_t *inline_tail = NULL;
+static THREAD_LOCAL int inline_running = 0;
+// not synchronised, i.e. only approximate
+static pool_stats_t stats = {0, 0, 0, 0, 0, 0, 0};
+
+int pool_submit(pool_task_t *task) {
+    task->next = NULL;
+    if (inline_tail) {
+        inline_tail->next = task;
+    } else {
+        inline_head = task;
+    }
+    inline_tail = task;
+    stats.submitted++;
+    // follow-up tasks submitted by a running task are run once it returns (rather than recursively)
+    if (!inline_running) {
+        inline_running = 1;
+        while (NULL != (task = inline_head)) {
+            if (NULL == (inline_head = task->next)) {
+                inline_tail = NULL;
+            }
+            task->func(task);
+            stats.completed++;
+        }
+        inline_running = 0;
+    }
+    return 0;
+}
+
+int pool_set_size(unsigned size) {
+    (void)size;
+    return 0;
+}
+
+unsigned pool_get_size(void) {
+    return 0;
+}
+
+unsigned pool_get_stats(pool_stats_t *stats_out, unsigned long long *depths, unsigned depths_len) {
+    (void)depths;
+    (void)depths_len;
+    *stats_out = stats;
+    return 0;
+}
+
+int pool_group_init(pool_group_t *group, size_t count) {
+    group->count = group->remaining = count;
+    group->next = 0;
+    return 0;
+}
+
+void pool_group_destroy(pool_group_t *group) {
+    (void)group;
+}
+
+size_t pool_group_take(pool_group_t *group) {
+    return (group->next < group->count) ? group->next++ : group->count;
+}
+
+void pool_group_done(pool_group_t *group) {
+    group->remaining--;
+}
+
+void pool_group_wait(pool_group_t *group) {
+    (void)group;
+}
+
+#endif  // LZ4FRAMED_HAVE_POOL
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016 Iotic Labs Ltd. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://github.com/Iotic-Labs/py-lz4framed/blob/master/LICENSE
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Process-wide worker pool with work stealing. Each worker has its own task queue: Workers take tasks from the front of
+ * their own queue and, when empty, steal the oldest task from other workers' queues. Tasks submitted from outside of
+ * the pool are distributed across workers round-robin whilst tasks submitted by a worker (e.g. follow-up tasks) go to
+ * the back of its own queue, i.e. behind work already queued by other callers. None of these functions use the Python
+ * API and those which might block should be called with the GIL released.
+ *
+ * On platforms without pthreads the pool has no workers and pool_submit() runs tasks inline (in submission order).
+ */
+
+#ifndef LZ4FRAMED_POOL_H
+#define LZ4FRAMED_POOL_H
+
+#include <stddef.h>
+
+// (LZ4FRAMED_NO_POOL forces tasks to be run inline, as on platforms without pthreads)
+#if !defined(_WIN32) && !defined(LZ4FRAMED_NO_POOL)
+    #define LZ4FRAMED_HAVE_POOL
+    #include <pthread.h>
+#endif
+
+typedef struct pool_task_s pool_task_t;
+typedef void (*pool_func_t)(pool_task_t *task);
+
+// Caller-owned task, which must remain valid until its function has been called
+struct pool_task_s {
+    pool_func_t func;
+    void *arg;
+    pool_task_t *next;
+};
+
+typedef struct {
+    unsigned size;                      // number of workers
+    unsigned long long queued;          // tasks waiting to be run
+    unsigned long long active;          // tasks being run
+    unsigned long long submitted;       // total tasks submitted
+    unsigned long long completed;       // total tasks run
+    unsigned long long stolen;          // total tasks run by worker other than one it was queued on
+    unsigned long long max_queued;      // highest number of waiting tasks seen
+} pool_stats_t;
+
+/* Queues task for execution (starting the pool with the default size if necessary). Returns non-zero (with errno set)
+ * if the pool could not be started.
+ */
+int pool_submit(pool_task_t *task);
+
+/* Changes number of workers (with 0 meaning number of online CPUs). Already queued tasks are completed by the
+ * current workers first. Returns non-zero (with errno set) on failure.
+ */
+int pool_set_size(unsigned size);
+
+// Number of workers (or what it will be once the pool has started)
+unsigned pool_get_size(void);
+
+/* Fills stats. depths (if not NULL) receives per-worker queue depth for up to depths_len workers. Returns number of
+ * workers.
+ */
+unsigned pool_get_stats(pool_stats_t *stats, unsigned long long *depths, unsigned depths_len);
+
+/* Hands out indices of count items of work (e.g. blocks belonging to a single call) and tracks their completion. */
+typedef struct {
+#ifdef LZ4FRAMED_HAVE_POOL
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+#endif
+    size_t count;
+    size_t next;
+    size_t remaining;
+} pool_group_t;
+
+// Returns non-zero (with errno set) on failure
+int pool_group_init(pool_group_t *group, size_t count);
+void pool_group_destroy(pool_group_t *group);
+// Returns index of next item to process or count if all have been handed out
+size_t pool_group_take(pool_group_t *group);
+// Marks one item as done
+void pool_group_done(pool_group_t *group);
+// Waits for all items to be done
+void pool_group_wait(pool_group_t *group);
+
+#endif  // LZ4FRAMED_POOL_H
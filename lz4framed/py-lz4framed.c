@@ -20,20 +20,59 @@
 #include <Python.h>
 #include <bytesobject.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+    #include <io.h>
+    #include <malloc.h>
+    #define LZ4FRAMED_OPEN(path, flags) _open((path), (flags) | _O_BINARY, _S_IREAD | _S_IWRITE)
+    #define LZ4FRAMED_READ(fd, buf, len) _read((fd), (buf), (unsigned int)(len))
+    #define LZ4FRAMED_WRITE(fd, buf, len) _write((fd), (buf), (unsigned int)(len))
+    #define LZ4FRAMED_CLOSE(fd) _close(fd)
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <poll.h>
+    #define LZ4FRAMED_HAVE_MMAP
+    #define LZ4FRAMED_HAVE_SOCKET
+    // (not available on macOS)
+    #ifndef __APPLE__
+        #define LZ4FRAMED_HAVE_FALLOCATE
+    #endif
+    #define LZ4FRAMED_OPEN(path, flags) open((path), (flags), 0666)
+    #define LZ4FRAMED_READ(fd, buf, len) read((fd), (buf), (len))
+    #define LZ4FRAMED_WRITE(fd, buf, len) write((fd), (buf), (len))
+    #define LZ4FRAMED_CLOSE(fd) close(fd)
+#endif
+
 #include "lz4frame_static.h"
 #include "lz4hc.h"
+#include "xxhash.h"
+
+#include "pool.h"
 
 /******************************************************************************/
 
 #define UNUSED(x) (void)(x)
 #define QUOTE(str) #str
 #define EXPAND_AND_QUOTE(str) QUOTE(str)
-#define MAX(x, y) (x) >= (y) ? (x) : (y)
+#define MAX(x, y) ((x) >= (y) ? (x) : (y))
+#define MIN(x, y) ((x) <= (y) ? (x) : (y))
 #define KB *(1<<10)
 #define MB *(1<<20)
 #define LZ4_COMPRESSION_MIN 0
+// Negative levels use fast compression with an acceleration of (1 - level)
+#define LZ4_COMPRESSION_FASTEST (-65536)
 #define LZ4_COMPRESSION_MIN_HC LZ4HC_CLEVEL_MIN
 #define LZ4_COMPRESSION_MAX LZ4HC_CLEVEL_MAX
+// Set in block size word of frame for blocks stored as-is
+#define BLOCK_UNCOMPRESSED_FLAG 0x80000000U
+// Return value of LZ4F functions for the given error (LZ4F_ERROR_* without prefix)
+#define LZ4F_ERROR_CODE(name) ((size_t)-(ptrdiff_t)LZ4F_ERROR_##name)
+#define SIZE_UNKNOWN ((size_t)-1)
 
 
 #define _BAIL_ON_LZ4_ERROR(code, without_gil) {\
@@ -46,18 +85,7 @@
         __err = (code);\
     }\
     if (LZ4F_isError(__err)) {\
-        PyObject *num = NULL, *str = NULL, *tuple = NULL;\
-        if ((num = PyLong_FromSize_t(-(int)__err)) &&\
-            (str = PyUnicode_FromString(LZ4F_getErrorName(__err))) &&\
-            (tuple = PyTuple_Pack(2, str, num))) {\
-            PyErr_SetObject(LZ4FError, tuple);\
-        /* backup method in case object creation fails */\
-        } else {\
-            PyErr_Format(LZ4FError, "[%d] %s", -(int)__err, LZ4F_getErrorName(__err));\
-        }\
-        Py_XDECREF(tuple);\
-        Py_XDECREF(num);\
-        Py_XDECREF(str);\
+        _lz4framed_set_lz4_error(__err);\
         goto bail;\
     }\
 }
@@ -89,6 +117,10 @@
 #define NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD 8*1024
 #define NOGIL_DECOMPRESS_INPUT_SIZE_THRESHOLD 8*1024
 #define NOGIL_DECOMPRESS_OUTPUT_SIZE_THRESHOLD 8*1024
+// Input (and minimum output) buffer size used by compress_file & decompress_file
+#define FILE_IO_CHUNK_SIZE (1 MB)
+// Alignment of said buffers (page size on most platforms)
+#define FILE_IO_BUFFER_ALIGNMENT 4096
 
 
 
@@ -106,11 +138,43 @@ if (result) {\
 #define DECOMPRESSION_CAPSULE_NAME "_lz4fdctx"
 
 PyDoc_STRVAR(__lz4f_error__doc__,
-             "Raised when an lz4-specific error occurs. Arguments are the error message and associated code.");
+             "Raised when an lz4-specific error occurs. Arguments are the error message and associated code (and, for\n"
+             "errors relating to a specific position within the input, the offset thereof).");
 static PyObject *LZ4FError = NULL;
 PyDoc_STRVAR(__lz4f_no_data_error__doc__,
              "Raised by compress_update() and compress() when data supplied is of zero length");
 static PyObject *LZ4FNoDataError = NULL;
+PyDoc_STRVAR(__lz4f_output_limit_error__doc__,
+             "Raised when decompressing would produce more output than allowed by max_output_size. Arguments are the\n"
+             "error message and the limit.");
+static PyObject *LZ4FOutputLimitError = NULL;
+
+// Raises LZ4FError for the given LZ4F error code
+static void _lz4framed_set_lz4_error(size_t err) {
+    PyObject *num = NULL, *str = NULL, *tuple = NULL;
+
+    if ((num = PyLong_FromSize_t(-(int)err)) &&
+        (str = PyUnicode_FromString(LZ4F_getErrorName(err))) &&
+        (tuple = PyTuple_Pack(2, str, num))) {
+        PyErr_SetObject(LZ4FError, tuple);
+    // backup method in case object creation fails
+    } else {
+        PyErr_Format(LZ4FError, "[%d] %s", -(int)err, LZ4F_getErrorName(err));
+    }
+    Py_XDECREF(tuple);
+    Py_XDECREF(num);
+    Py_XDECREF(str);
+}
+
+// Raises LZ4FOutputLimitError for the given limit
+static void _lz4framed_set_output_limit_error(size_t limit) {
+    PyObject *tuple;
+
+    if ((tuple = Py_BuildValue("(sn)", "output limit exceeded", (Py_ssize_t)limit))) {
+        PyErr_SetObject(LZ4FOutputLimitError, tuple);
+        Py_DECREF(tuple);
+    }
+}
 
 /* Hold compression context together with preferences, so compress_update & compress_end can calculate right output size
  * based on actualy preferences previously set via compress_begin (rather than defaults). The lock is used to preserve
@@ -161,6 +225,24 @@ static size_t _lz4f_block_size_from_id(int id) {
     return blockSizes[id];
 }
 
+// Validates & applies the given frame options to prefs. Returns non-zero (with exception set) on failure.
+static int _lz4framed_set_prefs(LZ4F_preferences_t *prefs, int block_id, int block_mode_linked, int checksum,
+                                int compression_level) {
+    if (!_valid_lz4f_block_size_id(block_id)) {
+        PyErr_Format(PyExc_ValueError, "block_size_id (%d) invalid", block_id);
+        return -1;
+    }
+    if (compression_level < LZ4_COMPRESSION_FASTEST || compression_level > LZ4_COMPRESSION_MAX) {
+        PyErr_Format(PyExc_ValueError, "level (%d) invalid", compression_level);
+        return -1;
+    }
+    prefs->frameInfo.blockMode = block_mode_linked ? LZ4F_blockLinked : LZ4F_blockIndependent;
+    prefs->frameInfo.blockSizeID = block_id;
+    prefs->frameInfo.contentChecksumFlag = checksum ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
+    prefs->compressionLevel = compression_level;
+    return 0;
+}
+
 /******************************************************************************/
 
 PyDoc_STRVAR(_lz4framed_get_block_size__doc__,
@@ -196,9 +278,426 @@ bail:
 
 /******************************************************************************/
 
+// Shared by all tasks of a single parallel compression call
+typedef struct {
+    pool_group_t group;
+    const char *input;
+    size_t input_len;
+    size_t history;             // bytes preceding input which can be used as dictionary
+    char *slots;                // one slot of (block_size + 4) bytes per block
+    size_t block_size;
+    int linked;
+    int level;
+    int alloc_failed;           // set (without lock, never cleared) if a task could not allocate compression state
+} _parallel_job_t;
+
+typedef struct {
+    pool_task_t task;           // must be first member
+    _parallel_job_t *job;
+    size_t index;
+} _parallel_task_t;
+
+#define PARALLEL_SLOT(job, index) ((job)->slots + (index) * ((job)->block_size + 4))
+
+static unsigned long _read_le32(const char *src) {
+    const unsigned char *in = (const unsigned char*)src;
+
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((unsigned long)in[3] << 24);
+}
+
+static void _write_le32(char *dst, unsigned long value) {
+    unsigned char *out = (unsigned char*)dst;
+
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+/* Compresses src as a single block into dst in the same manner as LZ4F does (i.e. fast compression for levels below
+ * LZ4_COMPRESSION_MIN_HC), referencing (up to the last 64 KB of) dict if dict_len is non-zero. Returns the compressed
+ * size, zero if it would not fit into dst_len or -1 if allocation failed. (No GIL)
+ */
+static int _compress_block(const char *src, int src_len, char *dst, int dst_len, int level, const char *dict,
+                           int dict_len) {
+    int output_len = 0;
+
+    if (level < LZ4_COMPRESSION_MIN_HC) {
+        // as LZ4F (for negative levels)
+        int acceleration = (level < 0) ? 1 - level : 1;
+        LZ4_stream_t *stream;
+        if (NULL == (stream = LZ4_createStream())) {
+            return -1;
+        }
+        if (dict_len) {
+            LZ4_loadDict(stream, dict, dict_len);
+            output_len = LZ4_compress_fast_continue(stream, src, dst, src_len, dst_len, acceleration);
+        } else {
+            output_len = LZ4_compress_fast_extState(stream, src, dst, src_len, dst_len, acceleration);
+        }
+        LZ4_freeStream(stream);
+    } else {
+        LZ4_streamHC_t *stream;
+        if (NULL == (stream = LZ4_createStreamHC())) {
+            return -1;
+        }
+        if (dict_len) {
+            LZ4_resetStreamHC(stream, level);
+            LZ4_loadDictHC(stream, dict, dict_len);
+            output_len = LZ4_compress_HC_continue(stream, src, dst, src_len, dst_len);
+        } else {
+            output_len = LZ4_compress_HC_extStateHC(stream, src, dst, src_len, dst_len, level);
+        }
+        LZ4_freeStreamHC(stream);
+    }
+    return MAX(output_len, 0);
+}
+
+/* Compresses one block into its slot (as block size word followed by data), in the same manner as LZ4F does, except
+ * that for linked blocks the preceding (up to) 64 KB of input are loaded as dictionary. (No GIL)
+ */
+static void _parallel_compress_block(_parallel_job_t *job, size_t index) {
+    size_t offset = index * job->block_size;
+    const char *src = job->input + offset;
+    int src_len = (int)(MIN(job->block_size, job->input_len - offset));
+    int dict_len = job->linked ? (int)(MIN((size_t)64 KB, job->history + offset)) : 0;
+    char *slot = PARALLEL_SLOT(job, index);
+    int output_len = _compress_block(src, src_len, slot + 4, src_len - 1, job->level, src - dict_len, dict_len);
+
+    if (output_len < 0) {
+        job->alloc_failed = 1;
+        return;
+    }
+    // incompressible, store as-is
+    if (!output_len) {
+        _write_le32(slot, (unsigned long)src_len | BLOCK_UNCOMPRESSED_FLAG);
+        memcpy(slot + 4, src, src_len);
+    } else {
+        _write_le32(slot, (unsigned long)output_len);
+    }
+}
+
+/* Processes one block, then re-queues itself for the next unclaimed one (if any). Re-queuing (rather than looping)
+ * places the follow-up behind tasks already queued by other callers, so concurrent calls share the pool fairly.
+ */
+static void _parallel_compress_task(pool_task_t *task) {
+    _parallel_task_t *self = (_parallel_task_t*)task;
+    _parallel_job_t *job = self->job;
+    size_t next;
+
+    if (!job->alloc_failed) {
+        _parallel_compress_block(job, self->index);
+    }
+    // must not touch self once re-queued or marked done
+    if ((next = pool_group_take(&job->group)) < job->group.count) {
+        self->index = next;
+        pool_submit(task);
+    }
+    pool_group_done(&job->group);
+}
+
+/* Compresses (non-empty) input into consecutive blocks using the worker pool, with at most max_tasks blocks being
+ * compressed at the same time, updating checksum (if not NULL) with the input meanwhile. For linked blocks up to
+ * history bytes preceding input are used as dictionary. Blocks are compressed into their own slot each, starting at
+ * slots, and then moved to be back-to-back, starting at dst (which must not be after slots). Called without the GIL.
+ * Returns number of bytes written to dst or zero (with errno set) on failure.
+ */
+static size_t _parallel_compress_blocks(const char *input, size_t input_len, size_t history,
+                                        const LZ4F_preferences_t *prefs, unsigned max_tasks, char *slots, char *dst,
+                                        XXH32_state_t *checksum) {
+    _parallel_job_t job;
+    _parallel_task_t *tasks;
+    char *dst_pos = dst;
+    size_t block_count;
+    size_t task_count;
+    size_t i;
+    int err = 0;
+
+    job.input = input;
+    job.input_len = input_len;
+    job.history = history;
+    job.slots = slots;
+    job.block_size = _lz4f_block_size_from_id(prefs->frameInfo.blockSizeID);
+    job.linked = (prefs->frameInfo.blockMode == LZ4F_blockLinked);
+    job.level = prefs->compressionLevel;
+    job.alloc_failed = 0;
+    block_count = (input_len + job.block_size - 1) / job.block_size;
+    // (at least one task, since none would leave all slots unwritten)
+    task_count = MAX(1, MIN(max_tasks, block_count));
+
+    if (NULL == (tasks = malloc(task_count * sizeof(_parallel_task_t)))) {
+        errno = ENOMEM;
+        return 0;
+    }
+    if (pool_group_init(&job.group, block_count)) {
+        err = errno;
+        free(tasks);
+        errno = err;
+        return 0;
+    }
+
+    for (i = 0; i < task_count; i++) {
+        tasks[i].task.func = _parallel_compress_task;
+        tasks[i].job = &job;
+        // earlier tasks might already have claimed the remaining blocks
+        if ((tasks[i].index = pool_group_take(&job.group)) >= block_count) {
+            break;
+        }
+        if (pool_submit(&tasks[i].task)) {
+            err = errno;
+            // abandon this and all unclaimed blocks, leaving any already submitted tasks to finish
+            pool_group_done(&job.group);
+            while (pool_group_take(&job.group) < block_count) {
+                pool_group_done(&job.group);
+            }
+            break;
+        }
+    }
+    // overlaps with block compression
+    if (!err && checksum) {
+        XXH32_update(checksum, input, input_len);
+    }
+    pool_group_wait(&job.group);
+    pool_group_destroy(&job.group);
+    free(tasks);
+
+    if (!err && job.alloc_failed) {
+        err = ENOMEM;
+    }
+    if (err) {
+        errno = err;
+        return 0;
+    }
+    for (i = 0; i < block_count; i++) {
+        char *slot = PARALLEL_SLOT(&job, i);
+        size_t slot_len = 4 + (_read_le32(slot) & ~BLOCK_UNCOMPRESSED_FLAG);
+        memmove(dst_pos, slot, slot_len);
+        dst_pos += slot_len;
+    }
+    return dst_pos - dst;
+}
+
+// Writes end mark (followed by content checksum, if not NULL), returning position following them
+static char* _parallel_end_frame(char *dst, XXH32_state_t *checksum) {
+    _write_le32(dst, 0);
+    dst += 4;
+    if (checksum) {
+        _write_le32(dst, XXH32_digest(checksum));
+        dst += 4;
+    }
+    return dst;
+}
+
+// Sets exception for errno value from _parallel_compress_blocks()
+static void _parallel_set_error(int err) {
+    if (ENOMEM == err) {
+        PyErr_NoMemory();
+    } else {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_OSError);
+    }
+}
+
+/* Compresses input into a complete frame using the worker pool, with at most max_tasks blocks being compressed at the
+ * same time. prefs must have been validated and contain contentSize. The first reserve bytes of the output are left for
+ * the caller to fill in. Returns NULL (with exception set) on failure.
+ */
+static PyObject* _lz4framed_compress_parallel(const char *input, size_t input_len, LZ4F_preferences_t *prefs,
+                                              unsigned max_tasks, size_t reserve) {
+    LZ4F_compressionContext_t ctx = NULL;
+    XXH32_state_t *checksum = NULL;
+    PyObject *output = NULL;
+    char *output_str;
+    char *output_pos = NULL;
+    size_t block_size = _lz4f_block_size_from_id(prefs->frameInfo.blockSizeID);
+    size_t block_count = (input_len + block_size - 1) / block_size;
+    size_t header_len;
+    size_t blocks_len;
+    int err = 0;
+
+    // reserved, header, block slots, end mark & checksum
+    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, reserve + LZ4F_HEADER_SIZE_MAX +
+                                                          block_count * (block_size + 4) + 8));
+    BAIL_ON_NULL(output_str = PyBytes_AsString(output));
+    output_str += reserve;
+    BAIL_ON_LZ4_ERROR(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION));
+    BAIL_ON_LZ4_ERROR(header_len = LZ4F_compressBegin(ctx, output_str, LZ4F_HEADER_SIZE_MAX, prefs));
+    if (prefs->frameInfo.contentChecksumFlag == LZ4F_contentChecksumEnabled) {
+        if (NULL == (checksum = XXH32_createState())) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+        XXH32_reset(checksum, 0);
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    output_pos = output_str + header_len;
+    if ((blocks_len = _parallel_compress_blocks(input, input_len, 0, prefs, max_tasks,
+                                                output_str + LZ4F_HEADER_SIZE_MAX, output_pos, checksum))) {
+        output_pos = _parallel_end_frame(output_pos + blocks_len, checksum);
+    } else {
+        err = errno;
+    }
+    Py_END_ALLOW_THREADS;
+
+    if (err) {
+        _parallel_set_error(err);
+        goto bail;
+    }
+    BAIL_ON_NONZERO(_PyBytes_Resize(&output, reserve + (output_pos - output_str)));
+    if (checksum) {
+        XXH32_freeState(checksum);
+    }
+    LZ4F_freeCompressionContext(ctx);
+    return output;
+
+bail:
+    if (checksum) {
+        XXH32_freeState(checksum);
+    }
+    LZ4F_freeCompressionContext(ctx);
+    Py_XDECREF(output);
+    return NULL;
+}
+
+/******************************************************************************/
+
+/* Shuffle filter: Within each chunk (of the frame's block size), items of item_size bytes are rearranged so that the
+ * first bytes of all items come first, followed by all second bytes etc. This groups bytes of typed numeric data which
+ * change little (e.g. exponents or high-order bytes) together, so that lz4 finds far more matches. With delta, each
+ * item is first replaced by its difference to the preceding one (as little-endian unsigned integers, starting from
+ * zero in each chunk), so that slowly changing values (e.g. timestamps) become mostly zero bytes. Trailing bytes of a
+ * chunk which do not make up a whole item are left as-is. The filter is recorded in a skippable frame preceding the lz4
+ * frame: magic, size (4), tag, item size, flags & chunk size (as block size id).
+ */
+#define FILTER_MAGIC 0x184D2A5EU
+#define FILTER_FRAME_SIZE 12
+#define FILTER_TAG 'S'
+#define FILTER_FLAG_DELTA 1
+#define FILTER_ITEM_SIZE_MAX 255
+
+typedef struct {
+    unsigned item_size;
+    int delta;
+    size_t chunk_size;
+} _filter_t;
+
+/* Filters (or, if inverse is set, unfilters) n items from src to dst, which must not overlap. Called with constant
+ * item_size (other than for unusual sizes) so that it can be specialised & vectorised by the compiler. (No GIL)
+ */
+static void _filter_items(const unsigned char *src, unsigned char *dst, size_t n, unsigned item_size, int delta,
+                          int inverse) {
+    size_t i;
+    unsigned j;
+
+    if (!delta) {
+        if (inverse) {
+            for (i = 0; i < n; i++) {
+                for (j = 0; j < item_size; j++) {
+                    dst[i * item_size + j] = src[j * n + i];
+                }
+            }
+        } else {
+            for (i = 0; i < n; i++) {
+                for (j = 0; j < item_size; j++) {
+                    dst[j * n + i] = src[i * item_size + j];
+                }
+            }
+        }
+    } else if (item_size <= 8) {
+        unsigned long long prev = 0, value;
+        for (i = 0; i < n; i++) {
+            value = 0;
+            if (inverse) {
+                for (j = 0; j < item_size; j++) {
+                    value |= (unsigned long long)src[j * n + i] << (8 * j);
+                }
+                prev += value;
+                for (j = 0; j < item_size; j++) {
+                    dst[i * item_size + j] = (unsigned char)(prev >> (8 * j));
+                }
+            } else {
+                for (j = 0; j < item_size; j++) {
+                    value |= (unsigned long long)src[i * item_size + j] << (8 * j);
+                }
+                for (j = 0; j < item_size; j++) {
+                    dst[j * n + i] = (unsigned char)((value - prev) >> (8 * j));
+                }
+                prev = value;
+            }
+        }
+    } else {
+        // byte-wise with carry/borrow for wider items, relative to previous item (in dst when inverse)
+        unsigned carry;
+        for (i = 0; i < n; i++) {
+            carry = 0;
+            for (j = 0; j < item_size; j++) {
+                if (inverse) {
+                    carry += src[j * n + i] + (i ? dst[(i - 1) * item_size + j] : 0);
+                    dst[i * item_size + j] = (unsigned char)carry;
+                    carry >>= 8;
+                } else {
+                    // (borrow kept as 0 or 0x100 offset)
+                    carry = 0x100 + src[i * item_size + j] - (i ? src[(i - 1) * item_size + j] : 0) - carry;
+                    dst[j * n + i] = (unsigned char)carry;
+                    carry = (carry < 0x100) ? 1 : 0;
+                }
+            }
+        }
+    }
+}
+
+// Applies filter to (or, if inverse is set, reverses it on) len bytes from src to dst (No GIL)
+static void _filter_apply(const _filter_t *filter, const char *src, char *dst, size_t len, int inverse) {
+    size_t offset, chunk_len, n;
+
+    for (offset = 0; offset < len; offset += chunk_len) {
+        const unsigned char *in = (const unsigned char*)src + offset;
+        unsigned char *out = (unsigned char*)dst + offset;
+        chunk_len = MIN(filter->chunk_size, len - offset);
+        n = chunk_len / filter->item_size;
+        switch (filter->item_size) {
+            case 1: _filter_items(in, out, n, 1, filter->delta, inverse); break;
+            case 2: _filter_items(in, out, n, 2, filter->delta, inverse); break;
+            case 4: _filter_items(in, out, n, 4, filter->delta, inverse); break;
+            case 8: _filter_items(in, out, n, 8, filter->delta, inverse); break;
+            default: _filter_items(in, out, n, filter->item_size, filter->delta, inverse); break;
+        }
+        memcpy(out + n * filter->item_size, in + n * filter->item_size, chunk_len - n * filter->item_size);
+    }
+}
+
+static void _filter_write_frame(const _filter_t *filter, int block_id, char *dst) {
+    _write_le32(dst, FILTER_MAGIC);
+    _write_le32(dst + 4, 4);
+    dst[8] = FILTER_TAG;
+    dst[9] = (char)filter->item_size;
+    dst[10] = filter->delta ? FILTER_FLAG_DELTA : 0;
+    dst[11] = (char)(block_id == LZ4F_default ? LZ4F_max64KB : block_id);
+}
+
+/* Reads filter frame at start of src (if present), returning its size, zero if there is none or -1 (with exception set)
+ * if invalid.
+ */
+static int _filter_read_frame(const char *src, size_t len, _filter_t *filter) {
+    const unsigned char *in = (const unsigned char*)src;
+
+    if (len < FILTER_FRAME_SIZE || _read_le32(src) != FILTER_MAGIC || _read_le32(src + 4) != 4 ||
+        in[8] != FILTER_TAG) {
+        return 0;
+    }
+    filter->item_size = in[9];
+    filter->delta = in[10] & FILTER_FLAG_DELTA;
+    if (!filter->item_size || in[10] & ~FILTER_FLAG_DELTA || !(filter->chunk_size = _lz4f_block_size_from_id(in[11]))) {
+        PyErr_SetString(PyExc_ValueError, "filter frame invalid");
+        return -1;
+    }
+    return FILTER_FRAME_SIZE;
+}
+
 PyDoc_STRVAR(_lz4framed_compress__doc__,
 "compress(b, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True,\n"
-"         checksum=False, level=0) -> bytes\n"
+"         checksum=False, level=0, threads=1, shuffle=0, delta=False) -> bytes\n"
 "\n"
 "Compresses the data given in b, returning the compressed and lz4-framed\n"
 "result.\n"
@@ -212,7 +711,23 @@ PyDoc_STRVAR(_lz4framed_compress__doc__,
 "    checksum (bool): Whether to produce frame checksum\n"
 "    level (int): Compression level. Values lower than LZ4F_COMPRESSION_MIN_HC use fast\n"
 "                 compression. Recommended range for hc compression is between 4 and 9,\n"
-"                 with a maximum of LZ4F_COMPRESSION_MAX.\n"
+"                 with a maximum of LZ4F_COMPRESSION_MAX. Negative values (down to\n"
+"                 LZ4F_COMPRESSION_FASTEST) trade ratio for speed, with an acceleration\n"
+"                 factor of (1 - level).\n"
+"    threads (int): Maximum number of blocks to compress in parallel, using the shared\n"
+"                   thread pool (see set_thread_pool_size()). Zero means as many as\n"
+"                   the pool has workers. In linked mode each block uses the preceding\n"
+"                   64 KB of input as dictionary, so the compression ratio is close to\n"
+"                   that of single-threaded compression.\n"
+"    shuffle (int): Item size in bytes (e.g. 8 for float64 arrays) of a byte shuffle filter\n"
+"                   to apply before compression (or zero for none). Grouping the n-th bytes\n"
+"                   of all items together usually compresses typed numeric data far better.\n"
+"                   The filter is recorded in a skippable frame preceding the lz4 frame and\n"
+"                   reversed by decompress(). (Other decompression methods skip the filter\n"
+"                   frame and so return filtered data.)\n"
+"    delta (bool): Whether to additionally replace each item by its difference to the\n"
+"                  previous one (as little-endian unsigned integers) before shuffling,\n"
+"                  e.g. for monotonic timestamps. Requires shuffle.\n"
 "\n"
 "Raises:\n"
 "    LZ4FNoDataError: If provided data is of zero length. (Useful for ending compression loop.)\n"
@@ -222,73 +737,309 @@ PyDoc_STRVAR(_lz4framed_compress__doc__,
 static PyObject*
 _lz4framed_compress(PyObject *self, PyObject *args, PyObject *kwargs) {
 #if PY_MAJOR_VERSION >= 3
-    static const char *format = "y#|iiii:compress";
+    static const char *format = "y#|iiiiiii:compress";
 #else
-    static const char *format = "s#|iiii:compress";
+    static const char *format = "s#|iiiiiii:compress";
 #endif
-    static char *keywords[] = {"b", "block_size_id", "block_mode_linked", "checksum", "level", NULL};
+    static char *keywords[] = {"b", "block_size_id", "block_mode_linked", "checksum", "level", "threads", "shuffle",
+                               "delta", NULL};
 
     LZ4F_preferences_t prefs = prefs_defaults;
-    const char *input;
+    const char *input = NULL;
     Py_ssize_t input_len;
     int block_id = LZ4F_default;
     int block_mode_linked = 1;
     int checksum = 0;
     int compression_level = LZ4_COMPRESSION_MIN;
+    int threads = 1;
+    int shuffle = 0;
+    int delta = 0;
+    _filter_t filter = {0, 0, 0};
+    char *filtered = NULL;
+    size_t reserve = 0;             // for filter frame
     PyObject *output = NULL;
     char * output_str;
     size_t output_len;
     UNUSED(self);
 
     if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input, &input_len, &block_id,
-                                     &block_mode_linked, &checksum, &compression_level)) {
+                                     &block_mode_linked, &checksum, &compression_level, &threads, &shuffle, &delta)) {
         goto bail;
     }
     if (input_len <= 0) {
         PyErr_SetNone(LZ4FNoDataError);
         goto bail;
     }
-    if (!_valid_lz4f_block_size_id(block_id)) {
-        PyErr_Format(PyExc_ValueError, "block_size_id (%d) invalid", block_id);
+    if (threads < 0) {
+        PyErr_Format(PyExc_ValueError, "threads (%d) invalid", threads);
         goto bail;
     }
-    if (compression_level < LZ4_COMPRESSION_MIN || compression_level > LZ4_COMPRESSION_MAX) {
-        PyErr_Format(PyExc_ValueError, "level (%d) invalid", compression_level);
+    if (shuffle < 0 || shuffle > FILTER_ITEM_SIZE_MAX || (delta && !shuffle)) {
+        PyErr_Format(PyExc_ValueError, "shuffle (%d) invalid", shuffle);
         goto bail;
     }
-
+    BAIL_ON_NONZERO(_lz4framed_set_prefs(&prefs, block_id, block_mode_linked, checksum, compression_level));
     prefs.frameInfo.contentSize = input_len;
-    prefs.frameInfo.blockMode = block_mode_linked ? LZ4F_blockLinked : LZ4F_blockIndependent;
-    prefs.frameInfo.blockSizeID = block_id;
-    prefs.frameInfo.contentChecksumFlag = checksum ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
-    prefs.compressionLevel = compression_level;
 
-    BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressFrameBound(input_len, &prefs));
-    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, output_len));
-    BAIL_ON_NULL(output_str = PyBytes_AsString(output));
+    if (shuffle) {
+        filter.item_size = shuffle;
+        filter.delta = delta;
+        filter.chunk_size = _lz4f_block_size_from_id(block_id);
+        if (NULL == (filtered = malloc(input_len))) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+        Py_BEGIN_ALLOW_THREADS;
+        _filter_apply(&filter, input, filtered, input_len, 0);
+        Py_END_ALLOW_THREADS;
+        input = filtered;
+        reserve = FILTER_FRAME_SIZE;
+    }
 
-    if (input_len < NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD) {
-        BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressFrame(output_str, output_len, input, input_len, &prefs));
+    // (without pool support its size is zero, i.e. compress on this thread)
+    if (!threads) {
+        threads = (int)pool_get_size();
+    }
+    if (threads > 1 && (size_t)input_len > _lz4f_block_size_from_id(block_id)) {
+        BAIL_ON_NULL(output = _lz4framed_compress_parallel(input, input_len, &prefs, (unsigned)threads, reserve));
+        BAIL_ON_NULL(output_str = PyBytes_AsString(output));
     } else {
-        BAIL_ON_LZ4_ERROR_NOGIL(output_len = LZ4F_compressFrame(output_str, output_len, input, input_len, &prefs));
+        BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressFrameBound(input_len, &prefs));
+        BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, reserve + output_len));
+        BAIL_ON_NULL(output_str = PyBytes_AsString(output));
+
+        if (input_len < NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD) {
+            BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressFrame(output_str + reserve, output_len, input, input_len,
+                                                              &prefs));
+        } else {
+            BAIL_ON_LZ4_ERROR_NOGIL(output_len = LZ4F_compressFrame(output_str + reserve, output_len, input, input_len,
+                                                                    &prefs));
+        }
+        // output length might be shorter than estimated
+        BAIL_ON_NONZERO(_PyBytes_Resize(&output, reserve + output_len));
+        BAIL_ON_NULL(output_str = PyBytes_AsString(output));
     }
-    // output length might be shorter than estimated
-    BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    if (shuffle) {
+        _filter_write_frame(&filter, block_id, output_str);
+    }
+    free(filtered);
     return output;
 
 bail:
+    free(filtered);
     Py_XDECREF(output);
     return NULL;
 }
 
 /******************************************************************************/
 
+#define LZ4F_MAGIC_NUMBER 0x184D2204U
+#define LZ4F_MAGIC_SKIPPABLE_START 0x184D2A50U
+#define LZ4F_MAGIC_SKIPPABLE_MASK 0xFFFFFFF0U
+#define LZ4F_HEADER_SIZE_MIN 7
+#define LZ4F_HEADER_SIZE_MAX 15
+#define LZ4F_SKIPPABLE_HEADER_SIZE 8
+#define LZ4_MIN_MATCH 4
+#define LZ4_HISTORY_SIZE (64 KB)
+
+// Fields of a frame header, see _frame_header_decode()
+typedef struct {
+    unsigned long magic;
+    int skippable;
+    size_t header_size;
+    int block_size_id;
+    size_t block_size;
+    int block_mode_linked;
+    int block_checksum;
+    int content_checksum;
+    int has_content_size;
+    unsigned long long content_size;    // for skippable frames: length of data following header
+} _frame_header_t;
+
+/* Decodes & validates the frame header at the start of src (len bytes), applying the same checks as LZ4F does, except
+ * that block checksums are accepted. Returns size of header or LZ4F error code. (No GIL)
+ */
+static size_t _frame_header_decode(const char *src, size_t len, _frame_header_t *header) {
+    const unsigned char *in = (const unsigned char*)src;
+    unsigned flags, block_desc;
+
+    memset(header, 0, sizeof(*header));
+    if (len < 4) {
+        return LZ4F_ERROR_CODE(frameHeader_incomplete);
+    }
+    header->magic = _read_le32(src);
+    if ((header->magic & LZ4F_MAGIC_SKIPPABLE_MASK) == LZ4F_MAGIC_SKIPPABLE_START) {
+        if (len < LZ4F_SKIPPABLE_HEADER_SIZE) {
+            return LZ4F_ERROR_CODE(frameHeader_incomplete);
+        }
+        header->skippable = 1;
+        header->content_size = _read_le32(src + 4);
+        return header->header_size = LZ4F_SKIPPABLE_HEADER_SIZE;
+    }
+    if (header->magic != LZ4F_MAGIC_NUMBER) {
+        return LZ4F_ERROR_CODE(frameType_unknown);
+    }
+    if (len < 5) {
+        return LZ4F_ERROR_CODE(frameHeader_incomplete);
+    }
+    flags = in[4];
+    header->has_content_size = (flags >> 3) & 1;
+    header->header_size = header->has_content_size ? LZ4F_HEADER_SIZE_MAX : LZ4F_HEADER_SIZE_MIN;
+    if (len < header->header_size) {
+        return LZ4F_ERROR_CODE(frameHeader_incomplete);
+    }
+    block_desc = in[5];
+    if (((flags >> 6) & 3) != 1) {
+        return LZ4F_ERROR_CODE(headerVersion_wrong);
+    }
+    if ((flags & 3) || (block_desc & 0x8F)) {
+        return LZ4F_ERROR_CODE(reservedFlag_set);
+    }
+    if ((header->block_size_id = (block_desc >> 4) & 7) < LZ4F_max64KB) {
+        return LZ4F_ERROR_CODE(maxBlockSize_invalid);
+    }
+    if (((XXH32(src + 4, header->header_size - 5, 0) >> 8) & 0xFF) != in[header->header_size - 1]) {
+        return LZ4F_ERROR_CODE(headerChecksum_invalid);
+    }
+    header->block_size = _lz4f_block_size_from_id(header->block_size_id);
+    header->block_mode_linked = !((flags >> 5) & 1);
+    header->block_checksum = (flags >> 4) & 1;
+    header->content_checksum = (flags >> 2) & 1;
+    if (header->has_content_size) {
+        header->content_size = _read_le32(src + 6) | ((unsigned long long)_read_le32(src + 10) << 32);
+    }
+    return header->header_size;
+}
+
+/* Converts optional size argument obj (None or non-negative integer) named name, setting *size to SIZE_UNKNOWN for
+ * None. Returns non-zero (with exception set) on failure.
+ */
+static int _lz4framed_size_arg(PyObject *obj, const char *name, size_t *size) {
+    Py_ssize_t value;
+
+    if (NULL == obj || Py_None == obj) {
+        *size = SIZE_UNKNOWN;
+        return 0;
+    }
+    if (-1 == (value = PyNumber_AsSsize_t(obj, PyExc_OverflowError)) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (value < 0) {
+        PyErr_Format(PyExc_ValueError, "%s (%zd) invalid", name, value);
+        return -1;
+    }
+    *size = (size_t)value;
+    return 0;
+}
+
+/* Decompresses the frame in src (whose header has been decoded into header & must state the content size) directly
+ * into dst (which must hold exactly content size bytes), returning the number of bytes written or an LZ4F error code
+ * (frameSize_wrong if src is incomplete). Unlike LZ4F_decompress() no intermediate buffers are used: each block is
+ * decoded straight into place, with the output preceding it serving as its prefix (for linked blocks). If trusted is
+ * set, blocks are decoded with LZ4_decompress_fast(), assuming every compressed block but the last to decode to the
+ * frame's maximum block size. Input is then NOT bounds checked whilst decoding, i.e. malformed (or differently blocked)
+ * data can lead to reads beyond the end of src. The content checksum (if present) is verified either way. (No GIL)
+ */
+static size_t _decompress_frame_direct(const char *src, size_t src_len, const _frame_header_t *header, char *dst,
+                                       int trusted) {
+    const char *end = src + src_len;
+    size_t dst_len = (size_t)header->content_size;
+    size_t total = 0;
+    size_t history;
+    size_t size;
+    size_t decoded;
+    unsigned long word;
+    int result;
+
+    // (as per LZ4F)
+    if (header->block_checksum) {
+        return LZ4F_ERROR_CODE(blockChecksum_unsupported);
+    }
+    src += header->header_size;
+    while (1) {
+        if (end - src < 4) {
+            return LZ4F_ERROR_CODE(frameSize_wrong);
+        }
+        word = _read_le32(src);
+        src += 4;
+        // end mark
+        if (!word) {
+            break;
+        }
+        size = word & ~BLOCK_UNCOMPRESSED_FLAG;
+        if (size > header->block_size) {
+            return LZ4F_ERROR_CODE(maxBlockSize_invalid);
+        }
+        if ((size_t)(end - src) < size) {
+            return LZ4F_ERROR_CODE(frameSize_wrong);
+        }
+        if (word & BLOCK_UNCOMPRESSED_FLAG) {
+            if (size > dst_len - total) {
+                return LZ4F_ERROR_CODE(decompressionFailed);
+            }
+            memcpy(dst + total, src, size);
+            decoded = size;
+        } else {
+            decoded = MIN(header->block_size, dst_len - total);
+            history = header->block_mode_linked ? MIN(total, LZ4_HISTORY_SIZE) : 0;
+            // (previous output is contiguous with the block, i.e. serves as its prefix)
+            if (trusted) {
+                if (!decoded || (size_t)LZ4_decompress_fast_usingDict(src, dst + total, (int)decoded,
+                                                                      dst + total - history, (int)history) != size) {
+                    return LZ4F_ERROR_CODE(decompressionFailed);
+                }
+            } else {
+                if ((result = LZ4_decompress_safe_usingDict(src, dst + total, (int)size, (int)decoded,
+                                                            dst + total - history, (int)history)) < 0) {
+                    return LZ4F_ERROR_CODE(decompressionFailed);
+                }
+                decoded = (size_t)result;
+            }
+        }
+        total += decoded;
+        src += size;
+    }
+    if (total != dst_len) {
+        return LZ4F_ERROR_CODE(frameSize_wrong);
+    }
+    if (header->content_checksum) {
+        if (end - src < 4) {
+            return LZ4F_ERROR_CODE(frameSize_wrong);
+        }
+        if (XXH32(dst, total, 0) != _read_le32(src)) {
+            return LZ4F_ERROR_CODE(contentChecksum_invalid);
+        }
+    }
+    return total;
+}
+
+/* Replaces *output (filtered, uncompressed data) with its unfiltered equivalent, truncated to (up to) max_len bytes.
+ * Returns non-zero (with exception set) on failure, in which case *output is unchanged.
+ */
+static int _lz4framed_unfilter(const _filter_t *filter, PyObject **output, size_t max_len) {
+    Py_ssize_t len = PyBytes_GET_SIZE(*output);
+    PyObject *unfiltered;
+
+    if (NULL == (unfiltered = PyBytes_FromStringAndSize(NULL, len))) {
+        return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    _filter_apply(filter, PyBytes_AS_STRING(*output), PyBytes_AS_STRING(unfiltered), len, 1);
+    Py_END_ALLOW_THREADS;
+    if ((size_t)len > max_len && _PyBytes_Resize(&unfiltered, max_len)) {
+        return -1;
+    }
+    Py_DECREF(*output);
+    *output = unfiltered;
+    return 0;
+}
+
 PyDoc_STRVAR(_lz4framed_decompress__doc__,
-"decompress(b, buffer_size=1024) -> bytes\n"
+"decompress(b, buffer_size=1024, max_output=None, max_output_size=None, trusted=False) -> bytes\n"
 "\n"
 "Decompresses framed lz4 blocks from the data given in *b*, returning the\n"
-"uncompressed result. For large payloads consider using Decompressor class\n"
-"to decompress in chunks.\n"
+"uncompressed result. A shuffle filter (see compress()) is reversed. For large payloads\n"
+"consider using Decompressor class to decompress in chunks.\n"
 "\n"
 "Args:\n"
 "    b (bytes): The object containing lz4-framed data to decompress\n"
@@ -299,20 +1050,37 @@ PyDoc_STRVAR(_lz4framed_decompress__doc__,
 "                       until the resulting data fits. If the frame states\n"
 "                       uncompressed size or if len(b) > buffer_size, this\n"
 "                       parameter is ignored.\n"
+"    max_output (int): If set, only (up to) the first max_output bytes of uncompressed\n"
+"                      data are decompressed & returned, e.g. to peek at a header. Blocks\n"
+"                      following the one containing the last of these bytes are not\n"
+"                      read at all (nor is the content checksum verified).\n"
+"    max_output_size (int): If set, the most uncompressed data to allow, e.g. to guard\n"
+"                           against decompression bombs. Neither a stated content size\n"
+"                           nor buffer growth can lead to more than this being allocated.\n"
+"    trusted (bool): If set, blocks are decoded without bounds checking the compressed\n"
+"                    data (which is faster), for frames which state their content size.\n"
+"                    The content checksum (if present) is still verified. Only use this\n"
+"                    for data from a trusted source (e.g. written by compress() & not\n"
+"                    modified since) since malformed input can cause memory beyond the\n"
+"                    end of b to be read (or the process to crash). Also requires all\n"
+"                    compressed blocks but the last to be of maximum (block) size.\n"
+"                    Ignored if max_output is set.\n"
 "\n"
 "Raises:\n"
 "    LZ4FNoDataError: If provided data is of zero length\n"
+"    Lz4FramedOutputLimitError: If the (stated or actual) uncompressed size of the frame\n"
+"                               exceeds max_output_size (and max_output)\n"
 "    Lz4FramedError: If a decompression failure occured");
 #define FUNC_DEF_DECOMPRESS {"decompress", (PyCFunction)_lz4framed_decompress, METH_VARARGS | METH_KEYWORDS,\
                              _lz4framed_decompress__doc__}
 static PyObject*
 _lz4framed_decompress(PyObject *self, PyObject *args, PyObject *kwargs) {
 #if PY_MAJOR_VERSION >= 3
-    static const char *format = "y#|i:decompress";
+    static const char *format = "y#|iOOi:decompress";
 #else
-    static const char *format = "s#|i:decompress";
+    static const char *format = "s#|iOOi:decompress";
 #endif
-    static char *keywords[] = {"b", "buffer_size", NULL};
+    static char *keywords[] = {"b", "buffer_size", "max_output", "max_output_size", "trusted", NULL};
 
     LZ4F_decompressionContext_t ctx = NULL;
     LZ4F_decompressOptions_t opt = {0, {0}};
@@ -323,14 +1091,26 @@ _lz4framed_decompress(PyObject *self, PyObject *args, PyObject *kwargs) {
     size_t input_read;              // used by LZ4 functions to indicate how many bytes were / can be read
     size_t input_size_hint;         // LZ4 hint to how many bytes make up the remaining block + next header
     int buffer_size = 1024;
+    PyObject *max_output_arg = NULL;
+    PyObject *max_output_size_arg = NULL;
+    size_t max_output;
+    size_t max_output_size;
+    size_t limit;                   // most output to decompress (beyond max_output if unfiltering requires full chunks)
+    int trusted = 0;
+    _frame_header_t header;
+    size_t direct_result;
     PyObject *output = NULL;
     char *output_pos;               // position in output
     size_t output_len;              // size of output
     size_t output_remaining;        // bytes still available in output
     size_t output_written;          // used by LZ4 to indicate how many bytes were / can be written
+    size_t grow_by;
+    _filter_t filter = {0, 0, 0};
+    int filter_len;
     UNUSED(self);
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input_pos, &input_len, &buffer_size)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input_pos, &input_len, &buffer_size,
+                                     &max_output_arg, &max_output_size_arg, &trusted)) {
         goto bail;
     }
     if (input_len <= 0) {
@@ -341,7 +1121,51 @@ _lz4framed_decompress(PyObject *self, PyObject *args, PyObject *kwargs) {
         PyErr_Format(PyExc_ValueError, "buffer_size (%d) invalid", buffer_size);
         goto bail;
     }
-    input_read = input_remaining = input_len;
+    BAIL_ON_NONZERO(_lz4framed_size_arg(max_output_arg, "max_output", &max_output));
+    BAIL_ON_NONZERO(_lz4framed_size_arg(max_output_size_arg, "max_output_size", &max_output_size));
+    if (!max_output) {
+        return PyBytes_FromStringAndSize(NULL, 0);
+    }
+    BAIL_ON_NONZERO((filter_len = _filter_read_frame(input_pos, input_len, &filter)) < 0);
+    input_pos += filter_len;
+    input_read = input_remaining = input_len - filter_len;
+    limit = max_output;
+    // (filter chunks can only be reversed as a whole)
+    if (filter_len && SIZE_UNKNOWN != limit) {
+        limit = (limit + filter.chunk_size - 1) / filter.chunk_size * filter.chunk_size;
+    }
+
+    // Whole frame available & size known, so decode directly into output, bypassing LZ4F (unless decoding only part)
+    if (SIZE_UNKNOWN == limit && !LZ4F_isError(_frame_header_decode(input_pos, input_remaining, &header)) &&
+        !header.skippable && header.content_size) {
+        if (header.content_size > max_output_size) {
+            _lz4framed_set_output_limit_error(max_output_size);
+            goto bail;
+        }
+        if (header.content_size > (unsigned long long)PY_SSIZE_T_MAX) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+        BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)header.content_size));
+        if (input_remaining < NOGIL_DECOMPRESS_INPUT_SIZE_THRESHOLD) {
+            direct_result = _decompress_frame_direct(input_pos, input_remaining, &header, PyBytes_AS_STRING(output),
+                                                     trusted);
+        } else {
+            Py_BEGIN_ALLOW_THREADS;
+            direct_result = _decompress_frame_direct(input_pos, input_remaining, &header, PyBytes_AS_STRING(output),
+                                                     trusted);
+            Py_END_ALLOW_THREADS;
+        }
+        if (!LZ4F_isError(direct_result)) {
+            if (filter_len) {
+                BAIL_ON_NONZERO(_lz4framed_unfilter(&filter, &output, max_output));
+            }
+            return output;
+        }
+        // Let LZ4F decompress the frame instead so that failures (e.g. incomplete frame, content size mismatch) are
+        // reported as before
+        Py_CLEAR(output);
+    }
 
     BAIL_ON_LZ4_ERROR(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION));
 
@@ -350,12 +1174,19 @@ _lz4framed_decompress(PyObject *self, PyObject *args, PyObject *kwargs) {
     input_pos += input_read;
     input_remaining = input_read = input_remaining - input_read;
     if (frame_info.contentSize) {
-        output_len = frame_info.contentSize;
+        output_len = MIN(frame_info.contentSize, limit);
+        if (output_len > max_output_size) {
+            _lz4framed_set_output_limit_error(max_output_size);
+            goto bail;
+        }
         // Prevent LZ4 from buffering output - works if uncompressed size known since output does not have to be resized
+        // (nor is it when limited)
         opt.stableDst = 1;
     } else {
         // uncompressed size is always at least that of compressed
         output_len = MAX((size_t) buffer_size, input_remaining);
+        output_len = MIN(output_len, limit);
+        output_len = MIN(output_len, max_output_size);
     }
 
     // set up initial output buffer
@@ -379,18 +1210,30 @@ _lz4framed_decompress(PyObject *self, PyObject *args, PyObject *kwargs) {
             output_len -= output_remaining;
             break;
         }
+        // all data requested produced, ignore remainder of frame
+        if (!output_remaining && output_len == limit) {
+            break;
+        }
 
         input_pos += input_read;
         input_read = input_remaining = (input_remaining - input_read);
         // destination too small
         if (input_remaining) {
+            // Frame decodes to more than its stated size, which LZ4F rejects at the end anyway. (Growing the output
+            // would also leave LZ4F referring to the previous output as its dictionary due to stableDst being set.)
             if (frame_info.contentSize) {
-                // if frame specifies size, should never have to enlarge
-                BAIL_ON_NONZERO(PyErr_WarnEx(PyExc_RuntimeWarning, "lz4frame contentSize mismatch", 2));
+                _lz4framed_set_lz4_error(LZ4F_ERROR_CODE(frameSize_wrong));
+                goto bail;
+            }
+            grow_by = MIN(output_len, limit - output_len);
+            grow_by = MIN(grow_by, max_output_size - output_len);
+            if (!grow_by) {
+                _lz4framed_set_output_limit_error(max_output_size);
+                goto bail;
             }
-            output_remaining += output_len;
+            output_remaining += grow_by;
             output_written = output_remaining;
-            output_len *= 2;
+            output_len += grow_by;
             BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
             BAIL_ON_NULL(output_pos = PyBytes_AsString(output));
             output_pos += (output_len - output_remaining);
@@ -401,6 +1244,9 @@ _lz4framed_decompress(PyObject *self, PyObject *args, PyObject *kwargs) {
         }
     }
     BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    if (filter_len) {
+        BAIL_ON_NONZERO(_lz4framed_unfilter(&filter, &output, max_output));
+    }
     LZ4F_freeDecompressionContext(ctx);
 
     return output;
@@ -411,23 +1257,110 @@ bail:
     return NULL;
 }
 
-/******************************************************************************/
+/* Decompresses the (first) frame in src directly into dst, returning the number of bytes written or an LZ4F error code
+ * (dstMaxSize_tooSmall if dst is too small, frameSize_wrong if src is incomplete). (No GIL)
+ */
+static size_t _decompress_into(const char *src, size_t src_len, char *dst, size_t dst_len) {
+    LZ4F_decompressionContext_t ctx = NULL;
+    // output is never moved, so lz4 need not buffer it
+    LZ4F_decompressOptions_t opt = {1, {0}};
+    size_t src_read;
+    size_t dst_written;
+    size_t total = 0;
+    size_t result;
 
-static void _cctx_capsule_destructor(PyObject *py_ctx) {
-    _lz4f_cctx_t *cctx = (_lz4f_cctx_t*)PyCapsule_GetPointer(py_ctx, COMPRESSION_CAPSULE_NAME);
-    if (NULL != cctx) {
-        // ignoring errors here since shouldn't throw exception in destructor
-        LZ4F_freeCompressionContext(cctx->ctx);
-#ifdef WITH_THREAD
-        PyThread_free_lock(cctx->lock);
-#endif
-        PyMem_Del(cctx);
+    if (LZ4F_isError(result = LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) {
+        return result;
     }
+    do {
+        src_read = src_len;
+        dst_written = dst_len - total;
+        if (LZ4F_isError(result = LZ4F_decompress(ctx, dst + total, &dst_written, src, &src_read, &opt))) {
+            break;
+        }
+        src += src_read;
+        src_len -= src_read;
+        total += dst_written;
+        // frame not complete but either all input used or no progress possible
+        if (result && (!src_len || (!src_read && !dst_written))) {
+            result = (total == dst_len) ? LZ4F_ERROR_CODE(dstMaxSize_tooSmall) : LZ4F_ERROR_CODE(frameSize_wrong);
+            break;
+        }
+    } while (result);
+    LZ4F_freeDecompressionContext(ctx);
+    return LZ4F_isError(result) ? result : total;
 }
 
-static void _dctx_capsule_destructor(PyObject *py_ctx) {
-    _lz4f_dctx_t *dctx = (_lz4f_dctx_t*)PyCapsule_GetPointer(py_ctx, DECOMPRESSION_CAPSULE_NAME);
-    if (NULL != dctx) {
+PyDoc_STRVAR(_lz4framed_decompress_into__doc__,
+"decompress_into(b, buffer) -> int\n"
+"\n"
+"Decompresses the lz4 frame in b directly into buffer (e.g. a bytearray, mmap or writable\n"
+"memoryview), returning the number of bytes written. Decompression runs with the GIL\n"
+"released. Any data following the frame is ignored.\n"
+"\n"
+"Args:\n"
+"    b (bytes): The object containing the lz4-framed data to decompress\n"
+"    buffer: Writable contiguous buffer to decompress into\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If b is empty\n"
+"    Lz4FramedError: If the frame is invalid, incomplete (LZ4F_ERROR_frameSize_wrong) or\n"
+"                    does not fit into buffer (LZ4F_ERROR_dstMaxSize_tooSmall)");
+#define FUNC_DEF_DECOMPRESS_INTO {"decompress_into", (PyCFunction)_lz4framed_decompress_into,\
+                                  METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_into__doc__}
+static PyObject*
+_lz4framed_decompress_into(PyObject *self, PyObject *args, PyObject *kwargs) {
+#if PY_MAJOR_VERSION >= 3
+    static const char *format = "y*w*:decompress_into";
+#else
+    static const char *format = "s*w*:decompress_into";
+#endif
+    static char *keywords[] = {"b", "buffer", NULL};
+
+    Py_buffer input = {NULL, NULL};
+    Py_buffer output = {NULL, NULL};
+    size_t result;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input, &output)) {
+        goto bail;
+    }
+    if (input.len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    BAIL_ON_LZ4_ERROR_NOGIL(result = _decompress_into(input.buf, input.len, output.buf, output.len));
+    PyBuffer_Release(&input);
+    PyBuffer_Release(&output);
+    return PyLong_FromSize_t(result);
+
+bail:
+    if (input.obj) {
+        PyBuffer_Release(&input);
+    }
+    if (output.obj) {
+        PyBuffer_Release(&output);
+    }
+    return NULL;
+}
+
+/******************************************************************************/
+
+static void _cctx_capsule_destructor(PyObject *py_ctx) {
+    _lz4f_cctx_t *cctx = (_lz4f_cctx_t*)PyCapsule_GetPointer(py_ctx, COMPRESSION_CAPSULE_NAME);
+    if (NULL != cctx) {
+        // ignoring errors here since shouldn't throw exception in destructor
+        LZ4F_freeCompressionContext(cctx->ctx);
+#ifdef WITH_THREAD
+        PyThread_free_lock(cctx->lock);
+#endif
+        PyMem_Del(cctx);
+    }
+}
+
+static void _dctx_capsule_destructor(PyObject *py_ctx) {
+    _lz4f_dctx_t *dctx = (_lz4f_dctx_t*)PyCapsule_GetPointer(py_ctx, DECOMPRESSION_CAPSULE_NAME);
+    if (NULL != dctx) {
         // ignoring errors here since shouldn't throw exception in destructor
         LZ4F_freeDecompressionContext(dctx->ctx);
 #ifdef WITH_THREAD
@@ -545,7 +1478,9 @@ PyDoc_STRVAR(_lz4framed_compress_begin__doc__,
 "                      incomplete blocks internally.\n"
 "    level (int): Compression level. Values lower than LZ4F_COMPRESSION_MIN_HC use fast\n"
 "                 compression. Recommended range for hc compression is between 4 and 9,\n"
-"                 with a maximum of LZ4F_COMPRESSION_MAX.\n"
+"                 with a maximum of LZ4F_COMPRESSION_MAX. Negative values (down to\n"
+"                 LZ4F_COMPRESSION_FASTEST) trade ratio for speed, with an acceleration\n"
+"                 factor of (1 - level).\n"
 "\n"
 "Raises:\n"
 "    Lz4FramedError: If a compression failure occured");
@@ -581,7 +1516,7 @@ _lz4framed_compress_begin(PyObject *self, PyObject *args, PyObject *kwargs) {
         PyErr_Format(PyExc_ValueError, "block_size_id (%d) invalid", block_id);
         goto bail;
     }
-    if (compression_level < LZ4_COMPRESSION_MIN || compression_level > LZ4_COMPRESSION_MAX) {
+    if (compression_level < LZ4_COMPRESSION_FASTEST || compression_level > LZ4_COMPRESSION_MAX) {
         PyErr_Format(PyExc_ValueError, "level (%d) invalid", compression_level);
         goto bail;
     }
@@ -641,7 +1576,7 @@ _lz4framed_compress_update(PyObject *self, PyObject *args) {
 #endif
     _lz4f_cctx_t *cctx = NULL;
     PyObject *ctx_capsule;
-    const char *input;
+    const char *input = NULL;
     Py_ssize_t input_len;
     PyObject *output = NULL;
     char *output_str;
@@ -687,6 +1622,57 @@ bail:
 
 /******************************************************************************/
 
+PyDoc_STRVAR(_lz4framed_compress_flush__doc__,
+"compress_flush(ctx) -> bytes\n"
+"\n"
+"Compresses and returns any data buffered internally (as a result of autoflush not\n"
+"having been set via compress_begin()), without finalising the frame.\n"
+"\n"
+"Args:\n"
+"    ctx: Compression context\n"
+"\n"
+"Raises:\n"
+"    Lz4FramedError: If a compression failure occured");
+#define FUNC_DEF_COMPRESS_FLUSH {"compress_flush", (PyCFunction)_lz4framed_compress_flush, METH_O,\
+                                 _lz4framed_compress_flush__doc__}
+static PyObject*
+_lz4framed_compress_flush(PyObject *self, PyObject *arg) {
+    _lz4f_cctx_t *cctx = NULL;
+    PyObject *output = NULL;
+    char *output_str;
+    size_t output_len;
+    LZ4FRAMED_LOCK_FLAG;
+    UNUSED(self);
+
+    if (!PyCapsule_IsValid(arg, COMPRESSION_CAPSULE_NAME)) {
+        PyErr_SetString(PyExc_ValueError, "ctx invalid");
+        goto bail;
+    }
+    // Guaranteed to succeed due to PyCapsule_IsValid check above
+    cctx = PyCapsule_GetPointer(arg, COMPRESSION_CAPSULE_NAME);
+
+    ENTER_LZ4FRAMED(cctx);
+
+    BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressBound(0, &(cctx->prefs)));
+    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, output_len));
+    BAIL_ON_NULL(output_str = PyBytes_AsString(output));
+
+    // at most one (partial) block to compress
+    BAIL_ON_LZ4_ERROR_NOGIL(output_len = LZ4F_flush(cctx->ctx, output_str, output_len, NULL));
+
+    EXIT_LZ4FRAMED(cctx);
+
+    BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    return output;
+
+bail:
+    EXIT_LZ4FRAMED(cctx);
+    Py_XDECREF(output);
+    return NULL;
+}
+
+/******************************************************************************/
+
 PyDoc_STRVAR(_lz4framed_compress_end__doc__,
 "compress_end(ctx) -> bytes\n"
 "\n"
@@ -815,7 +1801,7 @@ bail:
 /******************************************************************************/
 
 PyDoc_STRVAR(_lz4framed_decompress_update__doc__,
-"decompress_update(ctx, b, chunk_len=65536) -> list\n"
+"decompress_update(ctx, b, chunk_len=65536, max_output_size=None) -> list\n"
 "\n"
 "Decompresses parts of an lz4 frame from data given in *b*, returning the\n"
 "uncompressed result as a list of chunks, with the last element being input_hint\n"
@@ -824,33 +1810,41 @@ PyDoc_STRVAR(_lz4framed_decompress_update__doc__,
 "function may return no chunks if they are incomplete.\n"
 "Args:\n"
 "    ctx: Decompression context\n"
-"    b (bytes): The object containing lz4-framed data to decompress\n"
+"    b (bytes-like): The object containing lz4-framed data to decompress, e.g. bytes,\n"
+"                    bytearray or memoryview\n"
 "    chunk_len (int): Size of uncompressed chunks in bytes. If not all of the\n"
 "                     data fits in one chunk, multiple will be used. Ideally\n"
 "                     only one chunk is required per call of this method - this can\n"
-"                     be determined from block_size_id via get_frame_info() call."
+"                     be determined from block_size_id via get_frame_info() call.\n"
+"    max_output_size (int): If set, the most uncompressed data this call may produce.\n"
+"                           The context must not be used any further if exceeded.\n"
 "\n"
 "Raises:\n"
+"    Lz4FramedOutputLimitError: If b decompresses to more than max_output_size bytes\n"
 "    Lz4FramedError: If a decompression failure occured");
 #define FUNC_DEF_DECOMPRESS_UPDATE {"decompress_update", (PyCFunction)_lz4framed_decompress_update,\
                                     METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_update__doc__}
 static PyObject*
 _lz4framed_decompress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
 #if PY_MAJOR_VERSION >= 3
-    static const char *format = "Oy#|i:decompress_update";
+    static const char *format = "Oy*|iO:decompress_update";
 #else
-    static const char *format = "Os#|i:decompress_update";
+    static const char *format = "Os*|iO:decompress_update";
 #endif
-    static char *keywords[] = {"ctx", "b", "chunk_len", NULL};
+    static char *keywords[] = {"ctx", "b", "chunk_len", "max_output_size", NULL};
 
     _lz4f_dctx_t *dctx = NULL;
     PyObject *dctx_capsule;
+    Py_buffer input = {NULL, NULL};  // (buffer protocol so e.g. a re-used bytearray can be supplied)
     const char *input_pos;           // position in input
-    Py_ssize_t input_len;
     size_t input_remaining;          // bytes remaining in input
     size_t input_read;               // used by LZ4 functions to indicate how many bytes were / can be read
     size_t input_size_hint = 1;      // LZ4 hint to how many bytes make up the remaining block + next header
     size_t chunk_len = 65536;        // size of chunks
+    PyObject *max_output_size_arg = NULL;
+    size_t max_output_size;
+    size_t output_size = 0;          // produced so far by this call
+    size_t this_chunk_len;           // size of current chunk (smaller than chunk_len if limited by max_output_size)
     PyObject *list = NULL;           // function return
     PyObject *size_hint = NULL;      // python object of input_size_hint
     PyObject *chunk = NULL ;
@@ -860,15 +1854,15 @@ _lz4framed_decompress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
     LZ4FRAMED_LOCK_FLAG;
     UNUSED(self);
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &dctx_capsule, &input_pos, &input_len,
-                                     &chunk_len)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &dctx_capsule, &input, &chunk_len,
+                                     &max_output_size_arg)) {
         goto bail;
     }
     if (!PyCapsule_IsValid(dctx_capsule, DECOMPRESSION_CAPSULE_NAME)) {
         PyErr_SetString(PyExc_ValueError, "ctx invalid");
         goto bail;
     }
-    if (input_len <= 0) {
+    if (input.len <= 0) {
         PyErr_SetNone(LZ4FNoDataError);
         goto bail;
     }
@@ -876,31 +1870,37 @@ _lz4framed_decompress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
         PyErr_SetString(PyExc_ValueError, "chunk_len invalid");
         goto bail;
     }
+    BAIL_ON_NONZERO(_lz4framed_size_arg(max_output_size_arg, "max_output_size", &max_output_size));
     // Guaranteed to succeed due to PyCapsule_IsValid check above
     dctx = PyCapsule_GetPointer(dctx_capsule, DECOMPRESSION_CAPSULE_NAME);
 
-    input_read = input_remaining = input_len;
+    input_pos = input.buf;
+    input_read = input_remaining = input.len;
 
     // output list
     BAIL_ON_NULL(list = PyList_New(0));
 
     // first chunk
-    BAIL_ON_NULL(chunk = PyBytes_FromStringAndSize(NULL, chunk_len));
+    this_chunk_len = MIN(chunk_len, max_output_size);
+    BAIL_ON_NULL(chunk = PyBytes_FromStringAndSize(NULL, this_chunk_len));
     BAIL_ON_NULL(chunk_pos = PyBytes_AsString(chunk));
-    chunk_written = chunk_remaining = chunk_len;
+    chunk_written = chunk_remaining = this_chunk_len;
 
     ENTER_LZ4FRAMED(dctx);
 
     while (input_remaining && input_size_hint) {
         // add another chunk for more data when current one full
-        if (!chunk_remaining) {
+        if (!chunk_remaining && output_size < max_output_size) {
             // append previous (full) chunk to list
-            BAIL_ON_NONZERO(PyList_Append(list, chunk));
+            if (this_chunk_len) {
+                BAIL_ON_NONZERO(PyList_Append(list, chunk));
+            }
             Py_CLEAR(chunk);
             // create next chunk
-            BAIL_ON_NULL(chunk = PyBytes_FromStringAndSize(NULL, chunk_len));
+            this_chunk_len = MIN(chunk_len, max_output_size - output_size);
+            BAIL_ON_NULL(chunk = PyBytes_FromStringAndSize(NULL, this_chunk_len));
             BAIL_ON_NULL(chunk_pos = PyBytes_AsString(chunk));
-            chunk_written = chunk_remaining = chunk_len;
+            chunk_written = chunk_remaining = this_chunk_len;
         }
         if (chunk_written < NOGIL_DECOMPRESS_OUTPUT_SIZE_THRESHOLD) {
             BAIL_ON_LZ4_ERROR(input_size_hint = LZ4F_decompress(dctx->ctx, chunk_pos, &chunk_written, input_pos,
@@ -909,6 +1909,13 @@ _lz4framed_decompress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
             BAIL_ON_LZ4_ERROR_NOGIL(input_size_hint = LZ4F_decompress(dctx->ctx, chunk_pos, &chunk_written, input_pos,
                                                                       &input_read, NULL));
         }
+        // Limit reached yet lz4 can make no progress without producing more output. (Without output space it can
+        // still consume e.g. the end mark & checksum.)
+        if (!chunk_remaining && !input_read) {
+            _lz4framed_set_output_limit_error(max_output_size);
+            goto bail;
+        }
+        output_size += chunk_written;
         chunk_pos += chunk_written;
         chunk_written = chunk_remaining = (chunk_remaining - chunk_written);
         input_pos += input_read;
@@ -918,8 +1925,8 @@ _lz4framed_decompress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
     EXIT_LZ4FRAMED(dctx);
 
     // append & reduce size of final chunk (if contains any data)
-    if (chunk_remaining < chunk_len) {
-        BAIL_ON_NONZERO(_PyBytes_Resize(&chunk, chunk_len - chunk_remaining));
+    if (chunk_remaining < this_chunk_len) {
+        BAIL_ON_NONZERO(_PyBytes_Resize(&chunk, this_chunk_len - chunk_remaining));
         BAIL_ON_NONZERO(PyList_Append(list, chunk));
     }
     // append input size hint to list
@@ -927,6 +1934,7 @@ _lz4framed_decompress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
     BAIL_ON_NONZERO(PyList_Append(list, size_hint));
     Py_CLEAR(chunk);
     Py_CLEAR(size_hint);
+    PyBuffer_Release(&input);
 
     return list;
 
@@ -935,16 +1943,3746 @@ bail:
     Py_XDECREF(chunk);
     Py_XDECREF(size_hint);
     Py_XDECREF(list);
+    if (input.obj) {
+        PyBuffer_Release(&input);
+    }
     return NULL;
 }
 
 
+/******************************************************************************/
+
+// Allocates buffer suitable for direct file I/O. Must be freed via _aligned_buffer_free(). No exception set on failure.
+static char* _aligned_buffer_alloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, FILE_IO_BUFFER_ALIGNMENT);
+#else
+    void *buffer;
+    return posix_memalign(&buffer, FILE_IO_BUFFER_ALIGNMENT, size) ? NULL : buffer;
+#endif
+}
+
+static void _aligned_buffer_free(char *buffer) {
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+/* Returns file descriptor for the given path (str/bytes) or file descriptor (int), or -1 (with exception set) on
+ * failure. close_fd is set to indicate whether the caller is responsible for closing the descriptor.
+ */
+static int _lz4framed_file_open(PyObject *file, int flags, int *close_fd) {
+    PyObject *path = NULL;
+    int fd = -1;
+
+    *close_fd = 0;
+#if PY_MAJOR_VERSION < 3
+    if (PyInt_Check(file)) {
+        fd = (int)PyInt_AsLong(file);
+    } else
+#endif
+    if (PyLong_Check(file)) {
+        fd = (int)PyLong_AsLong(file);
+    } else {
+#if PY_MAJOR_VERSION >= 3
+        if (!PyUnicode_FSConverter(file, &path)) {
+            goto bail;
+        }
+#else
+        if (PyString_Check(file)) {
+            Py_INCREF(path = file);
+        } else {
+            BAIL_ON_NULL(path = PyUnicode_AsEncodedString(file, Py_FileSystemDefaultEncoding, NULL));
+        }
+#endif
+        Py_BEGIN_ALLOW_THREADS;
+        fd = LZ4FRAMED_OPEN(PyBytes_AS_STRING(path), flags);
+        Py_END_ALLOW_THREADS;
+        if (fd < 0) {
+            PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, file);
+            goto bail;
+        }
+        *close_fd = 1;
+        Py_DECREF(path);
+    }
+    if (fd < 0) {
+        if (!PyErr_Occurred()) {
+            PyErr_Format(PyExc_ValueError, "file descriptor (%d) invalid", fd);
+        }
+        goto bail;
+    }
+    return fd;
+
+bail:
+    Py_XDECREF(path);
+    return -1;
+}
+
+// Reads until len bytes or end of file reached. Returns number of bytes read or -1 (setting errno) on failure. (No GIL)
+static Py_ssize_t _read_fully(int fd, char *buf, size_t len) {
+    size_t total = 0;
+    Py_ssize_t count;
+
+    while (total < len) {
+        if ((count = LZ4FRAMED_READ(fd, buf + total, len - total)) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        } else if (!count) {
+            break;
+        }
+        total += count;
+    }
+    return total;
+}
+
+// Writes all of buf. Returns non-zero (setting errno) on failure. (No GIL)
+static int _write_fully(int fd, const char *buf, size_t len) {
+    Py_ssize_t count;
+
+    while (len) {
+        if ((count = LZ4FRAMED_WRITE(fd, buf, len)) < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        buf += count;
+        len -= count;
+    }
+    return 0;
+}
+
+#define BAIL_ON_FILE_IO_ERROR(io_errno) \
+if (io_errno) {\
+    errno = (io_errno);\
+    PyErr_SetFromErrno(PyExc_IOError);\
+    goto bail;\
+}
+
+/* Memory-mapped region of file, starting at the file position at time of mapping (see _file_map_*). On platforms
+ * without mmap support the mapping functions always fail, leaving addr set to NULL.
+ */
+typedef struct {
+    char *addr;             // start of mapping (page-aligned)
+    size_t len;             // length of mapping
+    char *data;             // start of data (i.e. file position at time of mapping)
+    size_t data_len;        // length of data from said position
+    unsigned long long pos; // file position at time of mapping
+    int writable;
+} _file_map_t;
+#define FILE_MAP_INIT {NULL, 0, NULL, 0, 0, 0}
+
+#ifdef LZ4FRAMED_HAVE_MMAP
+// Sets up mapping covering len bytes from current position of fd. Returns non-zero (setting errno) on failure.
+static int _file_map(int fd, size_t len, int writable, _file_map_t *map) {
+    off_t pos;
+    size_t page_offset;
+
+    if ((pos = lseek(fd, 0, SEEK_CUR)) < 0) {
+        return -1;
+    }
+    page_offset = (size_t)(pos % sysconf(_SC_PAGESIZE));
+    map->len = len + page_offset;
+    map->addr = mmap(NULL, map->len, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, pos - page_offset);
+    if (MAP_FAILED == map->addr) {
+        map->addr = NULL;
+        return -1;
+    }
+    map->data = map->addr + page_offset;
+    map->data_len = len;
+    map->pos = (unsigned long long)pos;
+    map->writable = writable;
+    return 0;
+}
+#endif
+
+// Maps remainder of fd (from current position) for sequential reading. Returns non-zero if not possible. (No GIL)
+static int _file_map_src(int fd, _file_map_t *map) {
+#ifdef LZ4FRAMED_HAVE_MMAP
+    struct stat info;
+    off_t pos;
+
+    if (fstat(fd, &info) || !S_ISREG(info.st_mode) || (pos = lseek(fd, 0, SEEK_CUR)) < 0 || info.st_size <= pos ||
+        (unsigned long long)(info.st_size - pos) > (size_t)-1 ||
+        _file_map(fd, (size_t)(info.st_size - pos), 0, map)) {
+        return -1;
+    }
+    // advisory only, hence ignoring failure
+    madvise(map->addr, map->len, MADV_SEQUENTIAL);
+    return 0;
+#else
+    UNUSED(fd);
+    UNUSED(map);
+    return -1;
+#endif
+}
+
+/* Extends fd so that len bytes are available from current position and maps said region for writing. Returns non-zero
+ * if not possible, in which case the file is left unchanged. (No GIL)
+ */
+static int _file_map_dst(int fd, size_t len, _file_map_t *map) {
+#ifdef LZ4FRAMED_HAVE_MMAP
+    struct stat info;
+    off_t pos;
+    int flags;
+
+    // appending descriptors ignore position
+    if ((flags = fcntl(fd, F_GETFL)) < 0 || (flags & O_APPEND) || fstat(fd, &info) || !S_ISREG(info.st_mode) ||
+        (pos = lseek(fd, 0, SEEK_CUR)) < 0) {
+        return -1;
+    }
+#ifdef LZ4FRAMED_HAVE_FALLOCATE
+    /* Reserves blocks up front since a (sparse) file extended via ftruncate() can fail to grow when written to via
+     * the mapping (e.g. disk full), which results in SIGBUS rather than an error. On failure the write() path is used.
+     */
+    if ((errno = posix_fallocate(fd, pos, len))) {
+        // ignoring errors since original failure more relevant
+        if (ftruncate(fd, info.st_size)) {}
+        return -1;
+    }
+#else
+    if (ftruncate(fd, pos + len)) {
+        return -1;
+    }
+#endif
+    if (_file_map(fd, len, 1, map)) {
+        // ignoring errors since original failure more relevant
+        if (ftruncate(fd, info.st_size)) {}
+        return -1;
+    }
+    madvise(map->addr, map->len, MADV_SEQUENTIAL);
+    return 0;
+#else
+    UNUSED(fd);
+    UNUSED(len);
+    UNUSED(map);
+    return -1;
+#endif
+}
+
+/* Removes mapping and moves fd position to data_used bytes past the mapped data. For writable mappings the file is
+ * truncated to said position. Returns non-zero (setting errno) on failure. (No GIL)
+ */
+static int _file_unmap(int fd, _file_map_t *map, size_t data_used) {
+#ifdef LZ4FRAMED_HAVE_MMAP
+    int failed = munmap(map->addr, map->len);
+    off_t end = (off_t)(map->pos + data_used);
+
+    map->addr = NULL;
+    if (map->writable && ftruncate(fd, end)) {
+        failed = 1;
+    }
+    if (lseek(fd, end, SEEK_SET) < 0) {
+        failed = 1;
+    }
+    return failed;
+#else
+    UNUSED(fd);
+    UNUSED(map);
+    UNUSED(data_used);
+    return -1;
+#endif
+}
+
+// Output for compress_file(), either via buffer (written to fd on commit) or directly to memory-mapped region
+typedef struct {
+    int fd;
+    char *buffer;       // NULL if writing to mapped region
+    char *pos;          // where next output is to be placed
+    size_t capacity;    // available at pos
+} _file_output_t;
+
+// Writes out (or advances past) len bytes placed at out->pos. Returns non-zero (setting errno) on failure. (No GIL)
+static int _file_output_commit(_file_output_t *out, size_t len) {
+    if (out->buffer) {
+        return _write_fully(out->fd, out->buffer, len);
+    }
+    out->pos += len;
+    out->capacity -= len;
+    return 0;
+}
+
+/* Multi-threaded variant of the compress_file() loop: Input is processed in chunks of whole blocks, each of which is
+ * compressed in parallel (see _parallel_compress_blocks), with the end of each chunk being kept as dictionary for the
+ * next one (linked blocks only). ctx is only used to write the frame header. Returns non-zero (with exception set) on
+ * failure.
+ */
+static int _compress_file_parallel(LZ4F_compressionContext_t ctx, int src_fd, int dst_fd, LZ4F_preferences_t *prefs,
+                                   unsigned max_tasks, int mmap_src, unsigned long long *total) {
+    _file_map_t src_map = FILE_MAP_INIT;
+    size_t block_size = _lz4f_block_size_from_id(prefs->frameInfo.blockSizeID);
+    size_t history_max = (prefs->frameInfo.blockMode == LZ4F_blockLinked) ? 64 KB : 0;
+    size_t history = 0;
+    size_t input_chunk;
+    char *input_buffer = NULL;
+    const char *input = NULL;
+    Py_ssize_t input_len = 0;
+    size_t input_consumed = 0;      // from source mapping
+    char *output = NULL;
+    size_t output_len;
+    XXH32_state_t *checksum = NULL;
+    int io_errno = 0;
+    int err = 0;
+
+    // enough whole blocks to keep all tasks busy
+    input_chunk = MAX(FILE_IO_CHUNK_SIZE, block_size * max_tasks * 2);
+    input_chunk = (input_chunk + block_size - 1) / block_size * block_size;
+
+    if (mmap_src) {
+        Py_BEGIN_ALLOW_THREADS;
+        if (!_file_map_src(src_fd, &src_map)) {
+            prefs->frameInfo.contentSize = src_map.data_len;
+        }
+        Py_END_ALLOW_THREADS;
+    }
+    // dictionary area immediately precedes chunk
+    if ((!src_map.addr && NULL == (input_buffer = _aligned_buffer_alloc(history_max + input_chunk))) ||
+        // header, block slots, end mark & checksum
+        NULL == (output = _aligned_buffer_alloc(LZ4F_HEADER_SIZE_MAX + input_chunk / block_size * (block_size + 4) +
+                                                8))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    if (prefs->frameInfo.contentChecksumFlag == LZ4F_contentChecksumEnabled) {
+        if (NULL == (checksum = XXH32_createState())) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+        XXH32_reset(checksum, 0);
+    }
+
+    BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressBegin(ctx, output, LZ4F_HEADER_SIZE_MAX, prefs));
+    do {
+        // One chunk per GIL release so that signals (e.g. KeyboardInterrupt) are not ignored for large files
+        Py_BEGIN_ALLOW_THREADS;
+        if (_write_fully(dst_fd, output, output_len)) {
+            io_errno = errno;
+        } else {
+            *total += output_len;
+            output_len = 0;
+            if (src_map.addr) {
+                input = src_map.data + input_consumed;
+                history = MIN(history_max, input_consumed);
+                input_len = MIN(input_chunk, src_map.data_len - input_consumed);
+                input_consumed += input_len;
+            } else {
+                // end of previous chunk becomes dictionary
+                if (history_max && input_len) {
+                    history = MIN(history_max, (size_t)input_len);
+                    memmove(input_buffer + history_max - history, input_buffer + history_max + input_len - history,
+                            history);
+                }
+                input = input_buffer + history_max;
+                if ((input_len = _read_fully(src_fd, input_buffer + history_max, input_chunk)) < 0) {
+                    io_errno = errno;
+                }
+            }
+            if (!io_errno && input_len > 0 &&
+                !(output_len = _parallel_compress_blocks(input, input_len, history, prefs, max_tasks, output, output,
+                                                         checksum))) {
+                err = errno;
+            }
+        }
+        Py_END_ALLOW_THREADS;
+        BAIL_ON_FILE_IO_ERROR(io_errno);
+        if (err) {
+            _parallel_set_error(err);
+            goto bail;
+        }
+        BAIL_ON_NONZERO(PyErr_CheckSignals());
+    } while (input_len);
+
+    output_len = _parallel_end_frame(output, checksum) - output;
+    Py_BEGIN_ALLOW_THREADS;
+    if (_write_fully(dst_fd, output, output_len)) {
+        io_errno = errno;
+    }
+    // input fd position is left at end of input, in line with non-mapped reads
+    if (src_map.addr) {
+        _file_unmap(src_fd, &src_map, src_map.data_len);
+    }
+    Py_END_ALLOW_THREADS;
+    BAIL_ON_FILE_IO_ERROR(io_errno);
+    *total += output_len;
+
+    if (checksum) {
+        XXH32_freeState(checksum);
+    }
+    _aligned_buffer_free(input_buffer);
+    _aligned_buffer_free(output);
+    return 0;
+
+bail:
+    if (src_map.addr) {
+        _file_unmap(src_fd, &src_map, 0);
+    }
+    if (checksum) {
+        XXH32_freeState(checksum);
+    }
+    _aligned_buffer_free(input_buffer);
+    _aligned_buffer_free(output);
+    return -1;
+}
+
+/******************************************************************************/
+
+PyDoc_STRVAR(_lz4framed_compress_file__doc__,
+"compress_file(src, dst, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True,\n"
+"              checksum=False, level=0, mmap_src=False, mmap_dst=False, threads=1) -> int\n"
+"\n"
+"Compresses the contents of src into a single lz4 frame written to dst, returning\n"
+"the number of bytes written. The whole read/compress/write loop runs natively\n"
+"with the GIL released (signals are processed between chunks). File descriptors\n"
+"are used as-is (from their current position) and not closed. Paths given for\n"
+"dst are created or truncated. An empty input produces an empty frame.\n"
+"\n"
+"Args:\n"
+"    src (str, bytes or int): Path or file descriptor to read uncompressed data from\n"
+"    dst (str, bytes or int): Path or file descriptor to write lz4-framed data to\n"
+"    block_size_id (int): Compression block size identifier, one of the\n"
+"                         LZ4F_BLOCKSIZE_* constants\n"
+"    block_mode_linked (bool): Whether compression blocks are linked\n"
+"    checksum (bool): Whether to produce frame checksum\n"
+"    level (int): Compression level, see compress()\n"
+"    mmap_src (bool): Whether to memory-map src (if a non-empty regular file) rather\n"
+"                     than reading it into intermediate buffers. The frame will also\n"
+"                     state the uncompressed length in this case.\n"
+"    mmap_dst (bool): Whether to also write the output via a memory-mapped region of\n"
+"                     dst (if a regular file, opened for reading and writing if given\n"
+"                     as descriptor). Only applies if src has been memory-mapped.\n"
+"    threads (int): Maximum number of blocks to compress in parallel, see compress().\n"
+"                   Input is then processed in chunks of multiple blocks and mmap_dst\n"
+"                   does not apply.\n"
+"\n"
+"Note: Memory-mapping is only supported on POSIX platforms and is silently skipped\n"
+"where not applicable.\n"
+"\n"
+"Raises:\n"
+"    IOError: If a read or write fails\n"
+"    Lz4FramedError: If a compression failure occured");
+#define FUNC_DEF_COMPRESS_FILE {"compress_file", (PyCFunction)_lz4framed_compress_file, METH_VARARGS | METH_KEYWORDS,\
+                                _lz4framed_compress_file__doc__}
+static PyObject*
+_lz4framed_compress_file(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "OO|iiiiiii:compress_file";
+    static char *keywords[] = {"src", "dst", "block_size_id", "block_mode_linked", "checksum", "level", "mmap_src",
+                               "mmap_dst", "threads", NULL};
+
+    LZ4F_preferences_t prefs = prefs_defaults;
+    LZ4F_compressOptions_t opt = {0, {0}};
+    LZ4F_compressionContext_t ctx = NULL;
+    PyObject *src, *dst;
+    int src_fd = -1, dst_fd = -1;
+    int src_close = 0, dst_close = 0;
+    int block_id = LZ4F_default;
+    int block_mode_linked = 1;
+    int checksum = 0;
+    int compression_level = LZ4_COMPRESSION_MIN;
+    int mmap_src = 0;
+    int mmap_dst = 0;
+    int threads = 1;
+    _file_map_t src_map = FILE_MAP_INIT;
+    _file_map_t dst_map = FILE_MAP_INIT;
+    size_t input_chunk = FILE_IO_CHUNK_SIZE;
+    char *input_buffer = NULL;
+    const char *input = NULL;
+    Py_ssize_t input_len = 0;
+    size_t input_consumed = 0;      // from source mapping
+    _file_output_t out = {-1, NULL, NULL, 0};
+    size_t output_len = 0;
+    unsigned long long total = 0;
+    int io_errno = 0;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &src, &dst, &block_id, &block_mode_linked,
+                                     &checksum, &compression_level, &mmap_src, &mmap_dst, &threads)) {
+        goto bail;
+    }
+    if (threads < 0) {
+        PyErr_Format(PyExc_ValueError, "threads (%d) invalid", threads);
+        goto bail;
+    }
+    BAIL_ON_NONZERO(_lz4framed_set_prefs(&prefs, block_id, block_mode_linked, checksum, compression_level));
+    BAIL_ON_LZ4_ERROR(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION));
+    BAIL_ON_NONZERO((src_fd = _lz4framed_file_open(src, O_RDONLY, &src_close)) < 0);
+    BAIL_ON_NONZERO((dst_fd = _lz4framed_file_open(dst, (mmap_src && mmap_dst ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC,
+                                                    &dst_close)) < 0);
+    out.fd = dst_fd;
+
+    // (without pool support its size is zero, i.e. compress on this thread)
+    if (!threads) {
+        threads = (int)pool_get_size();
+    }
+    if (threads > 1) {
+        BAIL_ON_NONZERO(_compress_file_parallel(ctx, src_fd, dst_fd, &prefs, (unsigned)threads, mmap_src, &total));
+        goto done;
+    }
+    if (mmap_src) {
+        Py_BEGIN_ALLOW_THREADS;
+        if (!_file_map_src(src_fd, &src_map)) {
+            prefs.frameInfo.contentSize = src_map.data_len;
+            // whole blocks per update, so lz4 never has to copy input into its internal buffer
+            input_chunk = MAX(FILE_IO_CHUNK_SIZE, _lz4f_block_size_from_id(block_id));
+            // input stays mapped for whole duration, so lz4 does not have to preserve (linked) dictionary either
+            opt.stableSrc = 1;
+            if (mmap_dst) {
+                output_len = LZ4F_compressFrameBound(src_map.data_len, &prefs);
+                if (!LZ4F_isError(output_len) && !_file_map_dst(dst_fd, output_len, &dst_map)) {
+                    out.pos = dst_map.data;
+                    out.capacity = dst_map.data_len;
+                }
+            }
+        }
+        Py_END_ALLOW_THREADS;
+    }
+    if (!src_map.addr && NULL == (input_buffer = _aligned_buffer_alloc(input_chunk))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    if (!dst_map.addr) {
+        BAIL_ON_LZ4_ERROR(out.capacity = LZ4F_compressBound(input_chunk, &prefs));
+        if (NULL == (out.pos = out.buffer = _aligned_buffer_alloc(out.capacity))) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+    }
+
+    BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressBegin(ctx, out.pos, out.capacity, &prefs));
+    do {
+        // One chunk per GIL release so that signals (e.g. KeyboardInterrupt) are not ignored for large files
+        Py_BEGIN_ALLOW_THREADS;
+        if (_file_output_commit(&out, output_len)) {
+            io_errno = errno;
+        } else if (src_map.addr) {
+            input = src_map.data + input_consumed;
+            input_len = MIN(input_chunk, src_map.data_len - input_consumed);
+            input_consumed += input_len;
+        } else if ((input_len = _read_fully(src_fd, input_buffer, input_chunk)) < 0) {
+            io_errno = errno;
+        } else {
+            input = input_buffer;
+        }
+        if (!io_errno && input_len) {
+            total += output_len;
+            output_len = LZ4F_compressUpdate(ctx, out.pos, out.capacity, input, input_len, &opt);
+        }
+        Py_END_ALLOW_THREADS;
+        BAIL_ON_FILE_IO_ERROR(io_errno);
+        BAIL_ON_LZ4_ERROR(output_len);
+        BAIL_ON_NONZERO(PyErr_CheckSignals());
+    } while (input_len);
+    total += output_len;
+
+    // not worth releasing GIL since should have less than a block left to write
+    BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressEnd(ctx, out.pos, out.capacity, NULL));
+    Py_BEGIN_ALLOW_THREADS;
+    if (_file_output_commit(&out, output_len)) {
+        io_errno = errno;
+    }
+    total += output_len;
+    // input fd position is left at end of input, in line with non-mapped reads
+    if (src_map.addr) {
+        _file_unmap(src_fd, &src_map, src_map.data_len);
+    }
+    if (!io_errno && dst_map.addr && _file_unmap(dst_fd, &dst_map, total)) {
+        io_errno = errno;
+    }
+    Py_END_ALLOW_THREADS;
+    BAIL_ON_FILE_IO_ERROR(io_errno);
+
+done:
+    if (dst_close && LZ4FRAMED_CLOSE(dst_fd)) {
+        dst_close = 0;
+        BAIL_ON_FILE_IO_ERROR(errno);
+    }
+    dst_close = 0;
+    if (src_close) {
+        LZ4FRAMED_CLOSE(src_fd);
+    }
+    LZ4F_freeCompressionContext(ctx);
+    _aligned_buffer_free(input_buffer);
+    _aligned_buffer_free(out.buffer);
+
+    return PyLong_FromUnsignedLongLong(total);
+
+bail:
+    if (src_map.addr) {
+        _file_unmap(src_fd, &src_map, 0);
+    }
+    if (dst_map.addr) {
+        _file_unmap(dst_fd, &dst_map, 0);
+    }
+    if (dst_close) {
+        LZ4FRAMED_CLOSE(dst_fd);
+    }
+    if (src_close) {
+        LZ4FRAMED_CLOSE(src_fd);
+    }
+    LZ4F_freeCompressionContext(ctx);
+    _aligned_buffer_free(input_buffer);
+    _aligned_buffer_free(out.buffer);
+    return NULL;
+}
+
+/******************************************************************************/
+
+PyDoc_STRVAR(_lz4framed_decompress_file__doc__,
+"decompress_file(src, dst) -> int\n"
+"\n"
+"Decompresses a single lz4 frame from src, writing the uncompressed result to dst and\n"
+"returning the number of bytes written. Like compress_file(), the read/decompress/write\n"
+"loop runs natively with the GIL released. Any data in src following the frame is\n"
+"ignored, though might have been read already.\n"
+"\n"
+"Args:\n"
+"    src (str, bytes or int): Path or file descriptor to read lz4-framed data from\n"
+"    dst (str, bytes or int): Path or file descriptor to write uncompressed data to\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If src is empty\n"
+"    ValueError: If the frame is incomplete\n"
+"    IOError: If a read or write fails\n"
+"    Lz4FramedError: If a decompression failure occured");
+#define FUNC_DEF_DECOMPRESS_FILE {"decompress_file", (PyCFunction)_lz4framed_decompress_file,\
+                                  METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_file__doc__}
+static PyObject*
+_lz4framed_decompress_file(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "OO:decompress_file";
+    static char *keywords[] = {"src", "dst", NULL};
+
+    LZ4F_decompressionContext_t ctx = NULL;
+    PyObject *src, *dst;
+    int src_fd = -1, dst_fd = -1;
+    int src_close = 0, dst_close = 0;
+    char *input = NULL;
+    Py_ssize_t input_len = 0;
+    size_t input_pos;
+    size_t input_read;
+    size_t input_size_hint = 1;     // LZ4 hint to how many bytes make up the remaining block + next header
+    char *output = NULL;
+    // large enough for any block so that LZ4 can decompress directly into it
+    size_t output_max = MAX(FILE_IO_CHUNK_SIZE, 4 MB);
+    size_t output_written = 0;
+    unsigned long long total = 0;
+    int io_errno = 0;
+    int no_input = 1;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &src, &dst)) {
+        goto bail;
+    }
+    if (NULL == (input = _aligned_buffer_alloc(FILE_IO_CHUNK_SIZE)) ||
+        NULL == (output = _aligned_buffer_alloc(output_max))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    BAIL_ON_LZ4_ERROR(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION));
+    BAIL_ON_NONZERO((src_fd = _lz4framed_file_open(src, O_RDONLY, &src_close)) < 0);
+    BAIL_ON_NONZERO((dst_fd = _lz4framed_file_open(dst, O_WRONLY | O_CREAT | O_TRUNC, &dst_close)) < 0);
+
+    while (input_size_hint) {
+        Py_BEGIN_ALLOW_THREADS;
+        if ((input_len = _read_fully(src_fd, input, FILE_IO_CHUNK_SIZE)) < 0) {
+            io_errno = errno;
+        } else {
+            input_pos = 0;
+            // keep going whilst output is full, since lz4 might still have buffered output to flush
+            do {
+                input_read = input_len - input_pos;
+                output_written = output_max;
+                input_size_hint = LZ4F_decompress(ctx, output, &output_written, input + input_pos, &input_read,
+                                                  NULL);
+                if (LZ4F_isError(input_size_hint)) {
+                    break;
+                }
+                input_pos += input_read;
+                if (_write_fully(dst_fd, output, output_written)) {
+                    io_errno = errno;
+                    break;
+                }
+                total += output_written;
+            } while (input_size_hint && (input_pos < (size_t)input_len || output_written == output_max));
+        }
+        Py_END_ALLOW_THREADS;
+        BAIL_ON_FILE_IO_ERROR(io_errno);
+        BAIL_ON_LZ4_ERROR(input_size_hint);
+        BAIL_ON_NONZERO(PyErr_CheckSignals());
+
+        if (input_len) {
+            no_input = 0;
+        } else if (input_size_hint) {
+            if (no_input) {
+                PyErr_SetNone(LZ4FNoDataError);
+            } else {
+                PyErr_SetString(PyExc_ValueError, "frame incomplete");
+            }
+            goto bail;
+        }
+    }
+
+    if (dst_close && LZ4FRAMED_CLOSE(dst_fd)) {
+        dst_close = 0;
+        BAIL_ON_FILE_IO_ERROR(errno);
+    }
+    dst_close = 0;
+    if (src_close) {
+        LZ4FRAMED_CLOSE(src_fd);
+    }
+    LZ4F_freeDecompressionContext(ctx);
+    _aligned_buffer_free(input);
+    _aligned_buffer_free(output);
+
+    return PyLong_FromUnsignedLongLong(total);
+
+bail:
+    if (dst_close) {
+        LZ4FRAMED_CLOSE(dst_fd);
+    }
+    if (src_close) {
+        LZ4FRAMED_CLOSE(src_fd);
+    }
+    LZ4F_freeDecompressionContext(ctx);
+    _aligned_buffer_free(input);
+    _aligned_buffer_free(output);
+    return NULL;
+}
+
+/******************************************************************************/
+
+// Size of frame header at start of src if enough of it is available to tell, minimum size otherwise. (No GIL)
+static size_t _frame_header_size(const char *src, size_t len) {
+    if (len >= 4 && (_read_le32(src) & LZ4F_MAGIC_SKIPPABLE_MASK) == LZ4F_MAGIC_SKIPPABLE_START) {
+        return LZ4F_SKIPPABLE_HEADER_SIZE;
+    }
+    return (len >= 5 && (src[4] & 0x08)) ? LZ4F_HEADER_SIZE_MAX : LZ4F_HEADER_SIZE_MIN;
+}
+
+/* Determines the uncompressed size of an lz4 block by walking its sequences without copying any data. Fails if the
+ * block is malformed, would decode to more than max_len bytes or refers back further than the (up to) history bytes
+ * preceding it. Returns size or SIZE_UNKNOWN on failure. (No GIL)
+ */
+static size_t _block_decoded_size(const char *src, size_t len, size_t max_len, size_t history) {
+    const unsigned char *in = (const unsigned char*)src;
+    const unsigned char *end = in + len;
+    size_t size = 0;
+    size_t length;
+    unsigned token, byte, offset;
+
+    while (in < end) {
+        token = *in++;
+        // literals
+        if ((length = token >> 4) == 15) {
+            do {
+                if (in >= end) {
+                    return SIZE_UNKNOWN;
+                }
+                length += (byte = *in++);
+            } while (255 == byte);
+        }
+        if ((size_t)(end - in) < length || max_len - size < length) {
+            return SIZE_UNKNOWN;
+        }
+        in += length;
+        size += length;
+        // last sequence consists of literals only
+        if (in == end) {
+            return size;
+        }
+        // match
+        if (end - in < 2) {
+            return SIZE_UNKNOWN;
+        }
+        offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (!offset || offset > size + history) {
+            return SIZE_UNKNOWN;
+        }
+        if ((length = token & 15) == 15) {
+            do {
+                if (in >= end) {
+                    return SIZE_UNKNOWN;
+                }
+                length += (byte = *in++);
+            } while (255 == byte);
+        }
+        length += LZ4_MIN_MATCH;
+        if (max_len - size < length) {
+            return SIZE_UNKNOWN;
+        }
+        size += length;
+    }
+    return SIZE_UNKNOWN;
+}
+
+typedef struct {
+    unsigned long long offset;              // of block data (i.e. following block size word)
+    size_t size;                            // of block data (excluding any block checksum)
+    unsigned long long uncompressed_offset; // relative to start of uncompressed data of all frames
+    size_t uncompressed_size;               // SIZE_UNKNOWN if not determined
+    int stored;                             // whether block data is uncompressed
+} _scan_block_t;
+
+typedef struct {
+    _frame_header_t header;
+    unsigned long long offset;
+    unsigned long long size;                // including header & trailer
+    unsigned long long uncompressed_offset;
+    unsigned long long uncompressed_len;
+    unsigned long long end_mark;            // offset of end mark (zero block size word)
+    size_t block_start;                     // index of first block (in _scan_t.blocks)
+    size_t block_count;
+} _scan_frame_t;
+
+typedef struct {
+    _scan_frame_t *frames;
+    size_t frame_count;
+    size_t frame_capacity;
+    _scan_block_t *blocks;
+    size_t block_count;
+    size_t block_capacity;
+    int decoded_sizes;                      // whether to determine uncompressed size of compressed blocks
+    size_t error;                           // LZ4F error code on failure (unless out of memory)
+    unsigned long long error_offset;        // input offset error relates to
+} _scan_t;
+#define SCAN_INIT {NULL, 0, 0, NULL, 0, 0, 1, 0, 0}
+
+// Ensures there is space for one more item in array. Returns non-zero (with errno set) on failure. (No GIL)
+static int _scan_reserve(void **items, size_t *capacity, size_t count, size_t item_size) {
+    size_t new_capacity;
+    void *new_items;
+
+    if (count < *capacity) {
+        return 0;
+    }
+    new_capacity = *capacity ? *capacity * 2 : 64;
+    if (new_capacity > ((size_t)-1) / item_size || NULL == (new_items = realloc(*items, new_capacity * item_size))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    *items = new_items;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static void _scan_free(_scan_t *scan) {
+    free(scan->frames);
+    free(scan->blocks);
+    scan->frames = NULL;
+    scan->blocks = NULL;
+}
+
+#define SCAN_FAIL(code, offset) {\
+    scan->error = LZ4F_ERROR_CODE(code);\
+    scan->error_offset = (offset);\
+    return -1;\
+}
+
+/* Records all frames & blocks in data (len bytes) without decompressing any of the blocks. Returns non-zero on failure,
+ * with either scan->error & error_offset or errno (ENOMEM) set. (No GIL)
+ */
+static int _scan(const char *data, size_t len, _scan_t *scan) {
+    _scan_frame_t *frame;
+    _scan_block_t *block;
+    size_t pos = 0;
+    size_t result;
+    size_t history;
+    size_t data_len;
+    unsigned long word;
+    unsigned long long uncompressed_total = 0;
+
+    while (pos < len) {
+        if (_scan_reserve((void**)&scan->frames, &scan->frame_capacity, scan->frame_count, sizeof(*frame))) {
+            return -1;
+        }
+        frame = &scan->frames[scan->frame_count++];
+        frame->offset = pos;
+        frame->uncompressed_offset = uncompressed_total;
+        frame->uncompressed_len = 0;
+        frame->end_mark = 0;
+        frame->block_start = scan->block_count;
+        frame->block_count = 0;
+        if (LZ4F_isError(result = _frame_header_decode(data + pos, len - pos, &frame->header))) {
+            scan->error = result;
+            scan->error_offset = pos;
+            return -1;
+        }
+        pos += result;
+
+        if (frame->header.skippable) {
+            if (len - pos < frame->header.content_size) {
+                SCAN_FAIL(frameSize_wrong, frame->offset);
+            }
+            pos += (size_t)frame->header.content_size;
+            frame->size = pos - frame->offset;
+            continue;
+        }
+
+        history = 0;
+        while (1) {
+            if (len - pos < 4) {
+                SCAN_FAIL(frameSize_wrong, pos);
+            }
+            if (!(word = _read_le32(data + pos))) {
+                frame->end_mark = pos;
+                pos += 4;
+                break;
+            }
+            data_len = word & ~BLOCK_UNCOMPRESSED_FLAG;
+            if (data_len > frame->header.block_size) {
+                SCAN_FAIL(decompressionFailed, pos);
+            }
+            if (len - pos - 4 < data_len + (frame->header.block_checksum ? 4 : 0)) {
+                SCAN_FAIL(frameSize_wrong, pos);
+            }
+            if (_scan_reserve((void**)&scan->blocks, &scan->block_capacity, scan->block_count, sizeof(*block))) {
+                return -1;
+            }
+            block = &scan->blocks[scan->block_count++];
+            frame->block_count++;
+            pos += 4;
+            block->offset = pos;
+            block->size = data_len;
+            block->uncompressed_offset = uncompressed_total;
+            if ((block->stored = (word & BLOCK_UNCOMPRESSED_FLAG) != 0)) {
+                block->uncompressed_size = data_len;
+            } else if (scan->decoded_sizes) {
+                if (SIZE_UNKNOWN == (block->uncompressed_size = _block_decoded_size(data + pos, data_len,
+                                                                                    frame->header.block_size,
+                                                                                    history))) {
+                    SCAN_FAIL(decompressionFailed, pos - 4);
+                }
+            } else {
+                block->uncompressed_size = SIZE_UNKNOWN;
+            }
+            if (block->uncompressed_size != SIZE_UNKNOWN) {
+                uncompressed_total += block->uncompressed_size;
+                frame->uncompressed_len += block->uncompressed_size;
+                if (frame->header.block_mode_linked) {
+                    history = MIN(LZ4_HISTORY_SIZE, history + block->uncompressed_size);
+                }
+            }
+            pos += data_len + (frame->header.block_checksum ? 4 : 0);
+        }
+        if (frame->header.content_checksum) {
+            if (len - pos < 4) {
+                SCAN_FAIL(frameSize_wrong, pos);
+            }
+            pos += 4;
+        }
+        if (scan->decoded_sizes && frame->header.has_content_size &&
+            frame->header.content_size != frame->uncompressed_len) {
+            SCAN_FAIL(frameSize_wrong, frame->offset);
+        }
+        frame->size = pos - frame->offset;
+    }
+    return 0;
+}
+
+// Raises LZ4FError for the given LZ4F error code, with the input offset it relates to as additional argument
+static void _lz4framed_set_lz4_error_at(size_t err, unsigned long long offset) {
+    PyObject *tuple;
+
+    if ((tuple = Py_BuildValue("(snK)", LZ4F_getErrorName(err), (Py_ssize_t)-(int)err, offset))) {
+        PyErr_SetObject(LZ4FError, tuple);
+        Py_DECREF(tuple);
+    }
+}
+
+/* Reads remainder of fd into a newly allocated buffer (to be freed by caller), for when it cannot be memory-mapped.
+ * Returns non-zero (with errno set) on failure. (No GIL)
+ */
+static int _read_all(int fd, char **buffer, size_t *len) {
+    size_t capacity = FILE_IO_CHUNK_SIZE;
+    Py_ssize_t count;
+    char *new_buffer;
+
+    *len = 0;
+    if (NULL == (*buffer = malloc(capacity))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    while ((count = _read_fully(fd, *buffer + *len, capacity - *len)) > 0) {
+        if ((*len += count) == capacity) {
+            if (NULL == (new_buffer = realloc(*buffer, capacity *= 2))) {
+                errno = ENOMEM;
+                return -1;
+            }
+            *buffer = new_buffer;
+        }
+    }
+    return count < 0 ? -1 : 0;
+}
+
+/* Resolves source argument of scan_frames() & verify(): bytes-like objects are acquired as buffer (i.e. with
+ * buffer->obj set) and otherwise a file descriptor is returned, given either directly or via fileno(). Returns -1 (with
+ * exception set) on failure.
+ */
+static int _lz4framed_source(PyObject *source, Py_buffer *buffer) {
+    PyObject *fileno = NULL;
+    int fd;
+    int close_fd;
+
+    if (PyObject_CheckBuffer(source)) {
+        return PyObject_GetBuffer(source, buffer, PyBUF_SIMPLE) ? -1 : 0;
+    }
+    if (!PyLong_Check(source)
+#if PY_MAJOR_VERSION < 3
+        && !PyInt_Check(source)
+#endif
+        ) {
+        if (!PyObject_HasAttrString(source, "fileno")) {
+            PyErr_SetString(PyExc_TypeError, "source must be bytes-like object, file descriptor or file object");
+            return -1;
+        }
+        if (NULL == (source = fileno = PyObject_CallMethod(source, "fileno", NULL))) {
+            return -1;
+        }
+    }
+    // only opens paths, which have been excluded above
+    fd = _lz4framed_file_open(source, O_RDONLY, &close_fd);
+    Py_XDECREF(fileno);
+    return fd;
+}
+
+// Returns new reference to value or None if not known
+static PyObject* _size_or_none(unsigned long long value, int known) {
+    if (known) {
+        return PyLong_FromUnsignedLongLong(value);
+    }
+    Py_RETURN_NONE;
+}
+
+// Converts scan results to a list of frame dicts (see scan_frames())
+static PyObject* _scan_to_list(_scan_t *scan) {
+    PyObject *list = NULL;
+    PyObject *blocks = NULL;
+    PyObject *item = NULL;
+    _scan_frame_t *frame;
+    _scan_block_t *block;
+    size_t i, j;
+    int offsets_known;
+
+    BAIL_ON_NULL(list = PyList_New(0));
+    for (i = 0; i < scan->frame_count; i++) {
+        frame = &scan->frames[i];
+        if (frame->header.skippable) {
+            BAIL_ON_NULL(item = Py_BuildValue("{s:K,s:K,s:O,s:k,s:n,s:K}", "offset", frame->offset, "size",
+                                              frame->size, "skippable", Py_True, "magic", frame->header.magic,
+                                              "header_size", (Py_ssize_t)frame->header.header_size, "length",
+                                              frame->header.content_size));
+        } else {
+            offsets_known = scan->decoded_sizes;
+            BAIL_ON_NULL(blocks = PyList_New(frame->block_count));
+            for (j = 0; j < frame->block_count; j++) {
+                block = &scan->blocks[frame->block_start + j];
+                // offsets of uncompressed data are only known for blocks preceded by ones with known sizes
+                PyList_SET_ITEM(blocks, j, Py_BuildValue("(KnNNO)", block->offset, (Py_ssize_t)block->size,
+                                                         _size_or_none(block->uncompressed_offset, offsets_known),
+                                                         _size_or_none(block->uncompressed_size,
+                                                                       block->uncompressed_size != SIZE_UNKNOWN),
+                                                         block->stored ? Py_True : Py_False));
+                BAIL_ON_NULL(PyList_GET_ITEM(blocks, j));
+            }
+            BAIL_ON_NULL(item = Py_BuildValue("{s:K,s:K,s:O,s:n,s:i,s:O,s:O,s:O,s:K,s:N,s:N,s:N,s:K,s:N}",
+                                              "offset", frame->offset, "size", frame->size, "skippable", Py_False,
+                                              "header_size", (Py_ssize_t)frame->header.header_size,
+                                              "block_size_id", frame->header.block_size_id,
+                                              "block_mode_linked", frame->header.block_mode_linked ? Py_True : Py_False,
+                                              "block_checksum", frame->header.block_checksum ? Py_True : Py_False,
+                                              "checksum", frame->header.content_checksum ? Py_True : Py_False,
+                                              "length", frame->header.content_size,
+                                              "uncompressed_offset", _size_or_none(frame->uncompressed_offset,
+                                                                                   offsets_known),
+                                              "uncompressed_length", _size_or_none(frame->uncompressed_len,
+                                                                                   offsets_known),
+                                              "blocks", blocks,
+                                              "end_mark", frame->end_mark,
+                                              "checksum_offset", _size_or_none(frame->end_mark + 4,
+                                                                               frame->header.content_checksum)));
+            // reference stolen by item
+            blocks = NULL;
+        }
+        BAIL_ON_NONZERO(PyList_Append(list, item));
+        Py_CLEAR(item);
+    }
+    return list;
+
+bail:
+    Py_XDECREF(item);
+    Py_XDECREF(blocks);
+    Py_XDECREF(list);
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_scan_frames__doc__,
+"scan_frames(source, decoded_sizes=True) -> list\n"
+"\n"
+"Lists the structure of all (back-to-back) lz4 and skippable frames in source without\n"
+"decompressing any data, returning a dict per frame. All offsets are relative to the\n"
+"start of source (or, for files, the position at which scanning started). Runs natively\n"
+"with the GIL released. Skippable frames have the following keys:\n"
+"    offset (int)              - Start of frame\n"
+"    size (int)                - Total size of frame\n"
+"    skippable (bool)          - True\n"
+"    magic (int)               - Magic number (0x184D2A50 to 0x184D2A5F)\n"
+"    header_size (int)         - Size of header (which is followed by data)\n"
+"    length (int)              - Size of data\n"
+"lz4 frames have the following keys (in addition to offset, size & header_size):\n"
+"    skippable (bool)          - False\n"
+"    block_size_id (int)       - One of LZ4F_BLOCKSIZE_* constants\n"
+"    block_mode_linked (bool)  - Whether blocks in frame are linked\n"
+"    block_checksum (bool)     - Whether each block is followed by a 4-byte checksum\n"
+"    checksum (bool)           - Whether the frame has a content checksum\n"
+"    length (int)              - Uncompressed length as stated in header (or zero)\n"
+"    uncompressed_offset (int) - Offset of frame's data within uncompressed data of all\n"
+"                                frames (or None if not known)\n"
+"    uncompressed_length (int) - Uncompressed length of frame's data (or None if not known)\n"
+"    blocks (list)             - (offset, size, uncompressed_offset, uncompressed_size,\n"
+"                                stored) tuple for each block, where offset & size refer to\n"
+"                                the block data (following its size word), stored indicates\n"
+"                                that the data is not compressed and the uncompressed values\n"
+"                                are None if not known\n"
+"    end_mark (int)            - Offset of end mark (zero block size word)\n"
+"    checksum_offset (int)     - Offset of content checksum (or None if not present)\n"
+"\n"
+"Args:\n"
+"    source: bytes-like object or file descriptor (int) or file object (with fileno()),\n"
+"            which will be read from its current (descriptor) position to the end. Files\n"
+"            are memory-mapped where possible.\n"
+"    decoded_sizes (bool): Whether to determine the uncompressed size of compressed blocks\n"
+"                          by walking their lz4 sequences (which also validates these).\n"
+"                          If not set, only headers & block size words are read and the\n"
+"                          uncompressed offsets & sizes of compressed blocks are None.\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If source is empty\n"
+"    IOError: If a read fails\n"
+"    Lz4FramedError: If the data is not made up of valid & complete frames, with the\n"
+"                    input offset the problem relates to as third argument");
+#define FUNC_DEF_SCAN_FRAMES {"scan_frames", (PyCFunction)_lz4framed_scan_frames, METH_VARARGS | METH_KEYWORDS,\
+                              _lz4framed_scan_frames__doc__}
+static PyObject*
+_lz4framed_scan_frames(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "O|i:scan_frames";
+    static char *keywords[] = {"source", "decoded_sizes", NULL};
+
+    PyObject *source;
+    Py_buffer buffer = {NULL, NULL};
+    int fd = -1;
+    _file_map_t map = FILE_MAP_INIT;
+    char *file_data = NULL;     // if not memory-mapped
+    const char *data = NULL;
+    size_t len = 0;
+    _scan_t scan = SCAN_INIT;
+    PyObject *list = NULL;
+    int failed = 0;
+    int io_errno = 0;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &source, &scan.decoded_sizes)) {
+        goto bail;
+    }
+    BAIL_ON_NONZERO((fd = _lz4framed_source(source, &buffer)) < 0);
+    if (buffer.obj) {
+        data = buffer.buf;
+        len = buffer.len;
+    } else {
+        Py_BEGIN_ALLOW_THREADS;
+        if (!_file_map_src(fd, &map)) {
+            data = map.data;
+            len = map.data_len;
+        } else if (_read_all(fd, &file_data, &len)) {
+            io_errno = errno;
+        } else {
+            data = file_data;
+        }
+        Py_END_ALLOW_THREADS;
+        if (ENOMEM == io_errno) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+        BAIL_ON_FILE_IO_ERROR(io_errno);
+    }
+    if (!len) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    failed = _scan(data, len, &scan);
+    Py_END_ALLOW_THREADS;
+    if (failed) {
+        if (scan.error) {
+            _lz4framed_set_lz4_error_at(scan.error, scan.error_offset);
+        } else {
+            PyErr_NoMemory();
+        }
+        goto bail;
+    }
+    list = _scan_to_list(&scan);
+
+bail:
+    _scan_free(&scan);
+    if (map.addr) {
+        // leaves descriptor at end of data, in line with non-mapped reads
+        _file_unmap(fd, &map, map.data_len);
+    }
+    free(file_data);
+    if (buffer.obj) {
+        PyBuffer_Release(&buffer);
+    }
+    return list;
+}
+
+/******************************************************************************/
+
+PyDoc_STRVAR(_lz4framed_verify__doc__,
+"verify(source) -> int\n"
+"\n"
+"Validates all (back-to-back) lz4 and skippable frames in source by decompressing them\n"
+"into a small re-used buffer, i.e. without producing any output, and returns the total\n"
+"uncompressed length. Content checksums and stated content lengths are checked where\n"
+"present. Memory use does not depend on the size of source (lz4 retains 64 KB of history\n"
+"plus one block) and decompression runs natively with the GIL released.\n"
+"\n"
+"Args:\n"
+"    source: bytes-like object or file descriptor (int) or file object (with fileno()),\n"
+"            which will be read from its current (descriptor) position to the end\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If source is empty\n"
+"    IOError: If a read fails\n"
+"    Lz4FramedError: If a frame is invalid, corrupt or incomplete (LZ4F_ERROR_frameSize_wrong),\n"
+"                    with the offset of the input being decoded at the time (relative to\n"
+"                    where reading started) as third argument");
+#define FUNC_DEF_VERIFY {"verify", (PyCFunction)_lz4framed_verify, METH_VARARGS | METH_KEYWORDS,\
+                         _lz4framed_verify__doc__}
+static PyObject*
+_lz4framed_verify(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "O:verify";
+    static char *keywords[] = {"source", NULL};
+
+    LZ4F_decompressionContext_t ctx = NULL;
+    LZ4F_frameInfo_t info;
+    PyObject *source;
+    Py_buffer buffer = {NULL, NULL};
+    int fd = -1;
+    char *input_buffer = NULL;
+    const char *input = NULL;
+    Py_ssize_t input_len = 0;
+    size_t input_pos;
+    size_t input_read;
+    size_t input_size_hint = 0;     // LZ4 hint to how many bytes make up the remaining block + next header
+    unsigned long long offset = 0;  // of input chunk
+    size_t error_pos = 0;           // within input chunk, of failed decompression call
+    char *output = NULL;
+    char *new_output;
+    size_t output_len = 64 KB;      // increased to block size of frame, so that lz4 can decompress directly into it
+    size_t output_written = 0;
+    size_t block_size;
+    size_t info_read;
+    int need_info = 1;              // whether output_len has yet to be checked against block size of frame
+    unsigned long long total = 0;
+    int io_errno = 0;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &source)) {
+        goto bail;
+    }
+    BAIL_ON_NONZERO((fd = _lz4framed_source(source, &buffer)) < 0);
+    if ((!buffer.obj && NULL == (input_buffer = _aligned_buffer_alloc(FILE_IO_CHUNK_SIZE))) ||
+        NULL == (output = malloc(output_len))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    BAIL_ON_LZ4_ERROR(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION));
+
+    do {
+        // one chunk per GIL release so that signals are not ignored for large inputs
+        Py_BEGIN_ALLOW_THREADS;
+        if (buffer.obj) {
+            input = (const char*)buffer.buf + offset;
+            input_len = MIN(FILE_IO_CHUNK_SIZE, (size_t)(buffer.len - offset));
+        } else if ((input_len = _read_fully(fd, input_buffer, FILE_IO_CHUNK_SIZE)) < 0) {
+            io_errno = errno;
+        } else {
+            input = input_buffer;
+        }
+        input_pos = 0;
+        // keep going whilst output is full (and frame incomplete), since lz4 might still have buffered output to flush
+        while (!io_errno && input_len > 0 &&
+               (input_pos < (size_t)input_len || (output_written == output_len && input_size_hint))) {
+            // only what lz4 hints at (i.e. one header or block at a time), so that failures can be attributed to the
+            // right part of the input
+            input_read = MIN(input_size_hint ? input_size_hint : _frame_header_size(input + input_pos,
+                                                                                     input_len - input_pos),
+                             input_len - input_pos);
+            output_written = output_len;
+            error_pos = input_pos;
+            input_size_hint = LZ4F_decompress(ctx, output, &output_written, input + input_pos, &input_read, NULL);
+            if (LZ4F_isError(input_size_hint)) {
+                break;
+            }
+            input_pos += input_read;
+            total += output_written;
+            if (!input_size_hint) {
+                // frame complete, next one might have different block size
+                need_info = 1;
+            } else if (need_info) {
+                info_read = 0;
+                if (!LZ4F_isError(LZ4F_getFrameInfo(ctx, &info, NULL, &info_read))) {
+                    need_info = 0;
+                    block_size = _lz4f_block_size_from_id(info.blockSizeID);
+                    if (block_size > output_len) {
+                        if (NULL == (new_output = realloc(output, block_size))) {
+                            io_errno = ENOMEM;
+                            break;
+                        }
+                        output = new_output;
+                        output_len = block_size;
+                        // signal that the (unchanged) output should not be regarded as full
+                        output_written = 0;
+                    }
+                }
+            }
+        }
+        Py_END_ALLOW_THREADS;
+        if (ENOMEM == io_errno) {
+            PyErr_NoMemory();
+            goto bail;
+        }
+        BAIL_ON_FILE_IO_ERROR(io_errno);
+        if (LZ4F_isError(input_size_hint)) {
+            _lz4framed_set_lz4_error_at(input_size_hint, offset + error_pos);
+            goto bail;
+        }
+        BAIL_ON_NONZERO(PyErr_CheckSignals());
+        offset += input_len;
+    } while (input_len > 0);
+
+    if (!offset) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    if (input_size_hint) {
+        _lz4framed_set_lz4_error_at(LZ4F_ERROR_CODE(frameSize_wrong), offset);
+        goto bail;
+    }
+
+    LZ4F_freeDecompressionContext(ctx);
+    _aligned_buffer_free(input_buffer);
+    free(output);
+    if (buffer.obj) {
+        PyBuffer_Release(&buffer);
+    }
+    return PyLong_FromUnsignedLongLong(total);
+
+bail:
+    LZ4F_freeDecompressionContext(ctx);
+    _aligned_buffer_free(input_buffer);
+    free(output);
+    if (buffer.obj) {
+        PyBuffer_Release(&buffer);
+    }
+    return NULL;
+}
+
+/******************************************************************************/
+
+// Decompresses a raw block, with dict (if its buf is set). Returns decompressed size or negative on failure. (No GIL)
+static int _decompress_block(const Py_buffer *input, char *dst, int dst_len, const Py_buffer *dict) {
+    const char *dict_buf = dict->buf;
+    Py_ssize_t dict_len = dict->len;
+
+    if (dict_buf && dict_len) {
+        // (64 KB is the most lz4 can reference, as with compress_block())
+        if (dict_len > 64 KB) {
+            dict_buf += dict_len - 64 KB;
+            dict_len = 64 KB;
+        }
+        return LZ4_decompress_safe_usingDict(input->buf, dst, (int)input->len, dst_len, dict_buf, (int)dict_len);
+    }
+    return LZ4_decompress_safe(input->buf, dst, (int)input->len, dst_len);
+}
+
+PyDoc_STRVAR(_lz4framed_compress_block__doc__,
+"compress_block(b, level=0, dictionary=None) -> bytes\n"
+"\n"
+"Compresses b as a single raw lz4 block, i.e. without any frame header, size word or\n"
+"checksum, so the uncompressed size must be known separately for decompression (see\n"
+"decompress_block()). Useful for many small values, where frame overhead would be\n"
+"significant, especially with a dictionary.\n"
+"\n"
+"Args:\n"
+"    b (bytes): Data to compress\n"
+"    level (int): Compression level, see compress()\n"
+"    dictionary (bytes): Data similar to b (only the last 64 KB are used) to reference\n"
+"                        during compression. The same dictionary must be supplied to\n"
+"                        decompress_block().\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If b is empty\n"
+"    ValueError: If level is invalid or b too large for a single block");
+#define FUNC_DEF_COMPRESS_BLOCK {"compress_block", (PyCFunction)_lz4framed_compress_block,\
+                                 METH_VARARGS | METH_KEYWORDS, _lz4framed_compress_block__doc__}
+static PyObject*
+_lz4framed_compress_block(PyObject *self, PyObject *args, PyObject *kwargs) {
+#if PY_MAJOR_VERSION >= 3
+    static const char *format = "y*|iz*:compress_block";
+#else
+    static const char *format = "s*|iz*:compress_block";
+#endif
+    static char *keywords[] = {"b", "level", "dictionary", NULL};
+
+    Py_buffer input = {NULL, NULL};
+    Py_buffer dict = {NULL, NULL};
+    int compression_level = LZ4_COMPRESSION_MIN;
+    PyObject *output = NULL;
+    int output_len;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input, &compression_level, &dict)) {
+        goto bail;
+    }
+    if (input.len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    if (compression_level < LZ4_COMPRESSION_FASTEST || compression_level > LZ4_COMPRESSION_MAX) {
+        PyErr_Format(PyExc_ValueError, "level (%d) invalid", compression_level);
+        goto bail;
+    }
+    if (input.len > LZ4_MAX_INPUT_SIZE) {
+        PyErr_Format(PyExc_ValueError, "input too large (%zd)", input.len);
+        goto bail;
+    }
+    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, LZ4_compressBound((int)input.len)));
+
+    // (64 KB is the most lz4 can reference)
+    if (dict.buf && dict.len > 64 KB) {
+        dict.buf = (char*)dict.buf + (dict.len - 64 KB);
+        dict.len = 64 KB;
+    }
+    if (input.len < NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD) {
+        output_len = _compress_block(input.buf, (int)input.len, PyBytes_AS_STRING(output),
+                                     (int)PyBytes_GET_SIZE(output), compression_level, dict.buf,
+                                     dict.buf ? (int)dict.len : 0);
+    } else {
+        Py_BEGIN_ALLOW_THREADS;
+        output_len = _compress_block(input.buf, (int)input.len, PyBytes_AS_STRING(output),
+                                     (int)PyBytes_GET_SIZE(output), compression_level, dict.buf,
+                                     dict.buf ? (int)dict.len : 0);
+        Py_END_ALLOW_THREADS;
+    }
+    if (output_len <= 0) {
+        // cannot fail to fit within bound
+        PyErr_NoMemory();
+        goto bail;
+    }
+    BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    PyBuffer_Release(&input);
+    if (dict.obj) {
+        PyBuffer_Release(&dict);
+    }
+    return output;
+
+bail:
+    Py_XDECREF(output);
+    if (input.obj) {
+        PyBuffer_Release(&input);
+    }
+    if (dict.obj) {
+        PyBuffer_Release(&dict);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_decompress_block__doc__,
+"decompress_block(b, max_size, dictionary=None) -> bytes\n"
+"\n"
+"Decompresses a single raw lz4 block, e.g. from compress_block() or the data of an\n"
+"(independent) block of a frame as located via scan_frames(), i.e. without its size word\n"
+"or checksum. Blocks of frames with linked blocks can only be decoded this way if they are\n"
+"the first block of their frame. Decompression runs with the GIL released (for larger\n"
+"blocks), so that many threads can decode blocks concurrently.\n"
+"\n"
+"Args:\n"
+"    b (bytes): Compressed block data\n"
+"    max_size (int): Upper limit of uncompressed size, e.g. uncompressed_size of block\n"
+"                    from scan_frames() or get_block_size() of its frame's block size id\n"
+"    dictionary (bytes): Dictionary the block was compressed with (if any)\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If b is empty\n"
+"    ValueError: If max_size is not positive or larger than allowed by lz4\n"
+"    Lz4FramedError: If the block is corrupt or decompresses to more than max_size bytes\n"
+"                    (LZ4F_ERROR_decompressionFailed)");
+#define FUNC_DEF_DECOMPRESS_BLOCK {"decompress_block", (PyCFunction)_lz4framed_decompress_block,\
+                                   METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_block__doc__}
+static PyObject*
+_lz4framed_decompress_block(PyObject *self, PyObject *args, PyObject *kwargs) {
+#if PY_MAJOR_VERSION >= 3
+    static const char *format = "y*n|z*:decompress_block";
+#else
+    static const char *format = "s*n|z*:decompress_block";
+#endif
+    static char *keywords[] = {"b", "max_size", "dictionary", NULL};
+
+    Py_buffer input = {NULL, NULL};
+    Py_buffer dict = {NULL, NULL};
+    Py_ssize_t max_size;
+    PyObject *output = NULL;
+    int output_len;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input, &max_size, &dict)) {
+        goto bail;
+    }
+    if (input.len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    if (max_size <= 0 || max_size > LZ4_MAX_INPUT_SIZE || input.len > INT_MAX) {
+        PyErr_Format(PyExc_ValueError, "max_size (%zd) invalid", max_size);
+        goto bail;
+    }
+    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, max_size));
+
+    if (input.len < NOGIL_DECOMPRESS_INPUT_SIZE_THRESHOLD) {
+        output_len = _decompress_block(&input, PyBytes_AS_STRING(output), (int)max_size, &dict);
+    } else {
+        Py_BEGIN_ALLOW_THREADS;
+        output_len = _decompress_block(&input, PyBytes_AS_STRING(output), (int)max_size, &dict);
+        Py_END_ALLOW_THREADS;
+    }
+    if (output_len < 0) {
+        _lz4framed_set_lz4_error(LZ4F_ERROR_CODE(decompressionFailed));
+        goto bail;
+    }
+    if (output_len < max_size) {
+        BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    }
+    PyBuffer_Release(&input);
+    if (dict.obj) {
+        PyBuffer_Release(&dict);
+    }
+    return output;
+
+bail:
+    Py_XDECREF(output);
+    if (input.obj) {
+        PyBuffer_Release(&input);
+    }
+    if (dict.obj) {
+        PyBuffer_Release(&dict);
+    }
+    return NULL;
+}
+
+/* Compresses as much of src as fits into dst_len bytes (fast mode only, as lz4 provides no destSize variant for HC),
+ * returning compressed size & setting *consumed. (No GIL)
+ */
+static int _compress_dest_size(const char *src, int src_len, char *dst, int dst_len, int *consumed) {
+    *consumed = src_len;
+    return LZ4_compress_destSize(src, dst, consumed, dst_len);
+}
+
+PyDoc_STRVAR(_lz4framed_compress_block_dest_size__doc__,
+"compress_block_dest_size(b, dest_size) -> tuple\n"
+"\n"
+"Compresses as much of (the start of) b as possible into a single raw lz4 block (see\n"
+"compress_block()) of at most dest_size bytes, returning a (block, consumed) tuple where\n"
+"consumed is the number of input bytes the block decompresses to. Always uses the fastest\n"
+"(default) compression level.\n"
+"\n"
+"Args:\n"
+"    b (bytes): Data to compress\n"
+"    dest_size (int): Most bytes the block may occupy\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If b is empty\n"
+"    ValueError: If dest_size is too small to hold any input or larger than allowed by lz4");
+#define FUNC_DEF_COMPRESS_BLOCK_DEST_SIZE {"compress_block_dest_size",\
+                                           (PyCFunction)_lz4framed_compress_block_dest_size,\
+                                           METH_VARARGS | METH_KEYWORDS, _lz4framed_compress_block_dest_size__doc__}
+static PyObject*
+_lz4framed_compress_block_dest_size(PyObject *self, PyObject *args, PyObject *kwargs) {
+#if PY_MAJOR_VERSION >= 3
+    static const char *format = "y*n:compress_block_dest_size";
+#else
+    static const char *format = "s*n:compress_block_dest_size";
+#endif
+    static char *keywords[] = {"b", "dest_size", NULL};
+
+    Py_buffer input = {NULL, NULL};
+    Py_ssize_t dest_size;
+    PyObject *output = NULL;
+    PyObject *result;
+    int input_len;
+    int output_len;
+    int consumed;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input, &dest_size)) {
+        goto bail;
+    }
+    if (input.len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    if (dest_size <= 0 || dest_size > LZ4_compressBound(LZ4_MAX_INPUT_SIZE)) {
+        PyErr_Format(PyExc_ValueError, "dest_size (%zd) invalid", dest_size);
+        goto bail;
+    }
+    // remainder (if any) is left for subsequent calls
+    input_len = (int)(MIN(input.len, LZ4_MAX_INPUT_SIZE));
+    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, dest_size));
+
+    if (input_len < NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD) {
+        output_len = _compress_dest_size(input.buf, input_len, PyBytes_AS_STRING(output), (int)dest_size, &consumed);
+    } else {
+        Py_BEGIN_ALLOW_THREADS;
+        output_len = _compress_dest_size(input.buf, input_len, PyBytes_AS_STRING(output), (int)dest_size, &consumed);
+        Py_END_ALLOW_THREADS;
+    }
+    if (output_len <= 0 || consumed <= 0) {
+        PyErr_Format(PyExc_ValueError, "dest_size (%zd) too small", dest_size);
+        goto bail;
+    }
+    BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    PyBuffer_Release(&input);
+    result = Py_BuildValue("(Ni)", output, consumed);
+    return result;
+
+bail:
+    Py_XDECREF(output);
+    if (input.obj) {
+        PyBuffer_Release(&input);
+    }
+    return NULL;
+}
+
+// Frame header (magic, FLG, BD & HC), end mark & content checksum
+#define DEST_SIZE_FRAME_OVERHEAD(checksum) (7 + 4 + 4 + ((checksum) ? 4 : 0))
+
+/* Writes a frame of independent blocks without content size, consisting of one block holding as much of src as fits
+ * into dst_len bytes (at least DEST_SIZE_FRAME_OVERHEAD + 1). The block is stored as-is if that consumes at least as
+ * much input. Returns frame length & sets *consumed. (No GIL)
+ */
+static size_t _compress_frame_dest_size(const char *src, int src_len, char *dst, int dst_len, int block_id,
+                                        int checksum, int *consumed) {
+    int budget = dst_len - DEST_SIZE_FRAME_OVERHEAD(checksum);
+    int raw_len;
+    int output_len;
+    char *pos = dst;
+
+    if (block_id == LZ4F_default) {
+        block_id = LZ4F_max64KB;
+    }
+    src_len = (int)(MIN((size_t)src_len, _lz4f_block_size_from_id(block_id)));
+    raw_len = MIN(src_len, budget);
+
+    _write_le32(pos, LZ4F_MAGIC_NUMBER);
+    // version 01, independent blocks, optional content checksum
+    pos[4] = (char)(0x60 | (checksum ? 0x04 : 0));
+    pos[5] = (char)(block_id << 4);
+    pos[6] = (char)((XXH32(pos + 4, 2, 0) >> 8) & 0xFF);
+    pos += 7;
+
+    output_len = _compress_dest_size(src, src_len, pos + 4, budget, consumed);
+    if (*consumed < raw_len || output_len <= 0 || output_len >= *consumed) {
+        *consumed = raw_len;
+        _write_le32(pos, (unsigned long)raw_len | BLOCK_UNCOMPRESSED_FLAG);
+        memcpy(pos + 4, src, raw_len);
+        pos += 4 + raw_len;
+    } else {
+        _write_le32(pos, (unsigned long)output_len);
+        pos += 4 + output_len;
+    }
+    _write_le32(pos, 0);
+    pos += 4;
+    if (checksum) {
+        _write_le32(pos, XXH32(src, *consumed, 0));
+        pos += 4;
+    }
+    return pos - dst;
+}
+
+PyDoc_STRVAR(_lz4framed_compress_dest_size__doc__,
+"compress_dest_size(b, dest_size, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, checksum=False)\n"
+"    -> tuple\n"
+"\n"
+"Compresses as much of (the start of) b as possible into a complete lz4 frame of at most\n"
+"dest_size bytes, returning a (frame, consumed) tuple where consumed is the number of input\n"
+"bytes the frame decompresses to. Pass the remaining input to subsequent calls to split data\n"
+"into e.g. datagram-sized frames (see compress_packets()). The frame consists of a single\n"
+"block (so consumes at most the block size) and does not include the content size. Always\n"
+"uses the fastest (default) compression level.\n"
+"\n"
+"Args:\n"
+"    b (bytes): Data to compress\n"
+"    dest_size (int): Most bytes the frame may occupy (at least 16, 20 with checksum)\n"
+"    block_size_id (int): Compression block size identifier, one of the\n"
+"                         LZ4F_BLOCKSIZE_* constants\n"
+"    checksum (bool): Whether to append checksum of consumed input to the frame\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If b is empty\n"
+"    ValueError: If dest_size or block_size_id is invalid");
+#define FUNC_DEF_COMPRESS_DEST_SIZE {"compress_dest_size", (PyCFunction)_lz4framed_compress_dest_size,\
+                                     METH_VARARGS | METH_KEYWORDS, _lz4framed_compress_dest_size__doc__}
+static PyObject*
+_lz4framed_compress_dest_size(PyObject *self, PyObject *args, PyObject *kwargs) {
+#if PY_MAJOR_VERSION >= 3
+    static const char *format = "y*n|ii:compress_dest_size";
+#else
+    static const char *format = "s*n|ii:compress_dest_size";
+#endif
+    static char *keywords[] = {"b", "dest_size", "block_size_id", "checksum", NULL};
+
+    Py_buffer input = {NULL, NULL};
+    Py_ssize_t dest_size;
+    int block_id = LZ4F_default;
+    int checksum = 0;
+    PyObject *output = NULL;
+    PyObject *result;
+    int input_len;
+    size_t output_len;
+    int consumed;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &input, &dest_size, &block_id, &checksum)) {
+        goto bail;
+    }
+    if (input.len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    if (!_valid_lz4f_block_size_id(block_id)) {
+        PyErr_Format(PyExc_ValueError, "block_size_id (%d) invalid", block_id);
+        goto bail;
+    }
+    if (dest_size <= DEST_SIZE_FRAME_OVERHEAD(checksum) || dest_size > INT_MAX) {
+        PyErr_Format(PyExc_ValueError, "dest_size (%zd) invalid", dest_size);
+        goto bail;
+    }
+    input_len = (int)(MIN(input.len, LZ4_MAX_INPUT_SIZE));
+    BAIL_ON_NULL(output = PyBytes_FromStringAndSize(NULL, dest_size));
+
+    if (input_len < NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD) {
+        output_len = _compress_frame_dest_size(input.buf, input_len, PyBytes_AS_STRING(output), (int)dest_size,
+                                               block_id, checksum, &consumed);
+    } else {
+        Py_BEGIN_ALLOW_THREADS;
+        output_len = _compress_frame_dest_size(input.buf, input_len, PyBytes_AS_STRING(output), (int)dest_size,
+                                               block_id, checksum, &consumed);
+        Py_END_ALLOW_THREADS;
+    }
+    BAIL_ON_NONZERO(_PyBytes_Resize(&output, output_len));
+    PyBuffer_Release(&input);
+    result = Py_BuildValue("(Ni)", output, consumed);
+    return result;
+
+bail:
+    Py_XDECREF(output);
+    if (input.obj) {
+        PyBuffer_Release(&input);
+    }
+    return NULL;
+}
+
+/******************************************************************************/
+
+/* A LazyLz4Buffer holds a compressed frame and only decompresses it when its contents are first accessed (via the
+ * buffer protocol or subscript). If it has a LazyLz4BufferCache, the cache tracks all of its buffers which currently
+ * hold decompressed data (most recently accessed first) and releases the least recently accessed ones when over budget.
+ * The list is only ever modified whilst holding the GIL, so needs no lock of its own. Buffers with outstanding exports
+ * (e.g. memoryviews) are pinned, i.e. never released. The cache only refers to buffers weakly (they unlink on
+ * deallocation).
+ */
+typedef struct _lazy_buffer_s _lazy_buffer_t;
+
+typedef struct {
+    PyObject_HEAD
+    _lazy_buffer_t *head;       // most recently accessed
+    _lazy_buffer_t *tail;       // least recently accessed
+    size_t size;                // of all decompressed data held by buffers in list
+    size_t max_size;
+    unsigned long long hits;
+    unsigned long long misses;  // i.e. decompressions
+} _lazy_cache_t;
+
+struct _lazy_buffer_s {
+    PyObject_HEAD
+    PyObject *compressed;       // bytes
+    PyObject *decompressed;     // bytes (or NULL if not decompressed / released)
+    _lazy_cache_t *cache;       // (or NULL)
+    _lazy_buffer_t *prev;       // within cache list, only set whilst decompressed
+    _lazy_buffer_t *next;
+    Py_ssize_t exports;         // outstanding buffer protocol exports
+    unsigned long long length;  // as per frame header
+    int length_known;
+};
+
+static PyTypeObject LazyBufferType = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject LazyCacheType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static void _lazy_cache_unlink(_lazy_cache_t *cache, _lazy_buffer_t *buffer) {
+    if (buffer->prev) {
+        buffer->prev->next = buffer->next;
+    } else {
+        cache->head = buffer->next;
+    }
+    if (buffer->next) {
+        buffer->next->prev = buffer->prev;
+    } else {
+        cache->tail = buffer->prev;
+    }
+    buffer->prev = buffer->next = NULL;
+    cache->size -= PyBytes_GET_SIZE(buffer->decompressed);
+}
+
+static void _lazy_cache_link(_lazy_cache_t *cache, _lazy_buffer_t *buffer) {
+    buffer->prev = NULL;
+    buffer->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = buffer;
+    } else {
+        cache->tail = buffer;
+    }
+    cache->head = buffer;
+    cache->size += PyBytes_GET_SIZE(buffer->decompressed);
+}
+
+// Drops decompressed data of least recently accessed (unpinned) buffers other than keep until within budget
+static void _lazy_cache_evict(_lazy_cache_t *cache, _lazy_buffer_t *keep) {
+    _lazy_buffer_t *buffer = cache->tail;
+    _lazy_buffer_t *prev;
+
+    while (buffer && cache->size > cache->max_size) {
+        prev = buffer->prev;
+        if (buffer != keep && !buffer->exports) {
+            _lazy_cache_unlink(cache, buffer);
+            Py_CLEAR(buffer->decompressed);
+        }
+        buffer = prev;
+    }
+}
+
+// Returns (borrowed) decompressed data of buffer, decompressing it first if required
+static PyObject* _lazy_buffer_load(_lazy_buffer_t *self) {
+    PyObject *args = NULL;
+    PyObject *decompressed = NULL;
+
+    if (self->decompressed) {
+        if (self->cache) {
+            self->cache->hits++;
+            if (self->cache->head != self) {
+                _lazy_cache_unlink(self->cache, self);
+                _lazy_cache_link(self->cache, self);
+            }
+        }
+        return self->decompressed;
+    }
+    // (releases GIL for larger inputs)
+    BAIL_ON_NULL(args = PyTuple_Pack(1, self->compressed));
+    BAIL_ON_NULL(decompressed = _lz4framed_decompress(NULL, args, NULL));
+    Py_CLEAR(args);
+    // another thread might have decompressed the same frame in the meantime
+    if (self->decompressed) {
+        Py_DECREF(decompressed);
+        return self->decompressed;
+    }
+    self->decompressed = decompressed;
+    self->length = PyBytes_GET_SIZE(decompressed);
+    self->length_known = 1;
+    if (self->cache) {
+        self->cache->misses++;
+        _lazy_cache_link(self->cache, self);
+        _lazy_cache_evict(self->cache, self);
+    }
+    return decompressed;
+
+bail:
+    Py_XDECREF(args);
+    return NULL;
+}
+
+// Drops decompressed data (unless pinned), returning non-zero if not possible
+static int _lazy_buffer_release(_lazy_buffer_t *self) {
+    if (self->exports) {
+        return -1;
+    }
+    if (self->decompressed) {
+        if (self->cache) {
+            _lazy_cache_unlink(self->cache, self);
+        }
+        Py_CLEAR(self->decompressed);
+    }
+    return 0;
+}
+
+PyDoc_STRVAR(_lazy_buffer__doc__,
+"LazyLz4Buffer(b, cache=None)\n"
+"\n"
+"Read-only bytes-like object wrapping a single compressed lz4 frame, which is only\n"
+"decompressed when its contents are first accessed via the buffer protocol (e.g.\n"
+"memoryview(), bytes(), file.write()) or a subscript (index or slice). len() reports the\n"
+"uncompressed length as stated in the frame header, so does not decompress either (unless\n"
+"the frame does not state its length). The decompressed data is retained (see release()).\n"
+"Thread safe.\n"
+"\n"
+"Args:\n"
+"    b (bytes): lz4 frame (copied unless of type bytes)\n"
+"    cache (LazyLz4BufferCache): Size-bounded cache to track decompressed data with (or None\n"
+"                                to retain it until release() is called)\n"
+"\n"
+"Raises:\n"
+"    LZ4FNoDataError: If b is empty\n"
+"    Lz4FramedError: If the frame header is invalid. (Decompression errors, see decompress(),\n"
+"                    are raised on access.)");
+static PyObject*
+_lazy_buffer_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static const char *format = "O|O:LazyLz4Buffer";
+    static char *keywords[] = {"b", "cache", NULL};
+
+    PyObject *source;
+    PyObject *cache = Py_None;
+    Py_buffer buffer = {NULL, NULL};
+    LZ4F_decompressionContext_t ctx = NULL;
+    LZ4F_frameInfo_t info;
+    size_t info_read;
+    _lazy_buffer_t *self = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &source, &cache)) {
+        goto bail;
+    }
+    if (cache != Py_None && !PyObject_TypeCheck(cache, &LazyCacheType)) {
+        PyErr_SetString(PyExc_TypeError, "cache must be a LazyLz4BufferCache or None");
+        goto bail;
+    }
+    BAIL_ON_NULL(self = (_lazy_buffer_t*)type->tp_alloc(type, 0));
+    if (PyBytes_CheckExact(source)) {
+        Py_INCREF(source);
+        self->compressed = source;
+    } else {
+        BAIL_ON_NONZERO(PyObject_GetBuffer(source, &buffer, PyBUF_SIMPLE));
+        BAIL_ON_NULL(self->compressed = PyBytes_FromStringAndSize(buffer.buf, buffer.len));
+        PyBuffer_Release(&buffer);
+    }
+    if (!PyBytes_GET_SIZE(self->compressed)) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+
+    BAIL_ON_LZ4_ERROR(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION));
+    info_read = PyBytes_GET_SIZE(self->compressed);
+    BAIL_ON_LZ4_ERROR(LZ4F_getFrameInfo(ctx, &info, PyBytes_AS_STRING(self->compressed), &info_read));
+    LZ4F_freeDecompressionContext(ctx);
+    ctx = NULL;
+    self->length = info.contentSize;
+    self->length_known = (0 != info.contentSize);
+
+    if (cache != Py_None) {
+        Py_INCREF(cache);
+        self->cache = (_lazy_cache_t*)cache;
+    }
+    return (PyObject*)self;
+
+bail:
+    if (buffer.obj) {
+        PyBuffer_Release(&buffer);
+    }
+    LZ4F_freeDecompressionContext(ctx);
+    Py_XDECREF(self);
+    return NULL;
+}
+
+static void
+_lazy_buffer_dealloc(_lazy_buffer_t *self) {
+    if (self->cache && self->decompressed) {
+        _lazy_cache_unlink(self->cache, self);
+    }
+    Py_XDECREF(self->decompressed);
+    Py_XDECREF(self->compressed);
+    Py_XDECREF(self->cache);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static Py_ssize_t
+_lazy_buffer_length(_lazy_buffer_t *self) {
+    if (!self->length_known && NULL == _lazy_buffer_load(self)) {
+        return -1;
+    }
+    if (self->length > PY_SSIZE_T_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "uncompressed length too large");
+        return -1;
+    }
+    return (Py_ssize_t)self->length;
+}
+
+static PyObject*
+_lazy_buffer_subscript(_lazy_buffer_t *self, PyObject *key) {
+    PyObject *decompressed = _lazy_buffer_load(self);
+    PyObject *item;
+
+    if (NULL == decompressed) {
+        return NULL;
+    }
+    // key's __index__ could release (or evict) the decompressed bytes
+    Py_INCREF(decompressed);
+    item = PyObject_GetItem(decompressed, key);
+    Py_DECREF(decompressed);
+    return item;
+}
+
+static int
+_lazy_buffer_getbuffer(_lazy_buffer_t *self, Py_buffer *view, int flags) {
+    PyObject *decompressed;
+
+    if (NULL == (decompressed = _lazy_buffer_load(self)) ||
+        PyBuffer_FillInfo(view, (PyObject*)self, PyBytes_AS_STRING(decompressed), PyBytes_GET_SIZE(decompressed), 1,
+                          flags)) {
+        return -1;
+    }
+    self->exports++;
+    return 0;
+}
+
+static void
+_lazy_buffer_releasebuffer(_lazy_buffer_t *self, Py_buffer *view) {
+    UNUSED(view);
+    // previously pinned data might now be evictable
+    if (!--self->exports && self->cache && self->cache->size > self->cache->max_size) {
+        _lazy_cache_evict(self->cache, NULL);
+    }
+}
+
+PyDoc_STRVAR(_lazy_buffer_release__doc__,
+"release()\n"
+"\n"
+"Drops decompressed data (if any), so that the frame is decompressed again on next access.\n"
+"\n"
+"Raises:\n"
+"    BufferError: If the decompressed data is still being referenced via the buffer\n"
+"                 protocol (e.g. by a memoryview)");
+static PyObject*
+_lazy_buffer_release_method(_lazy_buffer_t *self, PyObject *unused) {
+    UNUSED(unused);
+
+    if (_lazy_buffer_release(self)) {
+        PyErr_SetString(PyExc_BufferError, "decompressed data still exported");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+_lazy_buffer_get_compressed(_lazy_buffer_t *self, void *closure) {
+    UNUSED(closure);
+    Py_INCREF(self->compressed);
+    return self->compressed;
+}
+
+static PyObject*
+_lazy_buffer_get_loaded(_lazy_buffer_t *self, void *closure) {
+    UNUSED(closure);
+    return PyBool_FromLong(NULL != self->decompressed);
+}
+
+static PyMethodDef _lazy_buffer_methods[] = {
+    {"release", (PyCFunction)_lazy_buffer_release_method, METH_NOARGS, _lazy_buffer_release__doc__},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef _lazy_buffer_getset[] = {
+    {"compressed", (getter)_lazy_buffer_get_compressed, NULL, "The compressed frame (bytes)", NULL},
+    {"loaded", (getter)_lazy_buffer_get_loaded, NULL, "Whether decompressed data is currently held", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyMappingMethods _lazy_buffer_as_mapping = {
+    (lenfunc)_lazy_buffer_length,
+    (binaryfunc)_lazy_buffer_subscript,
+    NULL
+};
+
+static PyBufferProcs _lazy_buffer_as_buffer;
+
+PyDoc_STRVAR(_lazy_cache__doc__,
+"LazyLz4BufferCache(max_size)\n"
+"\n"
+"Bounds how much decompressed data the LazyLz4Buffer instances using it retain in total.\n"
+"When exceeded, the least recently accessed buffers release their decompressed data (unless\n"
+"still referenced via the buffer protocol), to be decompressed again on next access. The\n"
+"buffer being accessed is always retained, even if larger than max_size by itself.\n"
+"\n"
+"Args:\n"
+"    max_size (int): Most bytes of decompressed data to retain\n"
+"\n"
+"Raises:\n"
+"    ValueError: If max_size is negative");
+static PyObject*
+_lazy_cache_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static const char *format = "n:LazyLz4BufferCache";
+    static char *keywords[] = {"max_size", NULL};
+
+    Py_ssize_t max_size;
+    _lazy_cache_t *self;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &max_size)) {
+        return NULL;
+    }
+    if (max_size < 0) {
+        PyErr_Format(PyExc_ValueError, "max_size (%zd) invalid", max_size);
+        return NULL;
+    }
+    if ((self = (_lazy_cache_t*)type->tp_alloc(type, 0))) {
+        self->max_size = max_size;
+    }
+    return (PyObject*)self;
+}
+
+PyDoc_STRVAR(_lazy_cache_clear__doc__,
+"clear()\n"
+"\n"
+"Releases the decompressed data of all buffers (which are not still referenced via the\n"
+"buffer protocol).");
+static PyObject*
+_lazy_cache_clear(_lazy_cache_t *self, PyObject *unused) {
+    _lazy_buffer_t *buffer = self->head;
+    _lazy_buffer_t *next;
+    UNUSED(unused);
+
+    while (buffer) {
+        next = buffer->next;
+        _lazy_buffer_release(buffer);
+        buffer = next;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject*
+_lazy_cache_get_stats(_lazy_cache_t *self, void *closure) {
+    UNUSED(closure);
+    return Py_BuildValue("{s:n,s:n,s:K,s:K}", "size", (Py_ssize_t)self->size, "max_size", (Py_ssize_t)self->max_size,
+                         "hits", self->hits, "misses", self->misses);
+}
+
+static PyMethodDef _lazy_cache_methods[] = {
+    {"clear", (PyCFunction)_lazy_cache_clear, METH_NOARGS, _lazy_cache_clear__doc__},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef _lazy_cache_getset[] = {
+    {"stats", (getter)_lazy_cache_get_stats, NULL,
+     "dict with size (bytes of decompressed data retained), max_size, hits (accesses to\n"
+     "retained data) & misses (decompressions)", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+// Completes static type definitions (by field rather than positional initialisers, for portability)
+static int _lazy_types_init(void) {
+    _lazy_buffer_as_buffer.bf_getbuffer = (getbufferproc)_lazy_buffer_getbuffer;
+    _lazy_buffer_as_buffer.bf_releasebuffer = (releasebufferproc)_lazy_buffer_releasebuffer;
+
+    LazyBufferType.tp_name = "_lz4framed.LazyLz4Buffer";
+    LazyBufferType.tp_basicsize = sizeof(_lazy_buffer_t);
+    LazyBufferType.tp_dealloc = (destructor)_lazy_buffer_dealloc;
+    LazyBufferType.tp_as_mapping = &_lazy_buffer_as_mapping;
+    LazyBufferType.tp_as_buffer = &_lazy_buffer_as_buffer;
+#if PY_MAJOR_VERSION >= 3
+    LazyBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+#else
+    LazyBufferType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+#endif
+    LazyBufferType.tp_doc = _lazy_buffer__doc__;
+    LazyBufferType.tp_methods = _lazy_buffer_methods;
+    LazyBufferType.tp_getset = _lazy_buffer_getset;
+    LazyBufferType.tp_new = _lazy_buffer_new;
+
+    LazyCacheType.tp_name = "_lz4framed.LazyLz4BufferCache";
+    LazyCacheType.tp_basicsize = sizeof(_lazy_cache_t);
+    LazyCacheType.tp_flags = Py_TPFLAGS_DEFAULT;
+    LazyCacheType.tp_doc = _lazy_cache__doc__;
+    LazyCacheType.tp_methods = _lazy_cache_methods;
+    LazyCacheType.tp_getset = _lazy_cache_getset;
+    LazyCacheType.tp_new = _lazy_cache_new;
+
+    return (PyType_Ready(&LazyBufferType) || PyType_Ready(&LazyCacheType)) ? -1 : 0;
+}
+
+/******************************************************************************/
+
+#ifdef LZ4FRAMED_HAVE_SOCKET
+
+/* Socket contexts (de)compress directly to/from a connected stream socket, with both (de)compression and socket I/O
+ * happening without the GIL. Compressed output which cannot be sent straight away (non-blocking sockets) is kept as a
+ * list of segments which are sent together via sendmsg(). Decompression receives (as per input hint) into a buffer
+ * which grows to hold whole blocks, so that they can be decoded without being buffered by LZ4F first. Timeouts (in ms)
+ * apply to each wait for the socket to become ready, with zero meaning no waiting and negative meaning no limit.
+ */
+#define SOCKET_COMPRESSOR_CAPSULE_NAME "_lz4fscctx"
+#define SOCKET_DECOMPRESSOR_CAPSULE_NAME "_lz4fsdctx"
+// Most segments to send via a single sendmsg() call
+#define SOCKET_IOV_MAX 64
+// Initial input hint of each frame (smallest possible header), so that subsequent frames are not read into
+#define SOCKET_HEADER_HINT 7
+// Initial receive buffer size, increased to block size (as indicated by input hint) if necessary
+#define SOCKET_INPUT_SIZE (64 KB)
+// Returned (instead of errno value) by socket helpers on end of stream and on lz4 failure
+#define SOCKET_EOF -1
+#define SOCKET_LZ4_ERROR -2
+#ifdef MSG_NOSIGNAL
+    #define SOCKET_SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define SOCKET_SEND_FLAGS 0
+#endif
+
+// Compressed output not yet (fully) sent
+typedef struct _socket_segment_s _socket_segment_t;
+struct _socket_segment_s {
+    _socket_segment_t *next;
+    size_t len;                 // length of data
+    size_t sent;                // how much of data has been sent already
+    char data[];
+};
+
+typedef struct {
+    int fd;
+    LZ4F_compressionContext_t ctx;
+    LZ4F_preferences_t prefs;
+    _socket_segment_t *head;    // first segment to send
+    _socket_segment_t *tail;    // last segment to send
+    size_t pending;             // bytes remaining to be sent across all segments
+#ifdef WITH_THREAD
+    PyThread_type_lock lock;
+#endif
+} _lz4f_scctx_t;
+
+typedef struct {
+    int fd;
+    LZ4F_decompressionContext_t ctx;
+    char *input;                // receive buffer
+    size_t input_size;          // size of receive buffer
+    size_t input_pos;           // start of received data not yet decompressed
+    size_t input_len;           // end of received data
+    size_t input_hint;          // bytes expected to complete current block (plus next block header)
+    size_t output_size;         // block size of current frame or zero if header not decoded yet
+#ifdef WITH_THREAD
+    PyThread_type_lock lock;
+#endif
+} _lz4f_sdctx_t;
+
+// Converts the given timeout in seconds (negative meaning no limit) to milliseconds as used by poll()
+static int _socket_timeout_ms(double timeout) {
+    if (timeout < 0) {
+        return -1;
+    }
+    if (timeout >= INT_MAX / 1000) {
+        return INT_MAX;
+    }
+    // don't round very short timeouts down to zero (i.e. no waiting)
+    return (timeout > 0 && timeout < 0.001) ? 1 : (int)(timeout * 1000);
+}
+
+// Waits for fd to become ready. Returns zero on success, otherwise errno value (ETIMEDOUT if timed out).
+static int _socket_wait(int fd, short events, int timeout_ms) {
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    switch (poll(&pfd, 1, timeout_ms)) {
+        case -1:
+            return errno;
+        case 0:
+            return ETIMEDOUT;
+        default:
+            return 0;
+    }
+}
+
+/* Sends pending segments. Called without the GIL. Returns zero once all have been sent, otherwise errno value (EAGAIN
+ * if segments remain and socket not writable with zero timeout, EINTR if interrupted by a signal).
+ */
+static int _socket_send(_lz4f_scctx_t *sctx, int timeout_ms) {
+    struct iovec iov[SOCKET_IOV_MAX];
+    struct msghdr msg;
+    _socket_segment_t *segment;
+    ssize_t sent;
+    size_t remaining;
+    int count;
+    int err;
+
+    while (sctx->head) {
+        for (count = 0, segment = sctx->head; segment && count < SOCKET_IOV_MAX; segment = segment->next, count++) {
+            iov[count].iov_base = segment->data + segment->sent;
+            iov[count].iov_len = segment->len - segment->sent;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        if ((sent = sendmsg(sctx->fd, &msg, SOCKET_SEND_FLAGS)) < 0) {
+            err = errno;
+            if (EAGAIN != err && EWOULDBLOCK != err) {
+                return err;
+            }
+            if (!timeout_ms) {
+                return EAGAIN;
+            }
+            if ((err = _socket_wait(sctx->fd, POLLOUT, timeout_ms))) {
+                return err;
+            }
+            continue;
+        }
+        sctx->pending -= sent;
+        // release fully sent segments
+        while (sent > 0) {
+            segment = sctx->head;
+            remaining = segment->len - segment->sent;
+            if ((size_t)sent < remaining) {
+                segment->sent += sent;
+                break;
+            }
+            sent -= remaining;
+            sctx->head = segment->next;
+            free(segment);
+        }
+        if (!sctx->head) {
+            sctx->tail = NULL;
+        }
+    }
+    return 0;
+}
+
+// Sends pending segments (see _socket_send), releasing the GIL. Returns non-zero (with exception set) on failure.
+static int _socket_send_pending(_lz4f_scctx_t *sctx, int timeout_ms) {
+    int err;
+
+    do {
+        Py_BEGIN_ALLOW_THREADS;
+        err = _socket_send(sctx, timeout_ms);
+        Py_END_ALLOW_THREADS;
+        if (EINTR == err && PyErr_CheckSignals()) {
+            return -1;
+        }
+    } while (EINTR == err);
+
+    if (err && EAGAIN != err) {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return 0;
+}
+
+typedef enum {
+    SOCKET_COMPRESS_BEGIN,
+    SOCKET_COMPRESS_UPDATE,
+    SOCKET_COMPRESS_FLUSH,
+    SOCKET_COMPRESS_END
+} _socket_compress_op_t;
+
+/* Appends output of the given operation (input only used for SOCKET_COMPRESS_UPDATE) to pending segments. Returns
+ * non-zero (with exception set) on failure.
+ */
+static int _socket_compress(_lz4f_scctx_t *sctx, _socket_compress_op_t op, const char *input, size_t input_len) {
+    _socket_segment_t *segment = NULL;
+    size_t output_len;
+
+    if (SOCKET_COMPRESS_BEGIN == op) {
+        output_len = LZ4F_HEADER_SIZE_MAX;
+    } else {
+        BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressBound(input_len, &(sctx->prefs)));
+    }
+    if (NULL == (segment = malloc(sizeof(_socket_segment_t) + output_len))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+
+    switch (op) {
+        case SOCKET_COMPRESS_BEGIN:
+            BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressBegin(sctx->ctx, segment->data, output_len, &(sctx->prefs)));
+            break;
+        case SOCKET_COMPRESS_UPDATE:
+            if (input_len < NOGIL_COMPRESS_INPUT_SIZE_THRESHOLD) {
+                BAIL_ON_LZ4_ERROR(output_len = LZ4F_compressUpdate(sctx->ctx, segment->data, output_len, input,
+                                                                   input_len, NULL));
+            } else {
+                BAIL_ON_LZ4_ERROR_NOGIL(output_len = LZ4F_compressUpdate(sctx->ctx, segment->data, output_len, input,
+                                                                         input_len, NULL));
+            }
+            break;
+        case SOCKET_COMPRESS_FLUSH:
+            BAIL_ON_LZ4_ERROR_NOGIL(output_len = LZ4F_flush(sctx->ctx, segment->data, output_len, NULL));
+            break;
+        case SOCKET_COMPRESS_END:
+            BAIL_ON_LZ4_ERROR_NOGIL(output_len = LZ4F_compressEnd(sctx->ctx, segment->data, output_len, NULL));
+            break;
+    }
+
+    // nothing to send (e.g. input buffered internally)
+    if (!output_len) {
+        free(segment);
+        return 0;
+    }
+    segment->next = NULL;
+    segment->len = output_len;
+    segment->sent = 0;
+    if (sctx->tail) {
+        sctx->tail->next = segment;
+    } else {
+        sctx->head = segment;
+    }
+    sctx->tail = segment;
+    sctx->pending += output_len;
+    return 0;
+
+bail:
+    free(segment);
+    return -1;
+}
+
+/* Receives and decompresses into output (starting at *written) until the output is full, the current frame is complete
+ * or the frame header has just been decoded (output_size set). Stops waiting for more input once have_output is set or
+ * some output has been written. Called without the GIL. Returns zero or errno value (EAGAIN if no input ready with zero
+ * timeout, EINTR if interrupted by a signal), SOCKET_EOF or SOCKET_LZ4_ERROR (with lz4_error set).
+ */
+static int _socket_decompress(_lz4f_sdctx_t *sdctx, char *output, size_t output_len, size_t *written, int have_output,
+                              int timeout_ms, size_t *lz4_error) {
+    char *input;
+    ssize_t received;
+    size_t input_read;
+    size_t output_written;
+    size_t hint;
+    size_t zero = 0;
+    LZ4F_frameInfo_t info;
+    int err;
+
+    while (sdctx->input_hint && (*written < output_len || !sdctx->output_size)) {
+        if (sdctx->input_pos == sdctx->input_len) {
+            if (have_output || *written) {
+                break;
+            }
+            sdctx->input_pos = sdctx->input_len = 0;
+            // whole block (including next block header) should fit
+            if (sdctx->input_hint > sdctx->input_size) {
+                if (NULL == (input = realloc(sdctx->input, sdctx->input_hint))) {
+                    return ENOMEM;
+                }
+                sdctx->input = input;
+                sdctx->input_size = sdctx->input_hint;
+            }
+            if ((received = recv(sdctx->fd, sdctx->input, sdctx->input_hint, 0)) < 0) {
+                err = errno;
+                if (EAGAIN != err && EWOULDBLOCK != err) {
+                    return err;
+                }
+                if (!timeout_ms) {
+                    return EAGAIN;
+                }
+                if ((err = _socket_wait(sdctx->fd, POLLIN, timeout_ms))) {
+                    return err;
+                }
+                continue;
+            }
+            if (!received) {
+                return SOCKET_EOF;
+            }
+            sdctx->input_len = received;
+        }
+
+        input_read = sdctx->input_len - sdctx->input_pos;
+        output_written = output_len - *written;
+        hint = LZ4F_decompress(sdctx->ctx, output ? output + *written : NULL, &output_written,
+                               sdctx->input + sdctx->input_pos, &input_read, NULL);
+        if (LZ4F_isError(hint)) {
+            *lz4_error = hint;
+            return SOCKET_LZ4_ERROR;
+        }
+        sdctx->input_pos += input_read;
+        sdctx->input_hint = hint;
+        *written += output_written;
+
+        // caller to provide output sized for whole blocks once known
+        if (!sdctx->output_size && !LZ4F_isError(LZ4F_getFrameInfo(sdctx->ctx, &info, NULL, &zero))) {
+            sdctx->output_size = _lz4f_block_size_from_id(info.blockSizeID);
+            break;
+        }
+    }
+    return 0;
+}
+
+static void _scctx_capsule_destructor(PyObject *py_ctx) {
+    _lz4f_scctx_t *sctx = (_lz4f_scctx_t*)PyCapsule_GetPointer(py_ctx, SOCKET_COMPRESSOR_CAPSULE_NAME);
+    _socket_segment_t *segment;
+
+    if (NULL != sctx) {
+        while ((segment = sctx->head)) {
+            sctx->head = segment->next;
+            free(segment);
+        }
+        // ignoring errors here since shouldn't throw exception in destructor
+        LZ4F_freeCompressionContext(sctx->ctx);
+#ifdef WITH_THREAD
+        PyThread_free_lock(sctx->lock);
+#endif
+        PyMem_Del(sctx);
+    }
+}
+
+static void _sdctx_capsule_destructor(PyObject *py_ctx) {
+    _lz4f_sdctx_t *sdctx = (_lz4f_sdctx_t*)PyCapsule_GetPointer(py_ctx, SOCKET_DECOMPRESSOR_CAPSULE_NAME);
+
+    if (NULL != sdctx) {
+        // ignoring errors here since shouldn't throw exception in destructor
+        LZ4F_freeDecompressionContext(sdctx->ctx);
+        free(sdctx->input);
+#ifdef WITH_THREAD
+        PyThread_free_lock(sdctx->lock);
+#endif
+        PyMem_Del(sdctx);
+    }
+}
+
+PyDoc_STRVAR(_lz4framed_create_socket_compressor__doc__,
+"create_socket_compressor(fd, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True,\n"
+"                         checksum=False, autoflush=False, level=0) -> PyCapsule\n"
+"\n"
+"Creates context for compressing a single frame directly to a connected stream socket.\n"
+"The frame header is sent as part of the first socket_compress_update(),\n"
+"socket_compress_flush(), socket_compress_end() or socket_send_pending() call.\n"
+"\n"
+"Args:\n"
+"    fd (int): File descriptor of socket (which must remain open whilst in use)\n"
+"    Remaining arguments: See compress_begin()\n"
+"\n"
+"Raises:\n"
+"    Lz4FramedError: If a compression failure occured");
+#define FUNC_DEF_CREATE_SOCKET_COMPRESSOR {"create_socket_compressor",\
+                                           (PyCFunction)_lz4framed_create_socket_compressor,\
+                                           METH_VARARGS | METH_KEYWORDS, _lz4framed_create_socket_compressor__doc__}
+static PyObject*
+_lz4framed_create_socket_compressor(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "i|iiiii:create_socket_compressor";
+    static char *keywords[] = {"fd", "block_size_id", "block_mode_linked", "checksum", "autoflush", "level", NULL};
+
+    _lz4f_scctx_t *sctx = NULL;
+    PyObject *ctx_capsule = NULL;
+    int fd;
+    int block_id = LZ4F_default;
+    int block_mode_linked = 1;
+    int checksum = 0;
+    int autoflush = 0;
+    int compression_level = LZ4_COMPRESSION_MIN;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &fd, &block_id, &block_mode_linked, &checksum,
+                                     &autoflush, &compression_level)) {
+        goto bail;
+    }
+    if (fd < 0) {
+        PyErr_Format(PyExc_ValueError, "fd (%d) invalid", fd);
+        goto bail;
+    }
+    if (NULL == (sctx = PyMem_New(_lz4f_scctx_t, 1))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    sctx->fd = fd;
+    sctx->ctx = NULL;
+    sctx->prefs = prefs_defaults;
+    sctx->head = sctx->tail = NULL;
+    sctx->pending = 0;
+#ifdef WITH_THREAD
+    if (NULL == (sctx->lock = PyThread_allocate_lock())) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate lock");
+        goto bail;
+    }
+#endif
+    BAIL_ON_NONZERO(_lz4framed_set_prefs(&(sctx->prefs), block_id, block_mode_linked, checksum, compression_level));
+    sctx->prefs.autoFlush = autoflush ? 1 : 0;
+    BAIL_ON_LZ4_ERROR(LZ4F_createCompressionContext(&(sctx->ctx), LZ4F_VERSION));
+    BAIL_ON_NONZERO(_socket_compress(sctx, SOCKET_COMPRESS_BEGIN, NULL, 0));
+    BAIL_ON_NULL(ctx_capsule = PyCapsule_New(sctx, SOCKET_COMPRESSOR_CAPSULE_NAME, _scctx_capsule_destructor));
+    return ctx_capsule;
+
+bail:
+    // this must NOT be freed once capsule exists (since destructor responsible for freeing)
+    if (sctx) {
+        free(sctx->head);
+        LZ4F_freeCompressionContext(sctx->ctx);
+#ifdef WITH_THREAD
+        if (sctx->lock) {
+            PyThread_free_lock(sctx->lock);
+        }
+#endif
+        PyMem_Del(sctx);
+    }
+    return NULL;
+}
+
+// Runs given operation and sends pending output, returning number of bytes still pending
+static PyObject* _socket_compress_op(PyObject *ctx_capsule, _socket_compress_op_t op, Py_buffer *input,
+                                     double timeout) {
+    _lz4f_scctx_t *sctx = NULL;
+    size_t pending;
+    LZ4FRAMED_LOCK_FLAG;
+
+    if (!PyCapsule_IsValid(ctx_capsule, SOCKET_COMPRESSOR_CAPSULE_NAME)) {
+        PyErr_SetString(PyExc_ValueError, "ctx invalid");
+        goto bail;
+    }
+    if (input && input->len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        goto bail;
+    }
+    // Guaranteed to succeed due to PyCapsule_IsValid check above
+    sctx = PyCapsule_GetPointer(ctx_capsule, SOCKET_COMPRESSOR_CAPSULE_NAME);
+
+    ENTER_LZ4FRAMED(sctx);
+
+    if (SOCKET_COMPRESS_BEGIN != op) {
+        BAIL_ON_NONZERO(_socket_compress(sctx, op, input ? input->buf : NULL, input ? input->len : 0));
+    }
+    BAIL_ON_NONZERO(_socket_send_pending(sctx, _socket_timeout_ms(timeout)));
+
+    pending = sctx->pending;
+    EXIT_LZ4FRAMED(sctx);
+    return PyLong_FromSize_t(pending);
+
+bail:
+    EXIT_LZ4FRAMED(sctx);
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_socket_compress_update__doc__,
+"socket_compress_update(ctx, b, timeout=-1) -> int\n"
+"\n"
+"Compresses the given data and sends it (along with any output still pending) to the\n"
+"socket. For non-blocking sockets (or when timeout is zero) only as much as the\n"
+"socket accepts without blocking is sent, with the remainder kept for subsequent\n"
+"calls (see socket_send_pending()).\n"
+"\n"
+"Args:\n"
+"    ctx: Socket compression context\n"
+"    b (bytes-like): The data to compress, e.g. bytes, bytearray or memoryview\n"
+"    timeout (float): Seconds to wait each time the socket is not writable. Only\n"
+"                     applies to non-blocking sockets (e.g. ones with a timeout set).\n"
+"                     Negative means no limit and zero means not to wait at all.\n"
+"\n"
+"Returns:\n"
+"    Number of bytes of compressed output yet to be sent\n"
+"\n"
+"Raises:\n"
+"    Lz4FramedNoDataError: If provided data is of zero length\n"
+"    Lz4FramedError: If a compression failure occured\n"
+"    OSError: If sending failed (including ETIMEDOUT if timeout was reached)");
+#define FUNC_DEF_SOCKET_COMPRESS_UPDATE {"socket_compress_update", (PyCFunction)_lz4framed_socket_compress_update,\
+                                         METH_VARARGS | METH_KEYWORDS, _lz4framed_socket_compress_update__doc__}
+static PyObject*
+_lz4framed_socket_compress_update(PyObject *self, PyObject *args, PyObject *kwargs) {
+#if PY_MAJOR_VERSION >= 3
+    static const char *format = "Oy*|d:socket_compress_update";
+#else
+    static const char *format = "Os*|d:socket_compress_update";
+#endif
+    static char *keywords[] = {"ctx", "b", "timeout", NULL};
+
+    PyObject *ctx_capsule;
+    Py_buffer input = {NULL, NULL};
+    double timeout = -1;
+    PyObject *pending;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &ctx_capsule, &input, &timeout)) {
+        return NULL;
+    }
+    pending = _socket_compress_op(ctx_capsule, SOCKET_COMPRESS_UPDATE, &input, timeout);
+    PyBuffer_Release(&input);
+    return pending;
+}
+
+PyDoc_STRVAR(_lz4framed_socket_compress_flush__doc__,
+"socket_compress_flush(ctx, timeout=-1) -> int\n"
+"\n"
+"As socket_compress_update() but compresses data buffered internally (as a result of\n"
+"autoflush not having been set) instead, without finalising the frame.");
+#define FUNC_DEF_SOCKET_COMPRESS_FLUSH {"socket_compress_flush", (PyCFunction)_lz4framed_socket_compress_flush,\
+                                        METH_VARARGS | METH_KEYWORDS, _lz4framed_socket_compress_flush__doc__}
+static PyObject*
+_lz4framed_socket_compress_flush(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"ctx", "timeout", NULL};
+    PyObject *ctx_capsule;
+    double timeout = -1;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d:socket_compress_flush", keywords, &ctx_capsule, &timeout)) {
+        return NULL;
+    }
+    return _socket_compress_op(ctx_capsule, SOCKET_COMPRESS_FLUSH, NULL, timeout);
+}
+
+PyDoc_STRVAR(_lz4framed_socket_compress_end__doc__,
+"socket_compress_end(ctx, timeout=-1) -> int\n"
+"\n"
+"As socket_compress_update() but compresses any remaining data and finalises the\n"
+"frame instead. Note that for non-blocking sockets the end of the frame might not\n"
+"have been sent yet, i.e. until socket_send_pending() returns zero.");
+#define FUNC_DEF_SOCKET_COMPRESS_END {"socket_compress_end", (PyCFunction)_lz4framed_socket_compress_end,\
+                                      METH_VARARGS | METH_KEYWORDS, _lz4framed_socket_compress_end__doc__}
+static PyObject*
+_lz4framed_socket_compress_end(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"ctx", "timeout", NULL};
+    PyObject *ctx_capsule;
+    double timeout = -1;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d:socket_compress_end", keywords, &ctx_capsule, &timeout)) {
+        return NULL;
+    }
+    return _socket_compress_op(ctx_capsule, SOCKET_COMPRESS_END, NULL, timeout);
+}
+
+PyDoc_STRVAR(_lz4framed_socket_send_pending__doc__,
+"socket_send_pending(ctx, timeout=-1) -> int\n"
+"\n"
+"Sends compressed output still pending (e.g. once a non-blocking socket has become\n"
+"writable). See socket_compress_update() for arguments.");
+#define FUNC_DEF_SOCKET_SEND_PENDING {"socket_send_pending", (PyCFunction)_lz4framed_socket_send_pending,\
+                                      METH_VARARGS | METH_KEYWORDS, _lz4framed_socket_send_pending__doc__}
+static PyObject*
+_lz4framed_socket_send_pending(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"ctx", "timeout", NULL};
+    PyObject *ctx_capsule;
+    double timeout = -1;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d:socket_send_pending", keywords, &ctx_capsule, &timeout)) {
+        return NULL;
+    }
+    // (nothing to compress)
+    return _socket_compress_op(ctx_capsule, SOCKET_COMPRESS_BEGIN, NULL, timeout);
+}
+
+PyDoc_STRVAR(_lz4framed_create_socket_decompressor__doc__,
+"create_socket_decompressor(fd) -> PyCapsule\n"
+"\n"
+"Creates context for decompressing frames directly from a connected stream socket.\n"
+"Only data belonging to the current frame is received, i.e. the socket can be used for\n"
+"other purposes in between frames.\n"
+"\n"
+"Args:\n"
+"    fd (int): File descriptor of socket (which must remain open whilst in use)");
+#define FUNC_DEF_CREATE_SOCKET_DECOMPRESSOR {"create_socket_decompressor",\
+                                             (PyCFunction)_lz4framed_create_socket_decompressor, METH_VARARGS,\
+                                             _lz4framed_create_socket_decompressor__doc__}
+static PyObject*
+_lz4framed_create_socket_decompressor(PyObject *self, PyObject *args) {
+    _lz4f_sdctx_t *sdctx = NULL;
+    PyObject *ctx_capsule;
+    int fd;
+    UNUSED(self);
+
+    if (!PyArg_ParseTuple(args, "i:create_socket_decompressor", &fd)) {
+        goto bail;
+    }
+    if (fd < 0) {
+        PyErr_Format(PyExc_ValueError, "fd (%d) invalid", fd);
+        goto bail;
+    }
+    if (NULL == (sdctx = PyMem_New(_lz4f_sdctx_t, 1))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    sdctx->fd = fd;
+    sdctx->ctx = NULL;
+    sdctx->input_size = SOCKET_INPUT_SIZE;
+    sdctx->input_pos = sdctx->input_len = 0;
+    sdctx->input_hint = SOCKET_HEADER_HINT;
+    sdctx->output_size = 0;
+#ifdef WITH_THREAD
+    sdctx->lock = NULL;
+#endif
+    if (NULL == (sdctx->input = malloc(sdctx->input_size))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+#ifdef WITH_THREAD
+    if (NULL == (sdctx->lock = PyThread_allocate_lock())) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate lock");
+        goto bail;
+    }
+#endif
+    BAIL_ON_LZ4_ERROR(LZ4F_createDecompressionContext(&(sdctx->ctx), LZ4F_VERSION));
+    BAIL_ON_NULL(ctx_capsule = PyCapsule_New(sdctx, SOCKET_DECOMPRESSOR_CAPSULE_NAME, _sdctx_capsule_destructor));
+    return ctx_capsule;
+
+bail:
+    // this must NOT be freed once capsule exists (since destructor responsible for freeing)
+    if (sdctx) {
+        LZ4F_freeDecompressionContext(sdctx->ctx);
+        free(sdctx->input);
+#ifdef WITH_THREAD
+        if (sdctx->lock) {
+            PyThread_free_lock(sdctx->lock);
+        }
+#endif
+        PyMem_Del(sdctx);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_socket_decompress_recv__doc__,
+"socket_decompress_recv(ctx, timeout=-1) -> list\n"
+"\n"
+"Receives and decompresses data from the socket, returning the uncompressed result as\n"
+"a list of chunks (of up to block size each), with the last element being input_hint\n"
+"as per decompress_update(). Once input_hint is zero, the frame is complete and the\n"
+"next call starts receiving the next frame. Returns as soon as some output has been\n"
+"produced, i.e. without waiting for more data. For non-blocking sockets (or when\n"
+"timeout is zero) the list can contain no chunks.\n"
+"\n"
+"Args:\n"
+"    ctx: Socket decompression context\n"
+"    timeout (float): Seconds to wait each time the socket is not readable. Only\n"
+"                     applies to non-blocking sockets (e.g. ones with a timeout set).\n"
+"                     Negative means no limit and zero means not to wait at all.\n"
+"\n"
+"Raises:\n"
+"    Lz4FramedNoDataError: If the connection was closed before the frame was complete\n"
+"    Lz4FramedError: If a decompression failure occured\n"
+"    OSError: If receiving failed (including ETIMEDOUT if timeout was reached)");
+#define FUNC_DEF_SOCKET_DECOMPRESS_RECV {"socket_decompress_recv", (PyCFunction)_lz4framed_socket_decompress_recv,\
+                                         METH_VARARGS | METH_KEYWORDS, _lz4framed_socket_decompress_recv__doc__}
+static PyObject*
+_lz4framed_socket_decompress_recv(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"ctx", "timeout", NULL};
+
+    _lz4f_sdctx_t *sdctx = NULL;
+    PyObject *ctx_capsule;
+    double timeout = -1;
+    int timeout_ms;
+    PyObject *list = NULL;          // function return
+    PyObject *chunk = NULL;
+    PyObject *size_hint = NULL;     // python object of input_hint
+    size_t chunk_len = 0;
+    size_t chunk_written = 0;       // how much of current chunk has been filled
+    size_t lz4_error = 0;
+    int result;
+    LZ4FRAMED_LOCK_FLAG;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|d:socket_decompress_recv", keywords, &ctx_capsule, &timeout)) {
+        goto bail;
+    }
+    if (!PyCapsule_IsValid(ctx_capsule, SOCKET_DECOMPRESSOR_CAPSULE_NAME)) {
+        PyErr_SetString(PyExc_ValueError, "ctx invalid");
+        goto bail;
+    }
+    // Guaranteed to succeed due to PyCapsule_IsValid check above
+    sdctx = PyCapsule_GetPointer(ctx_capsule, SOCKET_DECOMPRESSOR_CAPSULE_NAME);
+    timeout_ms = _socket_timeout_ms(timeout);
+
+    BAIL_ON_NULL(list = PyList_New(0));
+
+    ENTER_LZ4FRAMED(sdctx);
+
+    while (1) {
+        // (no output until header has been decoded)
+        if (!chunk && sdctx->output_size) {
+            chunk_len = sdctx->output_size;
+            BAIL_ON_NULL(chunk = PyBytes_FromStringAndSize(NULL, chunk_len));
+            chunk_written = 0;
+        }
+        Py_BEGIN_ALLOW_THREADS;
+        result = _socket_decompress(sdctx, chunk ? PyBytes_AS_STRING(chunk) : NULL, chunk_len, &chunk_written,
+                                    PyList_GET_SIZE(list) > 0, timeout_ms, &lz4_error);
+        Py_END_ALLOW_THREADS;
+
+        switch (result) {
+            case 0:
+                break;
+            case EAGAIN:
+                goto done;
+            case EINTR:
+                BAIL_ON_NONZERO(PyErr_CheckSignals());
+                continue;
+            case SOCKET_EOF:
+                PyErr_SetNone(LZ4FNoDataError);
+                goto bail;
+            case SOCKET_LZ4_ERROR:
+                _lz4framed_set_lz4_error(lz4_error);
+                goto bail;
+            default:
+                errno = result;
+                PyErr_SetFromErrno(PyExc_OSError);
+                goto bail;
+        }
+
+        if (!sdctx->input_hint) {
+            break;
+        } else if (chunk && chunk_written == chunk_len) {
+            BAIL_ON_NONZERO(PyList_Append(list, chunk));
+            Py_CLEAR(chunk);
+        } else if (chunk || !sdctx->output_size) {
+            // no more input ready
+            break;
+        }
+    }
+
+done:
+    // append & reduce size of final chunk (if contains any data)
+    if (chunk && chunk_written) {
+        BAIL_ON_NONZERO(_PyBytes_Resize(&chunk, chunk_written));
+        BAIL_ON_NONZERO(PyList_Append(list, chunk));
+    }
+    BAIL_ON_NULL(size_hint = PyLong_FromSize_t(sdctx->input_hint));
+    BAIL_ON_NONZERO(PyList_Append(list, size_hint));
+    // prepare for next frame
+    if (!sdctx->input_hint) {
+        sdctx->input_hint = SOCKET_HEADER_HINT;
+        sdctx->output_size = 0;
+    }
+
+    EXIT_LZ4FRAMED(sdctx);
+    Py_CLEAR(chunk);
+    Py_CLEAR(size_hint);
+    return list;
+
+bail:
+    EXIT_LZ4FRAMED(sdctx);
+    Py_XDECREF(chunk);
+    Py_XDECREF(size_hint);
+    Py_XDECREF(list);
+    return NULL;
+}
+
+#define FUNC_DEFS_SOCKET FUNC_DEF_CREATE_SOCKET_COMPRESSOR, FUNC_DEF_SOCKET_COMPRESS_UPDATE,\
+                         FUNC_DEF_SOCKET_COMPRESS_FLUSH, FUNC_DEF_SOCKET_COMPRESS_END, FUNC_DEF_SOCKET_SEND_PENDING,\
+                         FUNC_DEF_CREATE_SOCKET_DECOMPRESSOR, FUNC_DEF_SOCKET_DECOMPRESS_RECV,
+#else
+#define FUNC_DEFS_SOCKET
+#endif  // LZ4FRAMED_HAVE_SOCKET
+
+/******************************************************************************/
+
+PyDoc_STRVAR(_lz4framed_set_thread_pool_size__doc__,
+"set_thread_pool_size(size)\n"
+"\n"
+"Sets the number of workers in the thread pool shared by all multi-threaded functions\n"
+"(e.g. compress() with threads). The pool is started on first use. Tasks already queued\n"
+"are completed by the current workers before the pool is resized.\n"
+"\n"
+"Args:\n"
+"    size (int): Number of workers, with zero meaning number of online CPUs (the default)\n"
+"\n"
+"Raises:\n"
+"    OSError: If the pool could not be resized (e.g. when called from within a pool task)");
+#define FUNC_DEF_SET_THREAD_POOL_SIZE {"set_thread_pool_size", (PyCFunction)_lz4framed_set_thread_pool_size,\
+                                       METH_VARARGS, _lz4framed_set_thread_pool_size__doc__}
+static PyObject*
+_lz4framed_set_thread_pool_size(PyObject *self, PyObject *args) {
+    int size;
+    int result;
+    UNUSED(self);
+
+    if (!PyArg_ParseTuple(args, "i:set_thread_pool_size", &size)) {
+        goto bail;
+    }
+    if (size < 0) {
+        PyErr_Format(PyExc_ValueError, "size (%d) invalid", size);
+        goto bail;
+    }
+    // might have to wait for queued tasks
+    Py_BEGIN_ALLOW_THREADS;
+    result = pool_set_size((unsigned)size);
+    Py_END_ALLOW_THREADS;
+    if (result) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        goto bail;
+    }
+
+    Py_RETURN_NONE;
+
+bail:
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_get_thread_pool_stats__doc__,
+"get_thread_pool_stats() -> dict\n"
+"\n"
+"Returns statistics of the shared thread pool:\n"
+"    size (int)          - Number of workers (or how many will be started on first use)\n"
+"    queued (int)        - Tasks waiting to be run\n"
+"    active (int)        - Tasks currently running\n"
+"    submitted (int)     - Total tasks submitted\n"
+"    completed (int)     - Total tasks run\n"
+"    stolen (int)        - Total tasks run by a worker other than the one they were queued on\n"
+"    max_queued (int)    - Highest number of waiting tasks seen\n"
+"    queue_depths (list) - Number of tasks waiting in each running worker's queue");
+#define FUNC_DEF_GET_THREAD_POOL_STATS {"get_thread_pool_stats", (PyCFunction)_lz4framed_get_thread_pool_stats,\
+                                        METH_NOARGS, _lz4framed_get_thread_pool_stats__doc__}
+static PyObject*
+_lz4framed_get_thread_pool_stats(PyObject *self, PyObject *unused) {
+    pool_stats_t stats;
+    unsigned long long *depths = NULL;
+    unsigned depths_len;
+    unsigned count;
+    unsigned i;
+    PyObject *dict = NULL;
+    PyObject *item = NULL;
+    UNUSED(self);
+    UNUSED(unused);
+
+    // workers might be added concurrently, in which case only the first depths_len are reported
+    depths_len = pool_get_size();
+    if (NULL == (depths = PyMem_New(unsigned long long, depths_len))) {
+        PyErr_NoMemory();
+        goto bail;
+    }
+    count = pool_get_stats(&stats, depths, depths_len);
+
+    BAIL_ON_NULL(dict = PyDict_New());
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLong(stats.size));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "size", item));
+    Py_CLEAR(item);
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLongLong(stats.queued));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "queued", item));
+    Py_CLEAR(item);
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLongLong(stats.active));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "active", item));
+    Py_CLEAR(item);
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLongLong(stats.submitted));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "submitted", item));
+    Py_CLEAR(item);
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLongLong(stats.completed));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "completed", item));
+    Py_CLEAR(item);
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLongLong(stats.stolen));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "stolen", item));
+    Py_CLEAR(item);
+    BAIL_ON_NULL(item = PyLong_FromUnsignedLongLong(stats.max_queued));
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "max_queued", item));
+    Py_CLEAR(item);
+
+    count = MIN(count, depths_len);
+    BAIL_ON_NULL(item = PyList_New(count));
+    for (i = 0; i < count; i++) {
+        PyObject *depth;
+        BAIL_ON_NULL(depth = PyLong_FromUnsignedLongLong(depths[i]));
+        PyList_SET_ITEM(item, i, depth);
+    }
+    BAIL_ON_NONZERO(PyDict_SetItemString(dict, "queue_depths", item));
+    Py_CLEAR(item);
+
+    PyMem_Del(depths);
+    return dict;
+
+bail:
+    // necessary for item if dict assignment fails
+    Py_XDECREF(item);
+    Py_XDECREF(dict);
+    PyMem_Del(depths);
+    return NULL;
+}
+
+/******************************************************************************/
+
+#ifdef WITH_THREAD
+
+/* Asynchronous operations run as tasks on the shared thread pool (i.e. without the GIL). Each completed job is appended
+ * to a single completion queue, drained via _async_completed(), so that one Python thread can resolve the futures of
+ * all outstanding jobs.
+ */
+typedef enum {
+    ASYNC_COMPRESS,
+    ASYNC_DECOMPRESS,
+    ASYNC_COMPRESS_UPDATE,
+    ASYNC_COMPRESS_FLUSH,
+    ASYNC_DECOMPRESS_UPDATE,
+    ASYNC_DECOMPRESS_INTO
+} _async_op_t;
+
+typedef enum {
+    ASYNC_OK,
+    ASYNC_ERROR_LZ4,
+    ASYNC_ERROR_NO_MEMORY,
+    ASYNC_ERROR_INCOMPLETE,
+    ASYNC_ERROR_SIZE_MISMATCH
+} _async_status_t;
+
+typedef struct _async_job_s _async_job_t;
+struct _async_job_s {
+    pool_task_t task;               // must be first member
+    _async_op_t op;
+    PyObject *future;               // owned reference
+    PyObject *ctx_capsule;          // owned reference (context operations only), keeping cctx/dctx alive
+    _lz4f_cctx_t *cctx;
+    _lz4f_dctx_t *dctx;
+    Py_buffer input;
+    int has_input;
+    Py_buffer target;               // decompress into only
+    int has_target;
+    LZ4F_preferences_t prefs;       // compress only
+    size_t buffer_size;             // decompression: output size to start with (if frame does not specify it)
+    PyObject *output;               // compression: allocated up front with worst-case size
+    char *output_str;
+    char *raw_output;               // decompression: grown (without GIL) as required
+    size_t output_len;              // capacity before & amount written after running
+    size_t input_hint;              // decompress update only
+    _async_status_t status;
+    size_t lz4_error;
+    _async_job_t *next;
+};
+
+static struct {
+    PyThread_type_lock lock;        // protects all other members
+    PyThread_type_lock ready;       // held (i.e. waited on) unless signalled
+    int signalled;
+    _async_job_t *head;
+    _async_job_t *tail;
+} async_completed = {NULL, NULL, 0, NULL, NULL};
+
+// Sets up completion queue on first use. Requires GIL. Returns non-zero (with exception set) on failure.
+static int _async_init(void) {
+    if (NULL != async_completed.lock) {
+        return 0;
+    }
+    if (NULL == (async_completed.ready = PyThread_allocate_lock())) {
+        goto bail;
+    }
+    PyThread_acquire_lock(async_completed.ready, 1);
+    if (NULL == (async_completed.lock = PyThread_allocate_lock())) {
+        PyThread_release_lock(async_completed.ready);
+        PyThread_free_lock(async_completed.ready);
+        async_completed.ready = NULL;
+        goto bail;
+    }
+    return 0;
+
+bail:
+    PyErr_SetString(PyExc_RuntimeError, "Failed to allocate lock");
+    return -1;
+}
+
+// (No GIL)
+static void _async_complete(_async_job_t *job) {
+    job->next = NULL;
+    PyThread_acquire_lock(async_completed.lock, 1);
+    if (async_completed.tail) {
+        async_completed.tail->next = job;
+    } else {
+        async_completed.head = job;
+    }
+    async_completed.tail = job;
+    if (!async_completed.signalled) {
+        async_completed.signalled = 1;
+        PyThread_release_lock(async_completed.ready);
+    }
+    PyThread_release_lock(async_completed.lock);
+}
+
+// Same as decompress() but (re-)allocating output via malloc so can run without GIL
+static void _async_decompress(_async_job_t *job) {
+    LZ4F_decompressionContext_t ctx = NULL;
+    LZ4F_decompressOptions_t opt = {0, {0}};
+    LZ4F_frameInfo_t frame_info;
+    const char *input_pos = job->input.buf;
+    size_t input_remaining = job->input.len;
+    size_t input_read = input_remaining;
+    size_t input_size_hint;
+    size_t output_len;
+    size_t output_pos = 0;
+    size_t output_written;
+    char *output;
+
+    if (LZ4F_isError(job->lz4_error = LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)) ||
+        LZ4F_isError(job->lz4_error = LZ4F_getFrameInfo(ctx, &frame_info, input_pos, &input_read))) {
+        goto lz4_error;
+    }
+    input_pos += input_read;
+    input_remaining -= input_read;
+    if (frame_info.contentSize) {
+        output_len = frame_info.contentSize;
+        opt.stableDst = 1;
+    } else {
+        output_len = MAX(job->buffer_size, input_remaining);
+    }
+    if (NULL == (job->raw_output = malloc(output_len))) {
+        job->status = ASYNC_ERROR_NO_MEMORY;
+        goto bail;
+    }
+
+    while (1) {
+        input_read = input_remaining;
+        output_written = output_len - output_pos;
+        input_size_hint = LZ4F_decompress(ctx, job->raw_output + output_pos, &output_written, input_pos, &input_read,
+                                          &opt);
+        if (LZ4F_isError(input_size_hint)) {
+            job->lz4_error = input_size_hint;
+            goto lz4_error;
+        }
+        output_pos += output_written;
+        if (!input_size_hint) {
+            break;
+        }
+        input_pos += input_read;
+        input_remaining -= input_read;
+        if (!input_remaining) {
+            job->status = ASYNC_ERROR_INCOMPLETE;
+            goto bail;
+        }
+        // Output must not move if lz4 relies on it for linked blocks (i.e. with stableDst)
+        if (opt.stableDst) {
+            job->status = ASYNC_ERROR_SIZE_MISMATCH;
+            goto bail;
+        }
+        output_len *= 2;
+        if (NULL == (output = realloc(job->raw_output, output_len))) {
+            job->status = ASYNC_ERROR_NO_MEMORY;
+            goto bail;
+        }
+        job->raw_output = output;
+    }
+    job->output_len = output_pos;
+    LZ4F_freeDecompressionContext(ctx);
+    return;
+
+lz4_error:
+    job->status = ASYNC_ERROR_LZ4;
+bail:
+    LZ4F_freeDecompressionContext(ctx);
+}
+
+// Same as decompress_update() but producing a single output buffer
+static void _async_decompress_update(_async_job_t *job) {
+    const char *input_pos = job->input.buf;
+    size_t input_remaining = job->input.len;
+    size_t input_read;
+    size_t output_len = job->buffer_size;
+    size_t output_pos = 0;
+    size_t output_written;
+    char *output;
+
+    if (NULL == (job->raw_output = malloc(output_len))) {
+        job->status = ASYNC_ERROR_NO_MEMORY;
+        return;
+    }
+    job->input_hint = 1;
+    PyThread_acquire_lock(job->dctx->lock, 1);
+    while (input_remaining && job->input_hint) {
+        if (output_pos == output_len) {
+            output_len *= 2;
+            if (NULL == (output = realloc(job->raw_output, output_len))) {
+                job->status = ASYNC_ERROR_NO_MEMORY;
+                break;
+            }
+            job->raw_output = output;
+        }
+        input_read = input_remaining;
+        output_written = output_len - output_pos;
+        job->input_hint = LZ4F_decompress(job->dctx->ctx, job->raw_output + output_pos, &output_written, input_pos,
+                                          &input_read, NULL);
+        if (LZ4F_isError(job->input_hint)) {
+            job->status = ASYNC_ERROR_LZ4;
+            job->lz4_error = job->input_hint;
+            break;
+        }
+        output_pos += output_written;
+        input_pos += input_read;
+        input_remaining -= input_read;
+    }
+    PyThread_release_lock(job->dctx->lock);
+    job->output_len = output_pos;
+}
+
+static void _async_run(pool_task_t *task) {
+    _async_job_t *job = (_async_job_t*)task;
+    size_t result = 0;
+
+    switch (job->op) {
+        case ASYNC_COMPRESS:
+            result = LZ4F_compressFrame(job->output_str, job->output_len, job->input.buf, job->input.len, &job->prefs);
+            break;
+        case ASYNC_DECOMPRESS:
+            _async_decompress(job);
+            break;
+        case ASYNC_DECOMPRESS_UPDATE:
+            _async_decompress_update(job);
+            break;
+        case ASYNC_DECOMPRESS_INTO:
+            result = _decompress_into(job->input.buf, job->input.len, job->target.buf, job->target.len);
+            break;
+        case ASYNC_COMPRESS_UPDATE:
+            PyThread_acquire_lock(job->cctx->lock, 1);
+            result = LZ4F_compressUpdate(job->cctx->ctx, job->output_str, job->output_len, job->input.buf,
+                                         job->input.len, NULL);
+            PyThread_release_lock(job->cctx->lock);
+            break;
+        case ASYNC_COMPRESS_FLUSH:
+            PyThread_acquire_lock(job->cctx->lock, 1);
+            result = LZ4F_flush(job->cctx->ctx, job->output_str, job->output_len, NULL);
+            PyThread_release_lock(job->cctx->lock);
+            break;
+    }
+    if (job->op != ASYNC_DECOMPRESS && job->op != ASYNC_DECOMPRESS_UPDATE) {
+        if (LZ4F_isError(result)) {
+            job->status = ASYNC_ERROR_LZ4;
+            job->lz4_error = result;
+        } else {
+            job->output_len = result;
+        }
+    }
+    _async_complete(job);
+}
+
+// Requires GIL
+static void _async_job_free(_async_job_t *job) {
+    if (job->has_input) {
+        PyBuffer_Release(&job->input);
+    }
+    if (job->has_target) {
+        PyBuffer_Release(&job->target);
+    }
+    Py_XDECREF(job->future);
+    Py_XDECREF(job->ctx_capsule);
+    Py_XDECREF(job->output);
+    free(job->raw_output);
+    PyMem_Del(job);
+}
+
+static _async_job_t* _async_job_new(_async_op_t op, PyObject *future) {
+    _async_job_t *job;
+
+    if (_async_init()) {
+        return NULL;
+    }
+    if (NULL == (job = PyMem_New(_async_job_t, 1))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memset(job, 0, sizeof(*job));
+    job->task.func = _async_run;
+    job->op = op;
+    Py_INCREF(future);
+    job->future = future;
+    return job;
+}
+
+// Obtains (non-empty) input for job. Returns non-zero (with exception set) on failure.
+static int _async_job_input(_async_job_t *job, PyObject *input) {
+    if (PyObject_GetBuffer(input, &job->input, PyBUF_SIMPLE)) {
+        return -1;
+    }
+    job->has_input = 1;
+    if (job->input.len <= 0) {
+        PyErr_SetNone(LZ4FNoDataError);
+        return -1;
+    }
+    return 0;
+}
+
+// Context operations only (with compression prefs already applied via compress_begin())
+static int _async_job_ctx(_async_job_t *job, PyObject *ctx_capsule) {
+    const char *name = (job->op == ASYNC_DECOMPRESS_UPDATE) ? DECOMPRESSION_CAPSULE_NAME : COMPRESSION_CAPSULE_NAME;
+
+    if (!PyCapsule_IsValid(ctx_capsule, name)) {
+        PyErr_SetString(PyExc_ValueError, "ctx invalid");
+        return -1;
+    }
+    // Guaranteed to succeed due to PyCapsule_IsValid check above
+    if (job->op == ASYNC_DECOMPRESS_UPDATE) {
+        job->dctx = PyCapsule_GetPointer(ctx_capsule, name);
+    } else {
+        job->cctx = PyCapsule_GetPointer(ctx_capsule, name);
+    }
+    Py_INCREF(ctx_capsule);
+    job->ctx_capsule = ctx_capsule;
+    return 0;
+}
+
+static int _async_job_output(_async_job_t *job, size_t output_len) {
+    if (LZ4F_isError(output_len)) {
+        _lz4framed_set_lz4_error(output_len);
+        return -1;
+    }
+    if (NULL == (job->output = PyBytes_FromStringAndSize(NULL, output_len))) {
+        return -1;
+    }
+    job->output_str = PyBytes_AS_STRING(job->output);
+    job->output_len = output_len;
+    return 0;
+}
+
+// Hands job over to pool (or frees it on failure)
+static PyObject* _async_job_submit(_async_job_t *job) {
+    int result;
+    int submit_errno = 0;
+
+    // Runs inline if there is no pool
+    Py_BEGIN_ALLOW_THREADS;
+    if ((result = pool_submit(&job->task))) {
+        submit_errno = errno;
+    }
+    Py_END_ALLOW_THREADS;
+    if (result) {
+        errno = submit_errno;
+        PyErr_SetFromErrno(PyExc_OSError);
+        _async_job_free(job);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// Returns (future, result, exception) tuple for completed job (and frees the job). Requires GIL.
+static PyObject* _async_job_finish(_async_job_t *job) {
+    PyObject *result = NULL;
+    PyObject *exception = NULL;
+    PyObject *type, *traceback;
+    PyObject *tuple;
+
+    switch (job->status) {
+        case ASYNC_OK:
+            if (job->op == ASYNC_DECOMPRESS) {
+                result = PyBytes_FromStringAndSize(job->raw_output, job->output_len);
+            } else if (job->op == ASYNC_DECOMPRESS_UPDATE) {
+#if PY_MAJOR_VERSION >= 3
+                result = Py_BuildValue("(y#n)", job->raw_output, (Py_ssize_t)job->output_len,
+                                       (Py_ssize_t)job->input_hint);
+#else
+                result = Py_BuildValue("(s#n)", job->raw_output, (Py_ssize_t)job->output_len,
+                                       (Py_ssize_t)job->input_hint);
+#endif
+            } else if (job->op == ASYNC_DECOMPRESS_INTO) {
+                result = PyLong_FromSize_t(job->output_len);
+            } else if (!_PyBytes_Resize(&job->output, job->output_len)) {
+                result = job->output;
+                job->output = NULL;
+            }
+            break;
+        case ASYNC_ERROR_LZ4:
+            _lz4framed_set_lz4_error(job->lz4_error);
+            break;
+        case ASYNC_ERROR_NO_MEMORY:
+            PyErr_NoMemory();
+            break;
+        case ASYNC_ERROR_INCOMPLETE:
+            PyErr_SetString(PyExc_ValueError, "frame incomplete");
+            break;
+        case ASYNC_ERROR_SIZE_MISMATCH:
+            PyErr_SetString(PyExc_ValueError, "lz4frame contentSize mismatch");
+            break;
+    }
+    if (NULL == result) {
+        PyErr_Fetch(&type, &exception, &traceback);
+        PyErr_NormalizeException(&type, &exception, &traceback);
+        Py_XDECREF(type);
+        Py_XDECREF(traceback);
+    }
+    tuple = PyTuple_Pack(3, job->future, result ? result : Py_None, exception ? exception : Py_None);
+    Py_XDECREF(result);
+    Py_XDECREF(exception);
+    _async_job_free(job);
+    return tuple;
+}
+
+PyDoc_STRVAR(_lz4framed_async_completed__doc__,
+"_async_completed() -> list\n"
+"\n"
+"Waits for at least one asynchronous operation to complete and returns a (future,\n"
+"result, exception) tuple for each completed operation. Used by the (single) thread\n"
+"resolving the futures returned by compress_async() etc.");
+#define FUNC_DEF_ASYNC_COMPLETED {"_async_completed", (PyCFunction)_lz4framed_async_completed, METH_NOARGS,\
+                                  _lz4framed_async_completed__doc__}
+static PyObject*
+_lz4framed_async_completed(PyObject *self, PyObject *unused) {
+    _async_job_t *jobs;
+    _async_job_t *job;
+    Py_ssize_t count = 0;
+    Py_ssize_t i;
+    PyObject *list = NULL;
+    UNUSED(self);
+    UNUSED(unused);
+
+    BAIL_ON_NONZERO(_async_init());
+
+    Py_BEGIN_ALLOW_THREADS;
+    PyThread_acquire_lock(async_completed.ready, 1);
+    PyThread_acquire_lock(async_completed.lock, 1);
+    jobs = async_completed.head;
+    async_completed.head = async_completed.tail = NULL;
+    async_completed.signalled = 0;
+    PyThread_release_lock(async_completed.lock);
+    Py_END_ALLOW_THREADS;
+
+    for (job = jobs; job; job = job->next) {
+        count++;
+    }
+    if (NULL == (list = PyList_New(count))) {
+        // hand jobs back for next call
+        while (jobs) {
+            job = jobs;
+            jobs = jobs->next;
+            _async_complete(job);
+        }
+        goto bail;
+    }
+    for (i = 0; i < count; i++) {
+        PyObject *tuple;
+        job = jobs;
+        jobs = jobs->next;
+        if (NULL == (tuple = _async_job_finish(job))) {
+            // Only likely on memory exhaustion, in which case future cannot be resolved
+            PyErr_Clear();
+            Py_INCREF(Py_None);
+            tuple = Py_None;
+        }
+        PyList_SET_ITEM(list, i, tuple);
+    }
+    return list;
+
+bail:
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_compress_async__doc__,
+"_compress_async(future, b, block_size_id=LZ4F_BLOCKSIZE_DEFAULT, block_mode_linked=True,\n"
+"                checksum=False, level=0)\n"
+"\n"
+"Queues compress() operation, the result of which is later returned by _async_completed().\n"
+"b can be any object supporting the buffer protocol and must not be modified until the\n"
+"operation has completed.");
+#define FUNC_DEF_COMPRESS_ASYNC {"_compress_async", (PyCFunction)_lz4framed_compress_async,\
+                                 METH_VARARGS | METH_KEYWORDS, _lz4framed_compress_async__doc__}
+static PyObject*
+_lz4framed_compress_async(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "OO|iiii:_compress_async";
+    static char *keywords[] = {"future", "b", "block_size_id", "block_mode_linked", "checksum", "level", NULL};
+
+    _async_job_t *job = NULL;
+    PyObject *future, *input;
+    int block_id = LZ4F_default;
+    int block_mode_linked = 1;
+    int checksum = 0;
+    int compression_level = LZ4_COMPRESSION_MIN;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &future, &input, &block_id, &block_mode_linked,
+                                     &checksum, &compression_level)) {
+        goto bail;
+    }
+    BAIL_ON_NULL(job = _async_job_new(ASYNC_COMPRESS, future));
+    BAIL_ON_NONZERO(_async_job_input(job, input));
+    job->prefs = prefs_defaults;
+    BAIL_ON_NONZERO(_lz4framed_set_prefs(&job->prefs, block_id, block_mode_linked, checksum, compression_level));
+    job->prefs.frameInfo.contentSize = job->input.len;
+    BAIL_ON_NONZERO(_async_job_output(job, LZ4F_compressFrameBound(job->input.len, &job->prefs)));
+
+    return _async_job_submit(job);
+
+bail:
+    if (job) {
+        _async_job_free(job);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_decompress_async__doc__,
+"_decompress_async(future, b, buffer_size=1024)\n"
+"\n"
+"Queues decompress() operation, the result of which is later returned by _async_completed().\n"
+"b can be any object supporting the buffer protocol and must not be modified until the\n"
+"operation has completed.");
+#define FUNC_DEF_DECOMPRESS_ASYNC {"_decompress_async", (PyCFunction)_lz4framed_decompress_async,\
+                                   METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_async__doc__}
+static PyObject*
+_lz4framed_decompress_async(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "OO|i:_decompress_async";
+    static char *keywords[] = {"future", "b", "buffer_size", NULL};
+
+    _async_job_t *job = NULL;
+    PyObject *future, *input;
+    int buffer_size = 1024;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &future, &input, &buffer_size)) {
+        goto bail;
+    }
+    if (buffer_size <= 0) {
+        PyErr_Format(PyExc_ValueError, "buffer_size (%d) invalid", buffer_size);
+        goto bail;
+    }
+    BAIL_ON_NULL(job = _async_job_new(ASYNC_DECOMPRESS, future));
+    BAIL_ON_NONZERO(_async_job_input(job, input));
+    job->buffer_size = buffer_size;
+
+    return _async_job_submit(job);
+
+bail:
+    if (job) {
+        _async_job_free(job);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_compress_update_async__doc__,
+"_compress_update_async(future, ctx, b)\n"
+"\n"
+"Queues compress_update() operation, the result of which is later returned by\n"
+"_async_completed(). Operations on the same context are NOT ordered, i.e. the caller must\n"
+"wait for one to complete before queueing the next. b can be any object supporting the\n"
+"buffer protocol and must not be modified until the operation has completed.");
+#define FUNC_DEF_COMPRESS_UPDATE_ASYNC {"_compress_update_async", (PyCFunction)_lz4framed_compress_update_async,\
+                                        METH_VARARGS, _lz4framed_compress_update_async__doc__}
+static PyObject*
+_lz4framed_compress_update_async(PyObject *self, PyObject *args) {
+    _async_job_t *job = NULL;
+    PyObject *future, *ctx_capsule, *input;
+    UNUSED(self);
+
+    if (!PyArg_ParseTuple(args, "OOO:_compress_update_async", &future, &ctx_capsule, &input)) {
+        goto bail;
+    }
+    BAIL_ON_NULL(job = _async_job_new(ASYNC_COMPRESS_UPDATE, future));
+    BAIL_ON_NONZERO(_async_job_ctx(job, ctx_capsule));
+    BAIL_ON_NONZERO(_async_job_input(job, input));
+    BAIL_ON_NONZERO(_async_job_output(job, LZ4F_compressBound(job->input.len, &(job->cctx->prefs))));
+
+    return _async_job_submit(job);
+
+bail:
+    if (job) {
+        _async_job_free(job);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_compress_flush_async__doc__,
+"_compress_flush_async(future, ctx)\n"
+"\n"
+"Queues compress_flush() operation, the result of which is later returned by\n"
+"_async_completed(). (See _compress_update_async() regarding ordering.)");
+#define FUNC_DEF_COMPRESS_FLUSH_ASYNC {"_compress_flush_async", (PyCFunction)_lz4framed_compress_flush_async,\
+                                       METH_VARARGS, _lz4framed_compress_flush_async__doc__}
+static PyObject*
+_lz4framed_compress_flush_async(PyObject *self, PyObject *args) {
+    _async_job_t *job = NULL;
+    PyObject *future, *ctx_capsule;
+    UNUSED(self);
+
+    if (!PyArg_ParseTuple(args, "OO:_compress_flush_async", &future, &ctx_capsule)) {
+        goto bail;
+    }
+    BAIL_ON_NULL(job = _async_job_new(ASYNC_COMPRESS_FLUSH, future));
+    BAIL_ON_NONZERO(_async_job_ctx(job, ctx_capsule));
+    BAIL_ON_NONZERO(_async_job_output(job, LZ4F_compressBound(0, &(job->cctx->prefs))));
+
+    return _async_job_submit(job);
+
+bail:
+    if (job) {
+        _async_job_free(job);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_decompress_update_async__doc__,
+"_decompress_update_async(future, ctx, b, buffer_len=65536)\n"
+"\n"
+"Queues decompress_update() operation, the result of which is later returned by\n"
+"_async_completed() as a (bytes, input_hint) tuple. buffer_len is the initial output\n"
+"buffer size. (See _compress_update_async() regarding ordering & input.)");
+#define FUNC_DEF_DECOMPRESS_UPDATE_ASYNC {"_decompress_update_async", (PyCFunction)_lz4framed_decompress_update_async,\
+                                          METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_update_async__doc__}
+static PyObject*
+_lz4framed_decompress_update_async(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "OOO|i:_decompress_update_async";
+    static char *keywords[] = {"future", "ctx", "b", "buffer_len", NULL};
+
+    _async_job_t *job = NULL;
+    PyObject *future, *ctx_capsule, *input;
+    int buffer_len = 65536;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &future, &ctx_capsule, &input, &buffer_len)) {
+        goto bail;
+    }
+    if (buffer_len <= 0) {
+        PyErr_Format(PyExc_ValueError, "buffer_len (%d) invalid", buffer_len);
+        goto bail;
+    }
+    BAIL_ON_NULL(job = _async_job_new(ASYNC_DECOMPRESS_UPDATE, future));
+    BAIL_ON_NONZERO(_async_job_ctx(job, ctx_capsule));
+    BAIL_ON_NONZERO(_async_job_input(job, input));
+    job->buffer_size = buffer_len;
+
+    return _async_job_submit(job);
+
+bail:
+    if (job) {
+        _async_job_free(job);
+    }
+    return NULL;
+}
+
+PyDoc_STRVAR(_lz4framed_decompress_into_async__doc__,
+"_decompress_into_async(future, b, buffer)\n"
+"\n"
+"Queues decompress_into() operation, the result of which is later returned by\n"
+"_async_completed(). Neither b nor buffer may be modified (or resized) until the operation\n"
+"has completed.");
+#define FUNC_DEF_DECOMPRESS_INTO_ASYNC {"_decompress_into_async", (PyCFunction)_lz4framed_decompress_into_async,\
+                                        METH_VARARGS | METH_KEYWORDS, _lz4framed_decompress_into_async__doc__}
+static PyObject*
+_lz4framed_decompress_into_async(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static const char *format = "OOO:_decompress_into_async";
+    static char *keywords[] = {"future", "b", "buffer", NULL};
+
+    _async_job_t *job = NULL;
+    PyObject *future, *input, *target;
+    UNUSED(self);
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, format, keywords, &future, &input, &target)) {
+        goto bail;
+    }
+    BAIL_ON_NULL(job = _async_job_new(ASYNC_DECOMPRESS_INTO, future));
+    BAIL_ON_NONZERO(_async_job_input(job, input));
+    BAIL_ON_NONZERO(PyObject_GetBuffer(target, &job->target, PyBUF_WRITABLE));
+    job->has_target = 1;
+
+    return _async_job_submit(job);
+
+bail:
+    if (job) {
+        _async_job_free(job);
+    }
+    return NULL;
+}
+
+#define FUNC_DEFS_ASYNC FUNC_DEF_ASYNC_COMPLETED, FUNC_DEF_COMPRESS_ASYNC, FUNC_DEF_DECOMPRESS_ASYNC,\
+                        FUNC_DEF_COMPRESS_UPDATE_ASYNC, FUNC_DEF_COMPRESS_FLUSH_ASYNC,\
+                        FUNC_DEF_DECOMPRESS_UPDATE_ASYNC, FUNC_DEF_DECOMPRESS_INTO_ASYNC,
+#else
+#define FUNC_DEFS_ASYNC
+#endif  // WITH_THREAD
+
 /******************************************************************************/
 
 static PyMethodDef Lz4framedMethods[] = {
-    FUNC_DEF_GET_BLOCK_SIZE, FUNC_DEF_COMPRESS, FUNC_DEF_DECOMPRESS, FUNC_DEF_CREATE_CCTX, FUNC_DEF_CREATE_DCTX,
-    FUNC_DEF_COMPRESS_BEGIN, FUNC_DEF_COMPRESS_UPDATE, FUNC_DEF_COMPRESS_END, FUNC_DEF_GET_FRAME_INFO,
-    FUNC_DEF_DECOMPRESS_UPDATE,
+    FUNC_DEF_GET_BLOCK_SIZE, FUNC_DEF_COMPRESS, FUNC_DEF_DECOMPRESS, FUNC_DEF_DECOMPRESS_INTO, FUNC_DEF_CREATE_CCTX,
+    FUNC_DEF_CREATE_DCTX,
+    FUNC_DEF_COMPRESS_BEGIN, FUNC_DEF_COMPRESS_UPDATE, FUNC_DEF_COMPRESS_FLUSH, FUNC_DEF_COMPRESS_END,
+    FUNC_DEF_GET_FRAME_INFO, FUNC_DEF_DECOMPRESS_UPDATE, FUNC_DEF_COMPRESS_FILE, FUNC_DEF_DECOMPRESS_FILE,
+    FUNC_DEF_SCAN_FRAMES, FUNC_DEF_VERIFY, FUNC_DEF_COMPRESS_BLOCK, FUNC_DEF_DECOMPRESS_BLOCK,
+    FUNC_DEF_COMPRESS_BLOCK_DEST_SIZE, FUNC_DEF_COMPRESS_DEST_SIZE, FUNC_DEF_SET_THREAD_POOL_SIZE,
+    FUNC_DEF_GET_THREAD_POOL_STATS, FUNC_DEFS_SOCKET FUNC_DEFS_ASYNC
     {NULL, NULL, 0, NULL}
 };
 
@@ -1009,12 +5747,21 @@ init_lz4framed(void)
     BAIL_ON_NULL(LZ4FError = PyErr_NewExceptionWithDoc("_lz4framed.Lz4FramedError", __lz4f_error__doc__, NULL, NULL));
     BAIL_ON_NULL(LZ4FNoDataError = PyErr_NewExceptionWithDoc("_lz4framed.Lz4FramedNoDataError",
                                                              __lz4f_no_data_error__doc__, NULL, NULL));
+    BAIL_ON_NULL(LZ4FOutputLimitError = PyErr_NewExceptionWithDoc("_lz4framed.Lz4FramedOutputLimitError",
+                                                                  __lz4f_output_limit_error__doc__, LZ4FError, NULL));
+    BAIL_ON_NONZERO(_lazy_types_init());
     Py_INCREF(LZ4FError);
     Py_INCREF(LZ4FNoDataError);
+    Py_INCREF(LZ4FOutputLimitError);
+    Py_INCREF(&LazyBufferType);
+    Py_INCREF(&LazyCacheType);
 
     // non-zero returns indicate error
     if (PyModule_AddObject(module, "Lz4FramedError", LZ4FError) ||
         PyModule_AddObject(module, "Lz4FramedNoDataError", LZ4FNoDataError) ||
+        PyModule_AddObject(module, "Lz4FramedOutputLimitError", LZ4FOutputLimitError) ||
+        PyModule_AddObject(module, "LazyLz4Buffer", (PyObject*)&LazyBufferType) ||
+        PyModule_AddObject(module, "LazyLz4BufferCache", (PyObject*)&LazyCacheType) ||
         PyModule_AddStringConstant(module, "__version__", EXPAND_AND_QUOTE(VERSION)) ||
         PyModule_AddStringConstant(module, "LZ4_VERSION", LZ4_VERSION_STRING) ||
         PyModule_AddIntMacro(module, LZ4F_VERSION) ||
@@ -1042,6 +5789,7 @@ init_lz4framed(void)
         PyModule_AddIntConstant(module, "LZ4F_BLOCKSIZE_MAX1MB", LZ4F_max1MB) ||
         PyModule_AddIntConstant(module, "LZ4F_BLOCKSIZE_MAX4MB", LZ4F_max4MB) ||
         PyModule_AddIntConstant(module, "LZ4F_COMPRESSION_MIN", LZ4_COMPRESSION_MIN) ||
+        PyModule_AddIntConstant(module, "LZ4F_COMPRESSION_FASTEST", LZ4_COMPRESSION_FASTEST) ||
         PyModule_AddIntConstant(module, "LZ4F_COMPRESSION_MIN_HC", LZ4_COMPRESSION_MIN_HC) ||
         PyModule_AddIntConstant(module, "LZ4F_COMPRESSION_MAX", LZ4_COMPRESSION_MAX)) {
         goto bail;
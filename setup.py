@@ -56,6 +56,7 @@ setup(
             'lz4/lz4hc.c',
             'lz4/lz4frame.c',
             'lz4/xxhash.c',
+            'lz4framed/pool.c',
             'lz4framed/py-lz4framed.c',
         ], extra_compile_args=[
             '-Ilz4',
@@ -15,23 +15,61 @@
 
 """Note: These tests are not meant to verify all of lz4's behaviour, only the Python functionality"""
 
-from sys import version_info
-from unittest import TestCase
+from sys import version_info, executable
+from unittest import TestCase, skipIf
 from contextlib import contextmanager
-from io import BytesIO, SEEK_END
+from io import BytesIO, StringIO, SEEK_END
+from os import (path, close as os_close, open as os_open, O_RDONLY, mkdir, utime, devnull as os_devnull,
+                urandom, environ, pathsep)
+from shutil import rmtree
+from subprocess import call
+from tempfile import mkdtemp, TemporaryFile
+from struct import pack, unpack
+from threading import Thread
+from socket import socketpair
+from array import array
+from importlib import import_module
+try:
+    import numpy
+except ImportError:
+    numpy = None
 
 from lz4framed import (LZ4F_BLOCKSIZE_DEFAULT, LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX256KB, LZ4F_BLOCKSIZE_MAX1MB,
                        LZ4F_BLOCKSIZE_MAX4MB,
-                       LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MAX,
+                       LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MAX, LZ4F_COMPRESSION_FASTEST,
                        LZ4F_ERROR_GENERIC, LZ4F_ERROR_frameHeader_incomplete, LZ4F_ERROR_contentChecksum_invalid,
-                       LZ4F_ERROR_frameType_unknown, Lz4FramedError, Lz4FramedNoDataError,
-                       compress, decompress,
-                       create_compression_context, compress_begin, compress_update, compress_end,
+                       LZ4F_ERROR_frameType_unknown, LZ4F_ERROR_frameSize_wrong, LZ4F_ERROR_headerChecksum_invalid,
+                       LZ4F_ERROR_decompressionFailed, LZ4F_ERROR_dstMaxSize_tooSmall,
+                       Lz4FramedError, Lz4FramedNoDataError, Lz4FramedOutputLimitError,
+                       LazyLz4Buffer, LazyLz4BufferCache,
+                       compress, decompress, decompress_into, decompress_into_async,
+                       create_compression_context, compress_begin, compress_update, compress_flush, compress_end,
                        create_decompression_context, get_frame_info, decompress_update,
-                       get_block_size,
-                       Compressor, Decompressor)
+                       get_block_size, compress_file, decompress_file, scan_frames, verify, compress_block,
+                       decompress_block, compress_block_dest_size, compress_dest_size, compress_packets,
+                       set_thread_pool_size, get_thread_pool_stats,
+                       compress_async, decompress_async, compress_iter, decompress_iter, create_socket_compressor,
+                       Compressor, Decompressor, SocketCompressor, SocketDecompressor)
+from lz4framed.bench import bench, synthetic_data
+from lz4framed.indexed import IndexedReader
+from lz4framed.cache import CompressedCache
 
 PY2 = version_info[0] < 3
+SOURCE_DIR = path.dirname(path.abspath(__file__))
+ASYNC_SUPPORTED = version_info >= (3, 6)
+PICKLE5_SUPPORTED = version_info >= (3, 8)
+SOCKETS_SUPPORTED = create_socket_compressor is not None
+
+if not PY2:
+    from selectors import DefaultSelector, EVENT_READ, EVENT_WRITE
+
+if ASYNC_SUPPORTED:
+    from asyncio import StreamReader, new_event_loop
+    from lz4framed.aio import AsyncCompressor, AsyncDecompressor
+
+if PICKLE5_SUPPORTED:
+    from pickle import PickleBuffer
+    from lz4framed.pickling import dumps, loads
 
 SHORT_INPUT = b'abcdefghijklmnopqrstuvwxyz0123456789'
 LONG_INPUT = SHORT_INPUT * (10**5)
@@ -99,13 +137,90 @@ class TestCompress(TestHelperMixin, TestCase):
     def test_compress_level(self):
         with self.assertRaises(TypeError):
             compress(SHORT_INPUT, level='1')
-        with self.assertRaises(ValueError):
-            compress(SHORT_INPUT, level=-1)
+        for level in (LZ4F_COMPRESSION_FASTEST - 1, LZ4F_COMPRESSION_MAX + 1):
+            with self.assertRaises(ValueError):
+                compress(SHORT_INPUT, level=level)
         for level in range(LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MAX + 1):
             self.check_compress_short(level=level)
         # large input, fast & hc levels (levels > 10 (v1.7.5) are significantly slower)
         self.check_compress_long(level=0)
         self.check_compress_long(level=10)
+        # accelerated (with lower ratio)
+        for level in (-1, -10, LZ4F_COMPRESSION_FASTEST):
+            self.check_compress_short(level=level)
+            self.check_compress_long(level=level)
+            self.check_compress_long(level=level, threads=0)
+        self.assertGreater(len(compress(LONG_INPUT, level=-10)), len(compress(LONG_INPUT)))
+
+    def test_compress_shuffle(self):
+        for kwargs in ({'shuffle': -1}, {'shuffle': 256}, {'delta': True}):
+            with self.assertRaises(ValueError):
+                compress(SHORT_INPUT, **kwargs)
+        # slowly increasing 64-bit integers with remainder
+        data = b''.join(pack('<Q', 10**15 + i * 1000 + i % 7) for i in range(50000)) + b'xyz'
+        plain = compress(data)
+        for shuffle in (1, 3, 8, 13, 255):
+            for delta in (False, True):
+                for kwargs in ({}, {'block_size_id': LZ4F_BLOCKSIZE_MAX256KB, 'threads': 0}, {'checksum': True}):
+                    compressed = compress(data, shuffle=shuffle, delta=delta, **kwargs)
+                    self.assertEqual(decompress(compressed), data)
+                    self.assertEqual(decompress(compress(SHORT_INPUT, shuffle=shuffle, delta=delta, **kwargs)),
+                                     SHORT_INPUT)
+        self.assertLess(len(compress(data, shuffle=8)) * 2, len(plain))
+        self.assertLess(len(compress(data, shuffle=8, delta=True)) * 4, len(plain))
+        # filter recorded in skippable frame
+        compressed = compress(data, shuffle=8, delta=True)
+        self.assertEqual(unpack('<II4B', compressed[:12]), (0x184D2A5E, 4, ord('S'), 8, 1, LZ4F_BLOCKSIZE_MAX64KB))
+        self.assertEqual([frame['skippable'] for frame in scan_frames(compressed)], [True, False])
+        with self.assertRaises(ValueError):
+            decompress(compressed[:9] + b'\0' + compressed[10:])
+
+    def test_compress_dest_size(self):
+        with self.assertRaises(Lz4FramedNoDataError):
+            compress_dest_size(b'', 100)
+        for dest_size in (0, 15):
+            with self.assertRaises(ValueError):
+                compress_dest_size(SHORT_INPUT, dest_size)
+        with self.assertRaises(ValueError):
+            compress_dest_size(SHORT_INPUT, 19, checksum=True)
+        with self.assertRaises(ValueError):
+            compress_dest_size(SHORT_INPUT, 100, block_size_id=-1)
+        for dest_size in (20, 100, 1400, 10**6):
+            for checksum in (False, True):
+                frame, consumed = compress_dest_size(LONG_INPUT, dest_size, checksum=checksum)
+                self.assertLessEqual(len(frame), dest_size)
+                self.assertEqual(decompress(frame), LONG_INPUT[:consumed])
+                verify(frame)
+        # limited by block size
+        self.assertEqual(compress_dest_size(LONG_INPUT, 10**6)[1], get_block_size(LZ4F_BLOCKSIZE_DEFAULT))
+        self.assertEqual(compress_dest_size(LONG_INPUT, 10**6, block_size_id=LZ4F_BLOCKSIZE_MAX4MB)[1],
+                         len(LONG_INPUT))
+        # incompressible input is stored as-is
+        data = bytes(bytearray(range(256)))
+        self.assertEqual(compress_dest_size(data, 100)[1], 100 - 15)
+        frame, consumed = compress_dest_size(data, 1000)
+        self.assertEqual((len(frame), consumed), (256 + 15, 256))
+
+        with self.assertRaises(Lz4FramedNoDataError):
+            compress_block_dest_size(b'', 100)
+        with self.assertRaises(ValueError):
+            compress_block_dest_size(SHORT_INPUT, 0)
+        with self.assertRaises(ValueError):
+            compress_block_dest_size(SHORT_INPUT, 1)
+        for dest_size in (2, 100, 1400, 10**6):
+            block, consumed = compress_block_dest_size(LONG_INPUT, dest_size)
+            self.assertLessEqual(len(block), dest_size)
+            self.assertEqual(decompress_block(block, consumed), LONG_INPUT[:consumed])
+        self.assertEqual(compress_block_dest_size(LONG_INPUT, 10**6)[1], len(LONG_INPUT))
+
+    def test_compress_packets(self):
+        with self.assertRaises(Lz4FramedNoDataError):
+            list(compress_packets(b'', 1400))
+        for data in (SHORT_INPUT, LONG_INPUT, bytes(bytearray(range(256))) * 100):
+            for kwargs in ({}, {'checksum': True, 'block_size_id': LZ4F_BLOCKSIZE_MAX4MB}):
+                packets = list(compress_packets(data, 1400, **kwargs))
+                self.assertTrue(all(len(packet) <= 1400 for packet in packets))
+                self.assertEqual(b''.join(decompress(packet) for packet in packets), data)
 
 
 class TestDecompress(TestHelperMixin, TestCase):
@@ -140,6 +255,119 @@ class TestDecompress(TestHelperMixin, TestCase):
             with self.assertRaisesRegex(ValueError, 'frame incomplete'):
                 decompress(output[:-20])
 
+    def test_decompress_max_output(self):
+        with self.assertRaises(ValueError):
+            decompress(compress(SHORT_INPUT), max_output=-1)
+        with self.assertRaises(TypeError):
+            decompress(compress(SHORT_INPUT), max_output='1')
+        # with & without content size, shuffle filter
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(LONG_INPUT)
+            without_size = out.getvalue()
+        for data in (compress(LONG_INPUT), without_size, compress(LONG_INPUT, shuffle=8, delta=True)):
+            for max_output in (0, 1, 100, 65536, 65537, len(LONG_INPUT), len(LONG_INPUT) + 1):
+                self.assertEqual(decompress(data, max_output=max_output), LONG_INPUT[:max_output])
+                self.assertEqual(decompress(data, buffer_size=1, max_output=max_output), LONG_INPUT[:max_output])
+            self.assertEqual(decompress(data, max_output=None), LONG_INPUT)
+        # remaining blocks are not read
+        data = compress(LONG_INPUT, block_mode_linked=False)
+        self.assertEqual(decompress(data[:1000] + b'\xff' * (len(data) - 1000), max_output=100), LONG_INPUT[:100])
+
+    def test_decompress_max_output_size(self):
+        with self.assertRaises(ValueError):
+            decompress(compress(SHORT_INPUT), max_output_size=-1)
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(LONG_INPUT)
+            without_size = out.getvalue()
+        for data in (compress(LONG_INPUT), without_size):
+            for max_output_size in (0, 1, 1000, len(LONG_INPUT) - 1):
+                with self.assertRaises(Lz4FramedOutputLimitError) as ctx:
+                    decompress(data, max_output_size=max_output_size)
+                self.assertEqual(ctx.exception.args[1], max_output_size)
+                with self.assertRaises(Lz4FramedOutputLimitError):
+                    decompress(data, buffer_size=1, max_output_size=max_output_size)
+            self.assertEqual(decompress(data, max_output_size=len(LONG_INPUT)), LONG_INPUT)
+            # truncated output within limit
+            self.assertEqual(decompress(data, max_output=100, max_output_size=100), LONG_INPUT[:100])
+        self.assertTrue(issubclass(Lz4FramedOutputLimitError, Lz4FramedError))
+
+    def test_decompress_direct(self):
+        # frames with content size are decoded without LZ4F (which reports any failures)
+        for block_mode_linked in (True, False):
+            out = compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX64KB, block_mode_linked=block_mode_linked,
+                           checksum=True)
+            self.assertEqual(decompress(out), LONG_INPUT)
+            self.assertEqual(decompress(out + b'trailing'), LONG_INPUT)
+            corrupt = bytearray(out)
+            corrupt[len(out) // 2] ^= 0xFF
+            with self.assertRaises(Lz4FramedError):
+                decompress(bytes(corrupt))
+            corrupt = bytearray(out)
+            corrupt[-1] ^= 1
+            with self.assertRaisesLz4FramedError(LZ4F_ERROR_contentChecksum_invalid):
+                decompress(bytes(corrupt))
+        # block size word exceeding maximum block size
+        out = bytearray(compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX64KB))
+        out[15 + 2] = 0x10
+        with self.assertRaises(Lz4FramedError):
+            decompress(bytes(out))
+
+    def test_decompress_trusted(self):
+        incompressible = bytes(bytearray(range(256))) * 16 + urandom(300000)
+        for data in (SHORT_INPUT, LONG_INPUT, incompressible):
+            for block_size_id in (LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX4MB):
+                for block_mode_linked in (True, False):
+                    for checksum in (True, False):
+                        out = compress(data, block_size_id=block_size_id, block_mode_linked=block_mode_linked,
+                                       checksum=checksum)
+                        self.assertEqual(decompress(out, trusted=True), data)
+                        self.assertEqual(decompress(out + b'trailing', trusted=True), data)
+        self.assertEqual(decompress(compress(LONG_INPUT, shuffle=4, delta=True), trusted=True), LONG_INPUT)
+        self.assertEqual(decompress(compress(LONG_INPUT), trusted=True, max_output=100), LONG_INPUT[:100])
+        # corruption still detected via content checksum
+        out = bytearray(compress(LONG_INPUT, checksum=True))
+        out[-1] ^= 1
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_contentChecksum_invalid):
+            decompress(bytes(out), trusted=True)
+        # incomplete frame
+        out = compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX64KB)
+        for length in (len(out) - 1, len(out) - 4, len(out) // 2):
+            with self.assertRaisesRegex(ValueError, 'frame incomplete'):
+                decompress(out[:length], trusted=True)
+        with self.assertRaises(Lz4FramedOutputLimitError):
+            decompress(out, trusted=True, max_output_size=len(LONG_INPUT) - 1)
+        # falls back to regular decompression without content size
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(LONG_INPUT)
+                compressor.flush()
+                compressor.update(SHORT_INPUT)
+            self.assertEqual(decompress(out.getvalue(), trusted=True), LONG_INPUT + SHORT_INPUT)
+
+    def test_decompress_into(self):
+        out = compress(LONG_INPUT)
+        with self.assertRaises(TypeError):
+            decompress_into(out, LONG_INPUT)
+        with self.assertRaises(Lz4FramedNoDataError):
+            decompress_into(b'', bytearray(1))
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_dstMaxSize_tooSmall):
+            decompress_into(out, bytearray(len(LONG_INPUT) - 1))
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_frameSize_wrong):
+            decompress_into(out[:-5], bytearray(len(LONG_INPUT)))
+        # larger buffer & trailing data
+        buffer = bytearray(len(LONG_INPUT) + 10)
+        self.assertEqual(decompress_into(out + b'trailing', buffer), len(LONG_INPUT))
+        self.assertEqual(buffer[:len(LONG_INPUT)], LONG_INPUT)
+        # into part of existing buffer (without content size)
+        buffer = bytearray(len(SHORT_INPUT) * 3)
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(SHORT_INPUT)
+            self.assertEqual(decompress_into(out.getvalue(), memoryview(buffer)[len(SHORT_INPUT):]), len(SHORT_INPUT))
+        self.assertEqual(buffer, bytes(len(SHORT_INPUT)) + SHORT_INPUT + bytes(len(SHORT_INPUT)))
+
 
 class TestLowLevelFunctions(TestHelperMixin, TestCase):
 
@@ -213,7 +441,9 @@ class TestLowLevelFunctions(TestHelperMixin, TestCase):
         with self.assertRaises(TypeError):
             self.__compress_begin(level='1')
         with self.assertRaises(ValueError):
-            self.__compress_begin(level=-1)
+            self.__compress_begin(level=LZ4F_COMPRESSION_FASTEST - 1)
+        for level in range(LZ4F_COMPRESSION_FASTEST, LZ4F_COMPRESSION_MAX + 1, 4096):
+            self.__compress_begin(level=level)
         for level in range(LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MAX + 1):
             self.__compress_begin(level=level)
 
@@ -250,6 +480,19 @@ class TestLowLevelFunctions(TestHelperMixin, TestCase):
         data = compress_update(ctx, SHORT_INPUT)
         self.assertEqual(decompress(header + data + compress_end(ctx)), SHORT_INPUT)
 
+    def test_compress_flush(self):
+        with self.assertRaises(TypeError):
+            compress_flush()
+        with self.assertRaises(ValueError):
+            compress_flush(create_decompression_context())
+
+        ctx, header = self.__compress_begin()
+        self.assertEqual(b'', compress_update(ctx, SHORT_INPUT))
+        data = compress_flush(ctx)
+        self.assertTrue(len(data) > 0)
+        self.assertEqual(b'', compress_flush(ctx))
+        self.assertEqual(decompress(header + data + compress_end(ctx)), SHORT_INPUT)
+
     def __compress_with_data_and_args(self, data, **kwargs):
         ctx, header = self.__compress_begin(**kwargs)
         in_raw = BytesIO(data)
@@ -279,6 +522,23 @@ class TestLowLevelFunctions(TestHelperMixin, TestCase):
         func(SHORT_INPUT, level=0)
         func(SHORT_INPUT, level=LZ4F_COMPRESSION_MAX)
 
+    def test_decompress_update_max_output_size(self):
+        data = compress(LONG_INPUT)
+        with self.assertRaises(ValueError):
+            decompress_update(create_decompression_context(), data, max_output_size=-1)
+        for max_output_size in (0, 1000, len(LONG_INPUT) - 1):
+            with self.assertRaises(Lz4FramedOutputLimitError):
+                decompress_update(create_decompression_context(), data, max_output_size=max_output_size)
+        output = decompress_update(create_decompression_context(), data, max_output_size=len(LONG_INPUT))
+        self.assertEqual(output.pop(), 0)
+        self.assertEqual(b''.join(output), LONG_INPUT)
+        # limit applies per call
+        ctx = create_decompression_context()
+        output = decompress_update(ctx, data[:len(data) // 2], max_output_size=len(LONG_INPUT))[:-1]
+        output += decompress_update(ctx, data[len(data) // 2:], max_output_size=len(LONG_INPUT))
+        self.assertEqual(output.pop(), 0)
+        self.assertEqual(b''.join(output), LONG_INPUT)
+
     def test_decompress_update_invalid(self):
         with self.assertRaises(TypeError):
             decompress_update()
@@ -384,6 +644,95 @@ class TestCompressor(TestHelperMixin, TestCase):
         # levels > 10 (v1.7.5) are significantly slower
         self.__fp_test(level=10)
 
+    def test_compressor_pipeline(self):
+        with self.assertRaises(ValueError):
+            Compressor(pipeline=True)
+        with self.assertRaises(ValueError):
+            Compressor(BytesIO(), pipeline=True, prefetch=0)
+        for autoflush in (False, True):
+            self.__fp_test(pipeline=True, autoflush=autoflush)
+        self.__fp_test(pipeline=True, prefetch=1)
+
+        class FailingWriter(object):
+            @staticmethod
+            def write(_):
+                raise IOError('write failed')
+
+        with self.assertRaisesRegex(IOError, 'write failed'):
+            with Compressor(FailingWriter(), pipeline=True) as compressor:
+                compressor.update(SHORT_INPUT)
+
+
+    def test_compressor_write_buffer(self):
+        with self.assertRaises(ValueError):
+            Compressor(BytesIO(), write_buffer_size=-1)
+        with self.assertRaises(ValueError):
+            Compressor(write_buffer_size=1)
+
+        class CountingWriter(BytesIO):
+            writes = 0
+
+            def write(self, data):
+                self.writes += 1
+                return super(CountingWriter, self).write(data)
+
+        chunks = [LONG_INPUT[i:i + 100] for i in range(0, len(LONG_INPUT), 100)]
+        for kwargs in ({}, {'pipeline': True}):
+            out = CountingWriter()
+            with Compressor(out, autoflush=True, write_buffer_size=64 * 1024, **kwargs) as compressor:
+                for chunk in chunks:
+                    compressor.update(chunk)
+            self.assertEqual(decompress(out.getvalue()), LONG_INPUT)
+            self.assertTrue(out.writes < len(chunks) // 100)
+        # flush() writes pending output
+        out = CountingWriter()
+        compressor = Compressor(out, write_buffer_size=64 * 1024)
+        compressor.update(SHORT_INPUT)
+        self.assertEqual(out.writes, 0)
+        compressor.flush()
+        self.assertEqual(out.writes, 1)
+        compressor.end()
+        self.assertEqual(out.writes, 2)
+        self.assertEqual(decompress(out.getvalue()), SHORT_INPUT)
+
+    def test_compressor_flush(self):
+        compressor = Compressor()
+        # header only, data buffered
+        header = compressor.update(SHORT_INPUT)
+        self.assertEqual(len(header), len(compress_begin(create_compression_context())))
+        output = compressor.flush()
+        self.assertTrue(len(output) > 0)
+        self.assertEqual(decompress(header + output + compressor.end()), SHORT_INPUT)
+
+    def test_compressor_async(self):
+        with self.assertRaises(Lz4FramedNoDataError):
+            Compressor().update_async(b'')
+        chunks = [LONG_INPUT[i:i + 10000] for i in range(0, len(LONG_INPUT), 10000)]
+        # returning output
+        compressor = Compressor(checksum=True)
+        futures = [compressor.update_async(chunk) for chunk in chunks]
+        futures.append(compressor.flush_async())
+        output = b''.join(future.result() for future in futures)
+        self.assertEqual(decompress(output + compressor.end()), LONG_INPUT)
+        # writing to fp, with end() waiting for outstanding operations
+        with BytesIO() as out:
+            with Compressor(out, block_mode_linked=False) as compressor:
+                for chunk in chunks:
+                    compressor.update_async(bytearray(chunk))
+            self.assertEqual(decompress(out.getvalue()), LONG_INPUT)
+        # any buffer protocol objects, with emptiness determined by size in bytes (rather than truthiness or len())
+        with self.assertRaises(Lz4FramedNoDataError):
+            Compressor().update_async(array('d'))
+        floats = array('d', range(10000))
+        compressor = Compressor()
+        output = compressor.update_async(_Unsized(floats)).result()
+        self.assertEqual(decompress(output + compressor.end()), floats.tobytes())
+        if numpy is not None:
+            matrix = numpy.arange(10000, dtype=numpy.float64).reshape(100, 100)
+            compressor = Compressor()
+            output = compressor.update_async(matrix).result()
+            self.assertEqual(decompress(output + compressor.end()), matrix.tobytes())
+
 
 class TestDecompressor(TestHelperMixin, TestCase):
 
@@ -415,3 +764,1089 @@ class TestDecompressor(TestHelperMixin, TestCase):
         # some data should have been written
         out_bytes.seek(SEEK_END)
         self.assertTrue(out_bytes.tell() > 0)
+
+    def test_decompressor_readinto(self):
+        class ReadOnly(BytesIO):
+            readinto = None
+
+        class ShortReadInto(BytesIO):
+            def readinto(self, b):
+                return super(ShortReadInto, self).readinto(memoryview(b)[:1000])
+
+        data = compress(LONG_INPUT, checksum=True, block_size_id=LZ4F_BLOCKSIZE_MAX256KB)
+        # without readinto & with short reads
+        for fp in (ReadOnly(data), ShortReadInto(data)):
+            self.assertEqual(b''.join(Decompressor(fp)), LONG_INPUT)
+        with self.assertRaises(Lz4FramedNoDataError):
+            b''.join(Decompressor(ShortReadInto(data[:-32])))
+        # re-used buffer
+        self.assertEqual(b''.join(decompress_update(create_decompression_context(), bytearray(data))[:-1]),
+                         LONG_INPUT)
+
+    def test_decompressor_max_output_size(self):
+        with self.assertRaises(ValueError):
+            Decompressor(BytesIO(), max_output_size=-1)
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(LONG_INPUT)
+            without_size = out.getvalue()
+        for data in (compress(LONG_INPUT), without_size):
+            for kwargs in ({}, {'pipeline': True}):
+                with self.assertRaises(Lz4FramedOutputLimitError) as ctx:
+                    b''.join(Decompressor(BytesIO(data), max_output_size=len(LONG_INPUT) - 1, **kwargs))
+                self.assertEqual(ctx.exception.args[1], len(LONG_INPUT) - 1)
+                self.assertEqual(b''.join(Decompressor(BytesIO(data), max_output_size=len(LONG_INPUT), **kwargs)),
+                                 LONG_INPUT)
+        # stated content size exceeding limit detected before any data is decompressed
+        fp = BytesIO(compress(LONG_INPUT))
+        with self.assertRaises(Lz4FramedOutputLimitError):
+            next(iter(Decompressor(fp, max_output_size=100)))
+        self.assertEqual(fp.tell(), 15)
+
+    def test_decompressor_read(self):
+        data = compress(LONG_INPUT, checksum=True)
+        for kwargs in ({}, {'pipeline': True}):
+            decompressor = Decompressor(BytesIO(data), **kwargs)
+            parts = [decompressor.read(size) for size in (0, 10, 70000, 5)]
+            self.assertEqual([len(part) for part in parts], [0, 10, 70000, 5])
+            parts.append(decompressor.read())
+            self.assertEqual(b''.join(parts), LONG_INPUT)
+            self.assertEqual(decompressor.read(), b'')
+            self.assertEqual(decompressor.read(1), b'')
+
+        # only first block read
+        fp = BytesIO(data)
+        self.assertEqual(Decompressor(fp).read(100), LONG_INPUT[:100])
+        self.assertLess(fp.tell(), len(data) // 10)
+
+        with self.assertRaises(Lz4FramedNoDataError):
+            Decompressor(BytesIO(data[:-32])).read()
+
+    def test_decompressor_pipeline(self):
+        with self.assertRaises(ValueError):
+            Decompressor(BytesIO(), pipeline=True, prefetch=0)
+
+        for prefetch in (1, 4):
+            for data in (SHORT_INPUT, LONG_INPUT):
+                decompressor = Decompressor(BytesIO(compress(data, checksum=True)), pipeline=True, prefetch=prefetch)
+                self.assertEqual(b''.join(decompressor), data)
+                self.assertEqual(decompressor.frame_info['length'], len(data))
+
+        # incomplete frame
+        with self.assertRaises(Lz4FramedNoDataError):
+            for _ in Decompressor(BytesIO(compress(LONG_INPUT)[:-32]), pipeline=True):
+                pass
+
+        class FailingReader(object):
+            @staticmethod
+            def read(_):
+                raise IOError('read failed')
+
+        with self.assertRaisesRegex(IOError, 'read failed'):
+            for _ in Decompressor(FailingReader(), pipeline=True):
+                pass
+
+
+class TestFileFunctions(TestHelperMixin, TestCase):
+
+    def setUp(self):
+        super(TestFileFunctions, self).setUp()
+        self.__dir = mkdtemp()
+
+    def tearDown(self):
+        rmtree(self.__dir)
+        super(TestFileFunctions, self).tearDown()
+
+    def __path(self, name, data=None):
+        name = path.join(self.__dir, name)
+        if data is not None:
+            with open(name, 'wb') as out:
+                out.write(data)
+        return name
+
+    @staticmethod
+    def __read(name):
+        with open(name, 'rb') as in_file:
+            return in_file.read()
+
+    def test_compress_file_invalid(self):
+        with self.assertRaises(TypeError):
+            compress_file()
+        with self.assertRaises(IOError):
+            compress_file(self.__path('missing'), self.__path('out'))
+        with self.assertRaises(ValueError):
+            compress_file(-1, self.__path('out'))
+        src = self.__path('in', SHORT_INPUT)
+        with self.assertRaises(ValueError):
+            compress_file(src, self.__path('out'), block_size_id=-1)
+        with self.assertRaises(ValueError):
+            compress_file(src, self.__path('out'), level=LZ4F_COMPRESSION_FASTEST - 1)
+
+    def test_compress_file(self):
+        src = self.__path('in', LONG_INPUT)
+        dst = self.__path('out')
+        for kwargs in ({}, {'checksum': True, 'block_mode_linked': False}, {'block_size_id': LZ4F_BLOCKSIZE_MAX4MB},
+                       {'level': 10}):
+            written = compress_file(src, dst, **kwargs)
+            output = self.__read(dst)
+            self.assertEqual(written, len(output))
+            self.assertEqual(decompress(output), LONG_INPUT)
+        # empty input produces empty frame
+        compress_file(self.__path('empty', b''), dst)
+        self.assertEqual(decompress(self.__read(dst)), b'')
+
+    def test_compress_file_threads(self):
+        src = self.__path('in', LONG_INPUT)
+        dst = self.__path('out')
+        with self.assertRaises(ValueError):
+            compress_file(src, dst, threads=-1)
+        for kwargs in ({}, {'checksum': True, 'block_mode_linked': False}, {'block_size_id': LZ4F_BLOCKSIZE_MAX4MB},
+                       {'level': 9, 'mmap_src': True}, {'level': -5, 'mmap_src': True, 'mmap_dst': True}):
+            for threads in (0, 3):
+                written = compress_file(src, dst, threads=threads, **kwargs)
+                output = self.__read(dst)
+                self.assertEqual(written, len(output))
+                self.assertEqual(decompress(output), LONG_INPUT)
+        compress_file(self.__path('empty', b''), dst, threads=0)
+        self.assertEqual(decompress(self.__read(dst)), b'')
+
+    def test_compress_file_descriptors(self):
+        src = self.__path('in', LONG_INPUT)
+        with open(self.__path('out'), 'wb') as out:
+            out.write(b'prefix')
+            out.flush()
+            fd = os_open(src, O_RDONLY)
+            try:
+                compress_file(fd, out.fileno())
+            finally:
+                os_close(fd)
+        output = self.__read(self.__path('out'))
+        self.assertEqual(output[:6], b'prefix')
+        self.assertEqual(decompress(output[6:]), LONG_INPUT)
+
+    def test_compressor_writev(self):
+        # output collected from many updates written directly to descriptor
+        chunks = [LONG_INPUT[i:i + 100] for i in range(0, len(LONG_INPUT), 100)]
+        dst = self.__path('out')
+        for buffering in (0, -1):
+            with open(dst, 'wb', buffering=buffering) as out:
+                out.write(b'prefix')
+                with Compressor(out, autoflush=True, write_buffer_size=32 * 1024) as compressor:
+                    for chunk in chunks:
+                        compressor.update(chunk)
+            output = self.__read(dst)
+            self.assertEqual(output[:6], b'prefix')
+            self.assertEqual(decompress(output[6:]), LONG_INPUT)
+
+    def test_compress_file_mmap(self):
+        src = self.__path('in', LONG_INPUT)
+        dst = self.__path('out')
+        for mmap_dst in (False, True):
+            for kwargs in ({}, {'block_size_id': LZ4F_BLOCKSIZE_MAX4MB, 'checksum': True},
+                           {'block_mode_linked': False}):
+                written = compress_file(src, dst, mmap_src=True, mmap_dst=mmap_dst, **kwargs)
+                output = self.__read(dst)
+                self.assertEqual(written, len(output))
+                self.assertEqual(decompress(output), LONG_INPUT)
+                # length known when mapping input
+                ctx = create_decompression_context()
+                decompress_update(ctx, output[:15])
+                self.assertEqual(get_frame_info(ctx)['length'], len(LONG_INPUT))
+
+        # mapping from current position of descriptors, leaving them positioned at end of input / output
+        with open(src, 'rb') as in_file, open(dst, 'w+b') as out:
+            in_file.seek(100)
+            out.write(b'prefix')
+            out.flush()
+            written = compress_file(in_file.fileno(), out.fileno(), mmap_src=True, mmap_dst=True)
+            self.assertEqual(in_file.tell(), len(LONG_INPUT))
+            self.assertEqual(out.tell(), 6 + written)
+            out.write(b'suffix')
+        output = self.__read(dst)
+        self.assertEqual(output[:6], b'prefix')
+        self.assertEqual(output[-6:], b'suffix')
+        self.assertEqual(decompress(output[6:-6]), LONG_INPUT[100:])
+
+        # empty (non-mappable) input
+        compress_file(self.__path('empty', b''), dst, mmap_src=True, mmap_dst=True)
+        self.assertEqual(decompress(self.__read(dst)), b'')
+
+    def test_decompress_file(self):
+        src = self.__path('in', compress(LONG_INPUT, checksum=True))
+        dst = self.__path('out')
+        self.assertEqual(decompress_file(src, dst), len(LONG_INPUT))
+        self.assertEqual(self.__read(dst), LONG_INPUT)
+
+        # trailing data is ignored
+        with open(src, 'ab') as out:
+            out.write(b'trailing')
+        decompress_file(src, dst)
+        self.assertEqual(self.__read(dst), LONG_INPUT)
+
+        with self.assertRaises(Lz4FramedNoDataError):
+            decompress_file(self.__path('empty', b''), dst)
+        with self.assertRaisesRegex(ValueError, 'frame incomplete'):
+            decompress_file(self.__path('incomplete', compress(LONG_INPUT)[:-5]), dst)
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_contentChecksum_invalid):
+            decompress_file(self.__path('invalid', compress(LONG_INPUT, checksum=True)[:-1] + b'0'), dst)
+        with self.assertRaises(IOError):
+            decompress_file(self.__path('missing'), dst)
+
+    def test_command_line_batch(self):
+        def run(*args):
+            return call((executable, '-m', 'lz4framed') + args, cwd=path.dirname(path.abspath(__file__)),
+                        stderr=devnull)
+
+        mkdir(self.__path('sub'))
+        names = [self.__path(name, LONG_INPUT[i:]) for i, name in enumerate(('a', 'b', path.join('sub', 'c')))]
+        utime(names[0], (1000000000, 1000000000))
+        with open(os_devnull, 'wb') as devnull:
+            self.assertEqual(run('-m', '-j', '2', 'compress', *names[:2]), 0)
+            self.assertEqual(decompress(self.__read(names[1] + '.lz4')), LONG_INPUT[1:])
+            self.assertEqual(path.getmtime(names[0] + '.lz4'), 1000000000)
+            # existing outputs are not overwritten by default
+            self.assertEqual(run('-r', 'compress', self.__dir), 4)
+            self.assertEqual(run('-r', '-f', '--rm', 'compress', self.__dir), 0)
+            self.assertFalse(any(path.exists(name) for name in names))
+            self.assertEqual(run('-r', '--rm', 'decompress', self.__dir), 0)
+            for i, name in enumerate(names):
+                self.assertEqual(self.__read(name), LONG_INPUT[i:])
+                self.assertFalse(path.exists(name + '.lz4'))
+            # unknown suffix
+            self.assertEqual(run('-m', 'decompress', names[0]), 1)
+
+            self.assertEqual(run('-r', 'compress', self.__dir), 0)
+            self.assertEqual(run('-r', 'verify', self.__dir), 0)
+            with open(names[1] + '.lz4', 'ab') as out:
+                out.write(b'trailing')
+            self.assertEqual(run('verify', names[0] + '.lz4', names[1] + '.lz4'), 8)
+
+    def test_command_line_batch_errors(self):
+        cli = import_module('lz4framed.__main__')
+        names = [self.__path(name, compress(SHORT_INPUT)) for name in ('a.lz4', 'b.lz4', 'c.lz4')]
+        original_verify, original_stderr = cli.verify, cli.stderr
+        try:
+            cli.stderr = BytesIO() if PY2 else StringIO()
+            # unexpected exception is reported without skipping remaining files
+            verified = []
+
+            def failing_verify(in_file):
+                verified.append(in_file.name)
+                raise RuntimeError('unexpected')
+
+            cli.verify = failing_verify
+            self.assertEqual(cli.do_verify(names, workers=1), 8)
+            self.assertEqual(sorted(verified), names)
+            self.assertIn('Unexpected error', cli.stderr.getvalue())
+
+            # error without offset
+            def lz4_error_verify(_):
+                raise Lz4FramedError('allocation_failed', 9)
+
+            cli.verify = lz4_error_verify
+            self.assertEqual(cli.do_verify(names[:1]), 8)
+            self.assertIn('Invalid: allocation_failed', cli.stderr.getvalue())
+        finally:
+            cli.verify, cli.stderr = original_verify, original_stderr
+
+
+class TestScanFrames(TestHelperMixin, TestCase):
+
+    def test_scan_frames_invalid(self):
+        with self.assertRaises(TypeError):
+            scan_frames()
+        with self.assertRaises(TypeError):
+            scan_frames(1.0)
+        with self.assertRaises(Lz4FramedNoDataError):
+            scan_frames(b'')
+        data = compress(LONG_INPUT, checksum=True)
+        for invalid, code, offset in ((b'1234567', LZ4F_ERROR_frameType_unknown, 0),
+                                      (data[:10], LZ4F_ERROR_frameHeader_incomplete, 0),
+                                      (data[:-3], LZ4F_ERROR_frameSize_wrong, len(data) - 4),
+                                      (data + b'xy', LZ4F_ERROR_frameHeader_incomplete, len(data)),
+                                      (data[:8] + b'0' + data[9:], LZ4F_ERROR_headerChecksum_invalid, 0)):
+            with self.assertRaises(Lz4FramedError) as context:
+                scan_frames(invalid)
+            self.assertEqual(context.exception.args[1:], (code, offset))
+
+    def test_scan_frames(self):
+        random = urandom(100000)
+        skippable = pack('<II', 0x184D2A55, 3) + b'abc'
+        data = (compress(LONG_INPUT, checksum=True) + skippable +
+                compress(random, block_size_id=LZ4F_BLOCKSIZE_MAX256KB, block_mode_linked=False))
+        frames = scan_frames(bytearray(data))
+        self.assertEqual(len(frames), 3)
+        self.assertEqual([frame['skippable'] for frame in frames], [False, True, False])
+        self.assertEqual(sum(frame['size'] for frame in frames), len(data))
+        self.assertEqual(frames[1], {'offset': frames[0]['size'], 'size': 11, 'skippable': True, 'magic': 0x184D2A55,
+                                     'header_size': 8, 'length': 3})
+
+        frame = frames[0]
+        self.assertEqual((frame['block_size_id'], frame['block_mode_linked'], frame['checksum'], frame['length'],
+                          frame['uncompressed_offset'], frame['uncompressed_length']),
+                         (LZ4F_BLOCKSIZE_MAX64KB, True, True, len(LONG_INPUT), 0,
+                          len(LONG_INPUT)))
+        self.assertEqual(frame['checksum_offset'], frame['end_mark'] + 4)
+        self.assertEqual(len(frame['blocks']), -(-len(LONG_INPUT) // (64 * 1024)))
+        uncompressed = 0
+        for offset, size, uncompressed_offset, uncompressed_size, stored in frame['blocks']:
+            self.assertFalse(stored)
+            self.assertEqual(unpack('<I', data[offset - 4:offset])[0], size)
+            self.assertEqual(uncompressed_offset, uncompressed)
+            uncompressed += uncompressed_size
+        self.assertEqual(uncompressed, len(LONG_INPUT))
+
+        # incompressible data is stored
+        frame = frames[2]
+        self.assertIsNone(frame['checksum_offset'])
+        self.assertEqual(frame['blocks'], [(frame['offset'] + frame['header_size'] + 4, len(random), len(LONG_INPUT),
+                                            len(random), True)])
+        self.assertEqual(data[frame['blocks'][0][0]:][:len(random)], random)
+
+        # without walking compressed blocks
+        blocks = scan_frames(data, decoded_sizes=False)[0]['blocks']
+        self.assertEqual([block[:2] for block in blocks], [block[:2] for block in frames[0]['blocks']])
+        self.assertEqual(set(block[2:4] for block in blocks), {(None, None)})
+
+    def test_scan_frames_file(self):
+        data = compress(LONG_INPUT) + compress(SHORT_INPUT)
+        expected = scan_frames(data)
+        with TemporaryFile() as tmp:
+            tmp.write(b'prefix' + data)
+            tmp.flush()
+            for source in (tmp, tmp.fileno()):
+                tmp.seek(6)
+                self.assertEqual(scan_frames(source), expected)
+            # empty from current position
+            with self.assertRaises(Lz4FramedNoDataError):
+                scan_frames(tmp)
+
+
+class TestVerify(TestHelperMixin, TestCase):
+
+    def test_verify_invalid(self):
+        with self.assertRaises(TypeError):
+            verify()
+        with self.assertRaises(TypeError):
+            verify(1.0)
+        with self.assertRaises(Lz4FramedNoDataError):
+            verify(b'')
+        data = compress(LONG_INPUT, checksum=True)
+        for invalid, code, offset in ((b'1234567', LZ4F_ERROR_frameType_unknown, 0),
+                                      (data[:-3], LZ4F_ERROR_frameSize_wrong, len(data) - 3),
+                                      (data[:-1] + b'0', LZ4F_ERROR_contentChecksum_invalid, None),
+                                      (data[:8] + b'0' + data[9:], LZ4F_ERROR_headerChecksum_invalid, 0)):
+            with self.assertRaises(Lz4FramedError) as context:
+                verify(invalid)
+            self.assertEqual(context.exception.args[1], code)
+            if offset is not None:
+                self.assertEqual(context.exception.args[2], offset)
+        # corrupt block is reported at its offset
+        offset, size = scan_frames(data)[0]['blocks'][3][:2]
+        with self.assertRaises(Lz4FramedError) as context:
+            verify(data[:offset] + b'\0' * size + data[offset + size:])
+        self.assertEqual(context.exception.args[2], offset)
+
+    def test_verify(self):
+        random = urandom(100000)
+        data = (compress(LONG_INPUT, checksum=True, block_size_id=LZ4F_BLOCKSIZE_MAX4MB) + pack('<II', 0x184D2A50, 1) +
+                b'x' + compress(random, block_mode_linked=False) + compress(SHORT_INPUT, checksum=True))
+        expected = len(LONG_INPUT) + len(random) + len(SHORT_INPUT)
+        self.assertEqual(verify(data), expected)
+        self.assertEqual(verify(memoryview(data)), expected)
+        with TemporaryFile() as tmp:
+            tmp.write(data)
+            tmp.flush()
+            tmp.seek(0)
+            self.assertEqual(verify(tmp), expected)
+            tmp.seek(0)
+            self.assertEqual(verify(tmp.fileno()), expected)
+        # frame (without content size) ending with block filling entire output buffer
+        self.assertEqual(verify(compress_dest_size(LONG_INPUT, 1400)[0]), get_block_size(LZ4F_BLOCKSIZE_DEFAULT))
+
+
+class TestIndexedReader(TestHelperMixin, TestCase):
+
+    def setUp(self):
+        super(TestIndexedReader, self).setUp()
+        self.__dir = mkdtemp()
+
+    def tearDown(self):
+        rmtree(self.__dir)
+        super(TestIndexedReader, self).tearDown()
+
+    def __path(self, data):
+        name = path.join(self.__dir, 'data.lz4')
+        with open(name, 'wb') as out:
+            out.write(data)
+        return name
+
+    def test_decompress_block(self):
+        with self.assertRaises(TypeError):
+            decompress_block(b'1')
+        with self.assertRaises(Lz4FramedNoDataError):
+            decompress_block(b'', 1)
+        with self.assertRaises(ValueError):
+            decompress_block(b'1', 0)
+        data = compress(LONG_INPUT, block_mode_linked=False, block_size_id=LZ4F_BLOCKSIZE_MAX64KB)
+        blocks = scan_frames(data)[0]['blocks']
+        for offset, size, uncompressed_offset, uncompressed_size, _ in blocks:
+            self.assertEqual(decompress_block(memoryview(data)[offset:offset + size], uncompressed_size),
+                             LONG_INPUT[uncompressed_offset:uncompressed_offset + uncompressed_size])
+        offset, size, _, uncompressed_size, _ = blocks[0]
+        with self.assertRaises(Lz4FramedError) as context:
+            decompress_block(data[offset:offset + size], uncompressed_size - 1)
+        self.assertEqual(context.exception.args[1], LZ4F_ERROR_decompressionFailed)
+
+    def test_indexed_reader_invalid(self):
+        with self.assertRaises(Lz4FramedNoDataError):
+            IndexedReader(self.__path(b''))
+        with self.assertRaises(ValueError):
+            IndexedReader(self.__path(compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX64KB)))
+        name = self.__path(compress(LONG_INPUT, block_mode_linked=False, block_size_id=LZ4F_BLOCKSIZE_MAX64KB))
+        for kwargs in ({'cache_bytes': -1}, {'cache_shards': 0}):
+            with self.assertRaises(ValueError):
+                IndexedReader(name, **kwargs)
+        with IndexedReader(name) as reader:
+            for offset, length in ((-1, 1), (0, -1)):
+                with self.assertRaises(ValueError):
+                    reader.pread(offset, length)
+        # blocks are validated whilst indexing
+        data = compress(LONG_INPUT, block_mode_linked=False, block_size_id=LZ4F_BLOCKSIZE_MAX64KB)
+        offset, size = scan_frames(data)[0]['blocks'][3][:2]
+        with self.assertRaises(Lz4FramedError):
+            IndexedReader(self.__path(data[:offset] + b'\xf0' * size + data[offset + size:]))
+
+    def test_indexed_reader(self):
+        random = urandom(100000)
+        expected = LONG_INPUT + random + SHORT_INPUT
+        # single-block linked frame, skippable frame & stored blocks are all supported
+        name = self.__path(compress(LONG_INPUT, block_mode_linked=False, block_size_id=LZ4F_BLOCKSIZE_MAX64KB) +
+                           pack('<II', 0x184D2A50, 1) + b'x' + compress(random, block_mode_linked=False) +
+                           compress(SHORT_INPUT))
+        with IndexedReader(name, cache_bytes=256 * 1024, cache_shards=4) as reader:
+            self.assertEqual(len(reader), len(expected))
+            self.assertEqual(reader.block_count, 55 + 2 + 1)
+            for offset, length in ((0, 0), (0, 1), (0, 65536), (65535, 2), (100, 300000), (len(LONG_INPUT) - 5, 10),
+                                   (len(expected) - 10, 100), (len(expected), 1), (len(expected) + 10, 1),
+                                   (0, len(expected))):
+                self.assertEqual(reader.pread(offset, length), expected[offset:offset + length])
+                self.assertEqual(bytes(reader.view(offset, length)), expected[offset:offset + length])
+            stats = reader.cache_stats
+            self.assertLessEqual(stats['size'], 256 * 1024)
+            self.assertGreater(stats['hits'], 0)
+            self.assertGreaterEqual(stats['misses'], reader.block_count)
+            # views of a single block are not copied and remain valid after eviction
+            view = reader.view(10, 20)
+            reader.pread(0, len(expected))
+            self.assertEqual(bytes(view), expected[10:30])
+
+    def test_indexed_reader_threads(self):
+        name = self.__path(compress(LONG_INPUT, block_mode_linked=False, block_size_id=LZ4F_BLOCKSIZE_MAX64KB))
+        failed = []
+
+        def read(reader, step):
+            for offset in range(0, len(LONG_INPUT), step):
+                if reader.pread(offset, 1000) != LONG_INPUT[offset:offset + 1000]:
+                    failed.append(offset)
+
+        with IndexedReader(name, cache_bytes=128 * 1024, cache_shards=2) as reader:
+            threads = [Thread(target=read, args=(reader, step)) for step in (10007, 20011, 30011, 40009)]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+        self.assertFalse(failed)
+
+
+class TestLazyBuffer(TestHelperMixin, TestCase):
+
+    def test_lazy_buffer_invalid(self):
+        with self.assertRaises(TypeError):
+            LazyLz4Buffer()
+        with self.assertRaises(TypeError):
+            LazyLz4Buffer(1)
+        with self.assertRaises(TypeError):
+            LazyLz4Buffer(compress(SHORT_INPUT), cache=1)
+        with self.assertRaises(Lz4FramedNoDataError):
+            LazyLz4Buffer(b'')
+        with self.assertRaises(Lz4FramedError):
+            LazyLz4Buffer(b'1234567')
+        with self.assertRaises(ValueError):
+            LazyLz4BufferCache(-1)
+        # body is only checked on access
+        data = compress(LONG_INPUT, checksum=True)
+        buffer = LazyLz4Buffer(data[:-1] + b'0')
+        self.assertEqual(len(buffer), len(LONG_INPUT))
+        with self.assertRaises(Lz4FramedError) as context:
+            memoryview(buffer)
+        self.assertEqual(context.exception.args[1], LZ4F_ERROR_contentChecksum_invalid)
+        self.assertFalse(buffer.loaded)
+
+    def test_lazy_buffer(self):
+        data = compress(LONG_INPUT)
+        for buffer in (LazyLz4Buffer(data), LazyLz4Buffer(bytearray(data))):
+            self.assertEqual(len(buffer), len(LONG_INPUT))
+            self.assertEqual(buffer.compressed, data)
+            self.assertFalse(buffer.loaded)
+            self.assertEqual(buffer[10:20], LONG_INPUT[10:20])
+            self.assertEqual(buffer[-1], LONG_INPUT[-1])
+            self.assertTrue(buffer.loaded)
+            view = memoryview(buffer)
+            self.assertTrue(view.readonly)
+            self.assertEqual(bytes(view), LONG_INPUT)
+            with self.assertRaises(BufferError):
+                buffer.release()
+            view.release()
+            buffer.release()
+            self.assertFalse(buffer.loaded)
+            self.assertEqual(bytes(buffer), LONG_INPUT)
+        # length not stated in frame
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(SHORT_INPUT)
+            buffer = LazyLz4Buffer(out.getvalue())
+        self.assertFalse(buffer.loaded)
+        self.assertEqual(len(buffer), len(SHORT_INPUT))
+        self.assertTrue(buffer.loaded)
+
+    def test_lazy_buffer_release_during_subscript(self):
+        buffer = LazyLz4Buffer(compress(LONG_INPUT))
+
+        class Key(object):  # pylint: disable=too-few-public-methods
+            def __index__(self):
+                buffer.release()
+                return len(LONG_INPUT) - 1
+
+        for _ in range(10):
+            self.assertEqual(buffer[Key()], LONG_INPUT[-1])
+            self.assertFalse(buffer.loaded)
+            self.assertEqual(buffer[Key():], LONG_INPUT[-1:])
+
+    def test_lazy_buffer_cache(self):
+        cache = LazyLz4BufferCache(2 * len(LONG_INPUT))
+        buffers = [LazyLz4Buffer(compress(LONG_INPUT), cache) for _ in range(4)]
+        for buffer in buffers:
+            buffer[0]  # pylint: disable=pointless-statement
+        self.assertEqual([buffer.loaded for buffer in buffers], [False, False, True, True])
+        # exported buffers are pinned
+        view = memoryview(buffers[2])
+        buffers[0][0]  # pylint: disable=pointless-statement
+        buffers[1][0]  # pylint: disable=pointless-statement
+        self.assertEqual([buffer.loaded for buffer in buffers], [False, True, True, False])
+        self.assertEqual(cache.stats, {'size': 2 * len(LONG_INPUT), 'max_size': 2 * len(LONG_INPUT), 'hits': 1,
+                                       'misses': 6})
+        buffers[1][0]  # pylint: disable=pointless-statement
+        self.assertEqual(cache.stats['hits'], 2)
+        cache.clear()
+        self.assertEqual([buffer.loaded for buffer in buffers], [False, False, True, False])
+        view.release()
+        del buffers
+        self.assertEqual(cache.stats['size'], 0)
+
+
+class TestCompressedCache(TestHelperMixin, TestCase):
+
+    def test_compress_block(self):
+        with self.assertRaises(TypeError):
+            compress_block()
+        with self.assertRaises(Lz4FramedNoDataError):
+            compress_block(b'')
+        with self.assertRaises(ValueError):
+            compress_block(SHORT_INPUT, level=LZ4F_COMPRESSION_MAX + 1)
+        dictionary = SHORT_INPUT * 3
+        for level in (LZ4F_COMPRESSION_FASTEST, LZ4F_COMPRESSION_MIN, LZ4F_COMPRESSION_MAX):
+            for kwargs in ({}, {'dictionary': dictionary}):
+                for data in (SHORT_INPUT, LONG_INPUT):
+                    compressed = compress_block(data, level=level, **kwargs)
+                    self.assertEqual(decompress_block(compressed, len(data), **kwargs), data)
+        # dictionary allows small inputs to be compressed
+        self.assertGreater(len(compress_block(SHORT_INPUT)), len(SHORT_INPUT))
+        compressed = compress_block(SHORT_INPUT, dictionary=dictionary)
+        self.assertLess(len(compressed), len(SHORT_INPUT) // 2)
+        with self.assertRaises(Lz4FramedError):
+            decompress_block(compressed, len(SHORT_INPUT))
+        # only the last 64 KB of a (larger) dictionary are used by either side
+        dictionary = urandom(200000) + SHORT_INPUT * 3
+        compressed = compress_block(SHORT_INPUT, dictionary=dictionary)
+        self.assertLess(len(compressed), len(SHORT_INPUT) // 2)
+        for dictionary in (dictionary, dictionary[-65536:]):
+            self.assertEqual(decompress_block(compressed, len(SHORT_INPUT), dictionary=dictionary), SHORT_INPUT)
+
+    def test_compressed_cache_invalid(self):
+        with self.assertRaises(ValueError):
+            CompressedCache(-1)
+        with self.assertRaises(ValueError):
+            CompressedCache(1, dictionary=b'1', frames=True)
+        cache = CompressedCache(100)
+        with self.assertRaises(KeyError):
+            cache['a']  # pylint: disable=pointless-statement
+        with self.assertRaises(KeyError):
+            del cache['a']
+        with self.assertRaises(ValueError):
+            CompressedCache(100, level=LZ4F_COMPRESSION_MAX + 1)['a'] = SHORT_INPUT
+
+    def test_compressed_cache(self):
+        values = [(SHORT_INPUT * (i + 1))[i:] for i in range(10)] + [b'', urandom(50)]
+        for kwargs in ({}, {'frames': True}, {'dictionary': SHORT_INPUT}, {'level': LZ4F_COMPRESSION_MAX}):
+            cache = CompressedCache(10000, **kwargs)
+            for i, value in enumerate(values):
+                cache[i] = value
+            self.assertEqual(len(cache), len(values))
+            self.assertEqual(sorted(cache), list(range(len(values))))
+            for i, value in enumerate(values):
+                self.assertEqual(cache[i], value)
+            self.assertEqual(cache.get(-1, b'x'), b'x')
+            stats = cache.stats
+            self.assertEqual((stats['count'], stats['hits'], stats['misses'], stats['evictions']),
+                             (len(values), len(values), 1, 0))
+            self.assertEqual(stats['uncompressed_size'], sum(len(value) for value in values))
+            self.assertGreater(stats['ratio'], 1)
+            self.assertAlmostEqual(stats['hit_rate'], len(values) / float(len(values) + 1))
+            self.assertIn(11, cache)
+            del cache[11]
+            self.assertNotIn(11, cache)
+            cache.clear()
+            self.assertEqual((len(cache), cache.stats['size']), (0, 0))
+
+    def test_compressed_cache_eviction(self):
+        value = urandom(100)
+        cache = CompressedCache(250)
+        for key in range(3):
+            cache[key] = value
+        self.assertEqual(sorted(cache), [1, 2])
+        # accessing marks as most recently used
+        cache[1]  # pylint: disable=pointless-statement
+        cache[3] = value
+        self.assertEqual(sorted(cache), [1, 3])
+        self.assertEqual(cache.stats['evictions'], 2)
+        # values exceeding budget by themselves are not stored (and replace existing)
+        cache[1] = urandom(300)
+        self.assertEqual(sorted(cache), [3])
+        self.assertEqual(cache.stats['size'], 100)
+
+
+class TestThreadPool(TestHelperMixin, TestCase):
+
+    def tearDown(self):
+        set_thread_pool_size(0)
+        super(TestThreadPool, self).tearDown()
+
+    def test_compress_threads(self):
+        with self.assertRaises(TypeError):
+            compress(SHORT_INPUT, threads='1')
+        with self.assertRaises(ValueError):
+            compress(SHORT_INPUT, threads=-1)
+        self.check_compress_short(threads=4)
+        for kwargs in ({}, {'block_mode_linked': False}, {'checksum': True}, {'level': 9},
+                       {'block_size_id': LZ4F_BLOCKSIZE_MAX256KB}):
+            kwargs.setdefault('block_size_id', LZ4F_BLOCKSIZE_MAX64KB)
+            for threads in (0, 2, 16):
+                self.check_compress_long(threads=threads, **kwargs)
+        # independent blocks are compressed exactly as when single-threaded
+        kwargs = {'block_size_id': LZ4F_BLOCKSIZE_MAX64KB, 'block_mode_linked': False, 'checksum': True}
+        self.assertEqual(compress(LONG_INPUT, threads=0, **kwargs), compress(LONG_INPUT, **kwargs))
+
+    def test_compress_threads_concurrent(self):
+        set_thread_pool_size(2)
+        results = []
+
+        def run():
+            results.append(all(decompress(compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX64KB, threads=0))
+                               == LONG_INPUT for _ in range(5)))
+
+        threads = [Thread(target=run) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(results, [True] * len(threads))
+
+    def test_thread_pool_stats(self):
+        with self.assertRaises(TypeError):
+            set_thread_pool_size('1')
+        with self.assertRaises(ValueError):
+            set_thread_pool_size(-1)
+        set_thread_pool_size(3)
+        stats = get_thread_pool_stats()
+        self.assertEqual(stats['size'], 3)
+        self.assertEqual(stats['queue_depths'], [])
+        compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX64KB, threads=0)
+        stats = get_thread_pool_stats()
+        self.assertEqual(stats['size'], 3)
+        self.assertEqual(stats['queue_depths'], [0, 0, 0])
+        self.assertEqual(stats['queued'], 0)
+        # one task per block (workers might not have updated completion counters just yet)
+        self.assertTrue(stats['submitted'] >= len(LONG_INPUT) // get_block_size(LZ4F_BLOCKSIZE_MAX64KB))
+        self.assertTrue(stats['completed'] <= stats['submitted'])
+        self.assertTrue(stats['max_queued'] > 0)
+
+    @skipIf(not path.isfile(path.join(SOURCE_DIR, 'setup.py')), 'requires source tree')
+    def test_compress_threads_without_pool(self):
+        # extension built with tasks run inline, as on platforms without pthreads (where the pool size is zero)
+        build_dir = mkdtemp()
+        try:
+            with open(os_devnull, 'wb') as devnull:
+                self.assertEqual(call((executable, 'setup.py', 'build_ext', '-b', build_dir, '-t',
+                                       path.join(build_dir, 'tmp')), cwd=SOURCE_DIR, stdout=devnull, stderr=devnull,
+                                      env=dict(environ, CFLAGS=environ.get('CFLAGS', '') + ' -DLZ4FRAMED_NO_POOL')),
+                                 0)
+            script = '\n'.join((
+                'from lz4framed import *',
+                'assert get_thread_pool_stats()["size"] == 0',
+                'data = b"abcdefghijklmnopqrstuvwxyz0123456789" * 10**5',
+                'with open("in", "wb") as f: f.write(data)',
+                'for threads in (0, 2):',
+                '    for linked in (True, False):',
+                '        kwargs = {"block_size_id": LZ4F_BLOCKSIZE_MAX64KB, "block_mode_linked": linked,',
+                '                  "checksum": True, "threads": threads}',
+                '        assert decompress(compress(data, **kwargs)) == data',
+                '        compress_file("in", "out", **kwargs)',
+                '        with open("out", "rb") as f: assert decompress(f.read()) == data',
+            ))
+            self.assertEqual(call((executable, '-c', script), cwd=build_dir,
+                                  env=dict(environ, PYTHONPATH=pathsep.join((build_dir, SOURCE_DIR)))), 0)
+        finally:
+            rmtree(build_dir)
+
+
+class TestAsyncFunctions(TestHelperMixin, TestCase):
+
+    def test_compress_async(self):
+        with self.assertRaises(TypeError):
+            compress_async()
+        with self.assertRaises(Lz4FramedNoDataError):
+            compress_async(b'')
+        with self.assertRaises(ValueError):
+            compress_async(SHORT_INPUT, level=LZ4F_COMPRESSION_FASTEST - 1)
+        for data in (SHORT_INPUT, LONG_INPUT, bytearray(LONG_INPUT), memoryview(LONG_INPUT)):
+            self.assertEqual(decompress(compress_async(data, checksum=True).result()), data)
+        # many outstanding at once
+        futures = [compress_async(LONG_INPUT[i:], block_mode_linked=False) for i in range(32)]
+        for i, future in enumerate(futures):
+            self.assertEqual(future.result(), compress(LONG_INPUT[i:], block_mode_linked=False))
+
+    def test_decompress_async(self):
+        with self.assertRaises(Lz4FramedNoDataError):
+            decompress_async(b'')
+        with self.assertRaises(ValueError):
+            decompress_async(SHORT_INPUT, buffer_size=0)
+        for data in (SHORT_INPUT, LONG_INPUT):
+            self.assertEqual(decompress_async(compress(data)).result(), data)
+        # without content size
+        with BytesIO() as out:
+            with Compressor(out) as compressor:
+                compressor.update(LONG_INPUT)
+            self.assertEqual(decompress_async(out.getvalue(), buffer_size=1).result(), LONG_INPUT)
+
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_frameType_unknown):
+            decompress_async(b'invalidheader').result()
+        with self.assertRaisesRegex(ValueError, 'frame incomplete'):
+            decompress_async(compress(LONG_INPUT)[:-5]).result()
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_contentChecksum_invalid):
+            decompress_async(compress(LONG_INPUT, checksum=True)[:-1] + b'0').result()
+
+    def test_decompress_into_async(self):
+        with self.assertRaises(Lz4FramedNoDataError):
+            decompress_into_async(b'', bytearray(1))
+        with self.assertRaises(BufferError):
+            decompress_into_async(compress(SHORT_INPUT), SHORT_INPUT)
+        buffers = [bytearray(len(LONG_INPUT)) for _ in range(8)]
+        futures = [decompress_into_async(compress(LONG_INPUT), buffer) for buffer in buffers]
+        for future, buffer in zip(futures, buffers):
+            self.assertEqual(future.result(), len(LONG_INPUT))
+            self.assertEqual(buffer, LONG_INPUT)
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_dstMaxSize_tooSmall):
+            decompress_into_async(compress(LONG_INPUT), bytearray(10)).result()
+
+    def test_compress_iter(self):
+        with self.assertRaises(ValueError):
+            next(compress_iter([SHORT_INPUT], lookahead=0))
+        with self.assertRaises(Lz4FramedNoDataError):
+            list(compress_iter(iter([b'', b''])))
+        with self.assertRaises(ValueError):
+            list(compress_iter([SHORT_INPUT], level=LZ4F_COMPRESSION_FASTEST - 1))
+        chunks = [LONG_INPUT[i:i + 7777] for i in range(0, len(LONG_INPUT), 7777)]
+        for kwargs in ({}, {'lookahead': 1}, {'checksum': True, 'block_mode_linked': False, 'autoflush': True}):
+            output = b''.join(compress_iter((chunk for chunk in chunks), **kwargs))
+            self.assertEqual(decompress(output), LONG_INPUT)
+        # any buffer protocol objects, with emptiness determined by size in bytes (rather than truthiness or len())
+        floats = array('d', range(100000))
+        for chunks in ((b'', floats[:50000], array('d'), floats[50000:]), [_Unsized(floats)]):
+            self.assertEqual(decompress(b''.join(compress_iter(chunks))), floats.tobytes())
+        if numpy is not None:
+            matrix = numpy.arange(100000, dtype=numpy.float64).reshape(1000, 100)
+            self.assertEqual(decompress(b''.join(compress_iter([matrix[:1], matrix[1:]]))), matrix.tobytes())
+
+    def test_decompress_iter(self):
+        with self.assertRaises(ValueError):
+            next(decompress_iter([SHORT_INPUT], lookahead=0))
+        with self.assertRaises(Lz4FramedNoDataError):
+            list(decompress_iter([]))
+        data = compress(LONG_INPUT, checksum=True)
+        for size, lookahead in ((1000, 4), (len(data), 1), (15, 32)):
+            chunks = (data[i:i + size] for i in range(0, len(data), size))
+            self.assertEqual(b''.join(decompress_iter(chunks, lookahead=lookahead)), LONG_INPUT)
+        # incomplete & invalid frames
+        with self.assertRaises(Lz4FramedNoDataError):
+            list(decompress_iter([data[:-10]]))
+        with self.assertRaisesLz4FramedError(LZ4F_ERROR_contentChecksum_invalid):
+            list(decompress_iter([data[:-1], b'0']))
+        # any buffer protocol objects, see test_compress_iter()
+        data = compress(LONG_INPUT)
+        half = len(data) // 2
+        chunks = [array('B', data[:half]), array('B'), _Unsized(data[half:])]
+        self.assertEqual(b''.join(decompress_iter(chunks)), LONG_INPUT)
+        if numpy is not None:
+            chunks = [numpy.frombuffer(part, dtype=numpy.uint8) for part in (data[:half], data[half:])]
+            self.assertEqual(b''.join(decompress_iter(chunks)), LONG_INPUT)
+
+
+class _Unsized(bytearray):
+    """Buffer whose len() does not reflect its size in bytes"""
+
+    def __len__(self):
+        return 0
+
+
+class _OutOfBand(object):
+
+    def __init__(self, data):
+        self.data = data
+
+    def __reduce_ex__(self, protocol):
+        return _OutOfBand, (PickleBuffer(self.data),)
+
+
+@skipIf(not PICKLE5_SUPPORTED, 'pickle protocol 5 requires Python v3.8+')
+class TestPickling(TestHelperMixin, TestCase):
+
+    def test_pickling_invalid(self):
+        with self.assertRaises(ValueError):
+            dumps(SHORT_INPUT, oob_threshold=0)
+        data = dumps([_OutOfBand(LONG_INPUT), _OutOfBand(LONG_INPUT[::-1])])
+        # truncated offsets table, frame overlapping table
+        for data in (b'', b'short', compress(LONG_INPUT), dumps(LONG_INPUT)[:-5], data[:40],
+                     data[:16] + pack('<Q', 0) + data[24:]):
+            with self.assertRaises(ValueError):
+                loads(data)
+
+    def test_pickling(self):
+        obj = {'list': [1, 2.0, 'three'], 'small': _OutOfBand(SHORT_INPUT), 'large': _OutOfBand(LONG_INPUT),
+               'mutable': _OutOfBand(bytearray(LONG_INPUT[::-1]))}
+        data = dumps(obj)
+        self.assertLess(len(data), len(LONG_INPUT))
+        # stream & two large buffers, preceded by offsets table
+        frames = scan_frames(data)
+        self.assertEqual([frame['skippable'] for frame in frames], [True, False, False, False])
+        self.assertEqual(sorted(frame['uncompressed_length'] for frame in frames[2:]), [len(LONG_INPUT)] * 2)
+        result = loads(data)
+        self.assertEqual(result['list'], obj['list'])
+        self.assertEqual(result['small'].data, SHORT_INPUT)
+        # read-only buffers are restored as such by pickle
+        self.assertEqual(result['large'].data, LONG_INPUT)
+        self.assertTrue(result['large'].data.readonly)
+        self.assertIsInstance(result['mutable'].data, bytearray)
+        self.assertEqual(result['mutable'].data, obj['mutable'].data)
+        # everything in-band
+        self.assertEqual(len(scan_frames(dumps(obj, oob_threshold=len(LONG_INPUT) + 1))), 2)
+        self.assertEqual(loads(dumps(obj, oob_threshold=len(LONG_INPUT) + 1))['large'].data, LONG_INPUT)
+
+
+@skipIf(not ASYNC_SUPPORTED, 'asyncio adapters require Python v3.6+')
+@skipIf(not SOCKETS_SUPPORTED, 'Socket (de)compression not supported')
+class TestSocketStreams(TestHelperMixin, TestCase):
+
+    def setUp(self):
+        super(TestSocketStreams, self).setUp()
+        self.sock_a, self.sock_b = socketpair()
+
+    def tearDown(self):
+        self.sock_a.close()
+        self.sock_b.close()
+        super(TestSocketStreams, self).tearDown()
+
+    @staticmethod
+    def __recv_all(sock, output):
+        while True:
+            data = sock.recv(65536)
+            if not data:
+                break
+            output.append(data)
+
+    def test_socket_compressor(self):
+        output = []
+        receiver = Thread(target=self.__recv_all, args=(self.sock_b, output))
+        receiver.start()
+        try:
+            with SocketCompressor(self.sock_a, checksum=True) as compressor:
+                for i in range(0, len(LONG_INPUT), 100 * 1024):
+                    self.assertEqual(compressor.update(memoryview(LONG_INPUT)[i:i + 100 * 1024]), 0)
+                self.assertEqual(compressor.flush(), 0)
+                with self.assertRaises(Lz4FramedNoDataError):
+                    compressor.update(b'')
+            self.assertEqual(compressor.pending, 0)
+        finally:
+            self.sock_a.shutdown(2)
+            receiver.join()
+        self.assertEqual(decompress(b''.join(output)), LONG_INPUT)
+
+        with self.assertRaises(ValueError):
+            SocketCompressor(-1)
+
+    def test_socket_decompressor(self):
+        frames = [compress(LONG_INPUT, block_size_id=LZ4F_BLOCKSIZE_MAX4MB), compress(SHORT_INPUT, checksum=True)]
+        # incomplete
+        sender = Thread(target=self.sock_a.sendall, args=(b''.join(frames) + frames[0][:-32],))
+        sender.start()
+        try:
+            # consecutive frames via same instance
+            decompressor = SocketDecompressor(self.sock_b)
+            self.assertEqual(b''.join(decompressor), LONG_INPUT)
+            self.assertTrue(decompressor.finished)
+            self.assertEqual(b''.join(decompressor), SHORT_INPUT)
+        finally:
+            sender.join()
+        self.sock_a.shutdown(2)
+        with self.assertRaises(Lz4FramedNoDataError):
+            b''.join(decompressor)
+
+    def test_socket_timeout(self):
+        self.sock_b.settimeout(0.05)
+        with self.assertRaises(OSError):
+            SocketDecompressor(self.sock_b).recv()
+        # explicit timeout overrides socket's
+        self.assertEqual(SocketDecompressor(self.sock_b, timeout=0).recv(), [])
+
+    @skipIf(PY2, 'selectors not available')
+    def test_socket_non_blocking(self):
+        self.sock_a.setblocking(False)
+        self.sock_b.setblocking(False)
+        compressor = SocketCompressor(self.sock_a, block_size_id=LZ4F_BLOCKSIZE_MAX256KB)
+        decompressor = SocketDecompressor(self.sock_b)
+        output = []
+        to_send = [LONG_INPUT[i:i + 256 * 1024] for i in range(0, len(LONG_INPUT), 256 * 1024)]
+
+        with DefaultSelector() as selector:
+            selector.register(self.sock_a, EVENT_WRITE)
+            selector.register(self.sock_b, EVENT_READ)
+            while not decompressor.finished:
+                for key, _ in selector.select(5):
+                    if key.fileobj is self.sock_b:
+                        output.extend(decompressor.recv())
+                    # only compress more once previous output has been sent
+                    elif compressor.send_pending() == 0:
+                        if to_send:
+                            compressor.update(to_send.pop(0))
+                        elif to_send is not None:
+                            compressor.end()
+                            to_send = None
+                        else:
+                            selector.unregister(self.sock_a)
+
+        self.assertEqual(b''.join(output), LONG_INPUT)
+        self.assertEqual(compressor.pending, 0)
+
+
+class TestAsyncAdapters(TestHelperMixin, TestCase):
+
+    def setUp(self):
+        super(TestAsyncAdapters, self).setUp()
+        self.__loop = new_event_loop()
+
+    def tearDown(self):
+        self.__loop.close()
+        super(TestAsyncAdapters, self).tearDown()
+
+    def __run(self, coroutine):
+        return self.__loop.run_until_complete(coroutine)
+
+    def __reader(self, data):
+        reader = StreamReader(loop=self.__loop) if version_info < (3, 10) else StreamReader()
+        reader.feed_data(data)
+        reader.feed_eof()
+        return reader
+
+    class Writer(BytesIO):
+
+        async def drain(self):
+            pass
+
+    def test_async_compressor(self):
+        async def compress_chunks(writer, data, **kwargs):
+            half = len(data) // 2
+            async with AsyncCompressor(writer, **kwargs) as compressor:
+                # both below and above inline threshold
+                for i in range(0, half, 1024):
+                    await compressor.update(data[i:min(i + 1024, half)])
+                for i in range(half, len(data), 100 * 1024):
+                    await compressor.update(data[i:i + 100 * 1024])
+
+        for kwargs in ({}, {'checksum': True, 'autoflush': True}):
+            writer = self.Writer()
+            self.__run(compress_chunks(writer, LONG_INPUT, **kwargs))
+            self.assertEqual(decompress(writer.getvalue()), LONG_INPUT)
+
+        with self.assertRaises(Lz4FramedNoDataError):
+            self.__run(AsyncCompressor(self.Writer()).update(b''))
+        # inline threshold applies to size in bytes (rather than len())
+        async def compress_single(writer, data):
+            async with AsyncCompressor(writer) as compressor:
+                await compressor.update(data)
+
+        floats = array('d', range(8192))
+        for data in (floats, _Unsized(floats)):
+            writer = self.Writer()
+            submitted = get_thread_pool_stats()['submitted']
+            self.__run(compress_single(writer, data))
+            self.assertGreater(get_thread_pool_stats()['submitted'], submitted)
+            self.assertEqual(decompress(writer.getvalue()), floats.tobytes())
+
+    def test_async_decompressor(self):
+        async def decompress_all(decompressor):
+            return b''.join([chunk async for chunk in decompressor])
+
+        for data in (SHORT_INPUT, LONG_INPUT):
+            decompressor = AsyncDecompressor(self.__reader(compress(data, checksum=True)))
+            self.assertEqual(self.__run(decompress_all(decompressor)), data)
+            self.assertEqual(decompressor.frame_info['length'], len(data))
+
+        with self.assertRaises(Lz4FramedNoDataError):
+            self.__run(decompress_all(AsyncDecompressor(self.__reader(compress(LONG_INPUT)[:-32]))))
+        # blocks above inline threshold are decompressed on the native thread pool
+        data = urandom(200000) + LONG_INPUT
+        submitted = get_thread_pool_stats()['submitted']
+        for block_size_id in (LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX4MB):
+            decompressor = AsyncDecompressor(self.__reader(compress(data, block_size_id=block_size_id)))
+            self.assertEqual(self.__run(decompress_all(decompressor)), data)
+        self.assertGreater(get_thread_pool_stats()['submitted'], submitted)
+
+
+class TestBench(TestHelperMixin, TestCase):
+
+    def test_synthetic_data(self):
+        data = synthetic_data(100000)
+        self.assertEqual(len(data), 100000)
+        self.assertEqual(synthetic_data(100000), data)
+        self.assertNotEqual(synthetic_data(100000, seed=1), data)
+        self.assertLess(len(compress(data)), len(data))
+
+    def test_bench(self):
+        with self.assertRaises(ValueError):
+            list(bench(SHORT_INPUT, iterations=0))
+        with self.assertRaises(Lz4FramedNoDataError):
+            list(bench(b''))
+        results = list(bench(LONG_INPUT, name='long', levels=(-1, LZ4F_COMPRESSION_MIN, 9),
+                             block_size_ids=(LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX4MB), iterations=1, threads=0))
+        self.assertEqual([(result.block_size_id, result.level) for result in results],
+                         [(block_size_id, level) for block_size_id in (LZ4F_BLOCKSIZE_MAX64KB, LZ4F_BLOCKSIZE_MAX4MB)
+                          for level in (-1, LZ4F_COMPRESSION_MIN, 9)])
+        for result in results:
+            self.assertEqual(result.name, 'long')
+            self.assertEqual(result.size, len(LONG_INPUT))
+            self.assertEqual(result.compressed_size, len(compress(LONG_INPUT, block_size_id=result.block_size_id,
+                                                                  level=result.level, threads=0)))
+            self.assertGreater(result.ratio, 1)
+            self.assertGreater(result.compress_speed, 0)
+            self.assertGreater(result.decompress_speed, 0)
+            self.assertIn('long', str(result))